@@ -0,0 +1,259 @@
+// Память и скорость обхода реестра на 1M клиентов: прежние записи ClientInfo (профиль - две строки
+// std::string в shared_ptr, кэшированный снимок из ClientView) против структуры массивов шарда
+// (горячие адрес, last_seen и флаги - в плотных массивах, имена в арене и интернированное
+// оборудование в ProfileStore). Память - прирост занятой памяти glibc (mallinfo2, включая блоки
+// mmap) при регистрации.
+// Сборка: g++ -O2 -o compact_registry_bench bench/compact_registry_bench.cpp
+#include <iostream>
+#include <iomanip>
+#include <algorithm>
+#include <vector>
+#include <string>
+#include <memory>
+#include <chrono>
+#include <ctime>
+#include <malloc.h>
+
+#include "../server/flat_map.h"
+#include "../server/client_store.h"
+
+constexpr uint32_t CLIENTS = 1'000'000;
+constexpr int REPEATS = 15;
+
+struct Match;
+
+struct RttEstimate {
+    uint32_t srtt_us = 0;
+    uint32_t rttvar_us = 0;
+};
+
+// Прежняя запись реестра.
+struct ClientProfile {
+    std::string name;
+    std::string hardware;
+};
+
+struct ClientInfo {
+    std::shared_ptr<const ClientProfile> profile;
+    time_t last_seen;
+    bool active;
+    sockaddr_in addr;
+    bool multicast;
+    int64_t inactive_since_ms;
+    Match *match;
+    uint32_t match_slot;
+    uint8_t protocol;
+    uint32_t record;
+    RttEstimate rtt;
+    RttEstimate response;
+    uint64_t rtt_probe_ms;
+    uint32_t heartbeat_ms;
+    uint8_t probes;
+};
+
+struct ClientView {
+    std::shared_ptr<const ClientProfile> profile;
+    sockaddr_in addr;
+    time_t last_seen;
+    int64_t inactive_since_ms;
+    bool active;
+    bool multicast;
+    uint8_t protocol;
+};
+
+struct LegacyRegistry {
+    std::vector<ClientInfo> clients;
+    FlatMap<uint32_t> ids;
+    std::vector<ClientView> snapshot;
+
+    void take_snapshot() {
+        std::vector<ClientView> views;
+        views.reserve(clients.size());
+        for (const auto &c: clients) {
+            views.push_back({c.profile, c.addr, c.last_seen, c.inactive_since_ms, c.active, c.multicast, c.protocol});
+        }
+        snapshot = std::move(views);
+    }
+};
+
+// Новая раскладка шарда.
+enum ClientFlag : uint8_t { CLIENT_ACTIVE = 1, CLIENT_MULTICAST = 2, CLIENT_V2 = 4 };
+
+struct ClientSession {
+    Match *match = nullptr;
+    uint32_t match_slot = 0;
+    uint32_t heartbeat_ms = 3000;
+    RttEstimate rtt{};
+    RttEstimate response{};
+    uint32_t rtt_probe_ms = 0;
+    uint8_t probes = 0;
+};
+
+struct ClientCold {
+    const char *name;
+    const HardwareProfile *hardware;
+    int64_t inactive_since_ms;
+    uint32_t record;
+};
+
+struct CompactSnapshot {
+    std::vector<uint64_t> keys;
+    std::vector<uint32_t> last_seen;
+    std::vector<uint8_t> flags;
+    std::vector<ClientCold> cold;
+};
+
+struct CompactRegistry {
+    std::vector<uint64_t> keys;
+    std::vector<uint32_t> last_seen;
+    std::vector<uint8_t> flags;
+    std::vector<ClientSession> sessions;
+    std::vector<ClientCold> cold;
+    FlatMap<uint32_t> ids;
+    CompactSnapshot snapshot;
+
+    void take_snapshot() { snapshot = CompactSnapshot{keys, last_seen, flags, cold}; }
+};
+
+uint64_t key_of(uint32_t i) { return (uint64_t{0x0A000000u + i / 50000} << 16) | (10000 + i % 50000); }
+
+// Имя как у клиента в docker compose: Client_ и 12 символов имени хоста.
+std::string name_of(uint32_t i) {
+    char name[32];
+    snprintf(name, sizeof(name), "Client_%012x", i * 2654435761u);
+    return name;
+}
+
+uint16_t cpus_of(uint32_t i) { return static_cast<uint16_t>(2 << (i % 4)); }
+uint32_t ram_of(uint32_t i) { return 4096u << (i / 4 % 3); }
+
+size_t heap_used() {
+    struct mallinfo2 info = mallinfo2();
+    return info.uordblks + info.hblkhd; // hblkhd - крупные блоки, выделенные через mmap
+}
+
+template<typename F>
+double best_ms(F &&body) {
+    double best = 1e100;
+    for (int r = 0; r < REPEATS; ++r) {
+        auto start = std::chrono::steady_clock::now();
+        body();
+        best = std::min(best, std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+    }
+    return best;
+}
+
+struct Result {
+    double bytes_per_client, snapshot_bytes_per_client, snapshot_ms, sweep_ms, broadcast_ms;
+    size_t swept, destinations;
+};
+
+// Проверка неактивности обходом (как до колеса таймеров) и сбор адресов рассылки по снимку.
+Result run_legacy() {
+    Result result{};
+    size_t before = heap_used();
+    auto *registry = new LegacyRegistry;
+    time_t now = time(nullptr);
+    for (uint32_t i = 0; i < CLIENTS; ++i) {
+        auto profile = std::make_shared<const ClientProfile>(ClientProfile{
+            name_of(i), "CPU:" + std::to_string(cpus_of(i)) + " RAM:" + std::to_string(ram_of(i)) + "MB"
+        });
+        sockaddr_in addr = unpack_addr(key_of(i));
+        registry->ids.try_emplace(key_of(i), i);
+        registry->clients.push_back({profile, now - (i % 100 == 0 ? 60 : 0), true, addr, i % 3 == 0, 0, nullptr, 0,
+                                     static_cast<uint8_t>(i % 10 ? 2 : 1), i, {}, {}, 0, 3000, 0});
+    }
+    size_t registered = heap_used();
+    registry->take_snapshot();
+    result.bytes_per_client = double(registered - before) / CLIENTS;
+    result.snapshot_bytes_per_client = double(heap_used() - registered) / CLIENTS;
+    result.snapshot_ms = best_ms([&] { registry->take_snapshot(); });
+
+    time_t cutoff = now - 10;
+    result.sweep_ms = best_ms([&] {
+        result.swept = 0;
+        for (const auto &c: registry->clients) result.swept += c.active && c.last_seen < cutoff;
+    });
+    std::vector<sockaddr_in> text, wire;
+    result.broadcast_ms = best_ms([&] {
+        text.clear();
+        wire.clear();
+        for (const auto &c: registry->snapshot) {
+            if (!c.active || c.multicast) continue;
+            (c.protocol == 2 ? wire : text).push_back(c.addr);
+        }
+    });
+    result.destinations = text.size() + wire.size();
+    delete registry;
+    return result;
+}
+
+Result run_compact() {
+    Result result{};
+    size_t before = heap_used();
+    auto *store = new ProfileStore;
+    auto *registry = new CompactRegistry;
+    uint32_t now = static_cast<uint32_t>(time(nullptr));
+    for (uint32_t i = 0; i < CLIENTS; ++i) {
+        registry->ids.try_emplace(key_of(i), i);
+        registry->keys.push_back(key_of(i));
+        registry->last_seen.push_back(now - (i % 100 == 0 ? 60 : 0));
+        registry->flags.push_back(static_cast<uint8_t>(CLIENT_ACTIVE | (i % 3 == 0 ? CLIENT_MULTICAST : 0) |
+                                                       (i % 10 ? CLIENT_V2 : 0)));
+        registry->sessions.push_back(ClientSession{});
+        registry->cold.push_back({store->intern_name(name_of(i)), store->intern_hardware(cpus_of(i), ram_of(i)), 0, i});
+    }
+    size_t registered = heap_used();
+    registry->take_snapshot();
+    result.bytes_per_client = double(registered - before) / CLIENTS;
+    result.snapshot_bytes_per_client = double(heap_used() - registered) / CLIENTS;
+    result.snapshot_ms = best_ms([&] { registry->take_snapshot(); });
+
+    uint32_t cutoff = now - 10;
+    result.sweep_ms = best_ms([&] {
+        result.swept = 0;
+        for (size_t i = 0; i < registry->keys.size(); ++i) {
+            result.swept += (registry->flags[i] & CLIENT_ACTIVE) && registry->last_seen[i] < cutoff;
+        }
+    });
+    std::vector<sockaddr_in> text, wire;
+    const CompactSnapshot &snapshot = registry->snapshot;
+    result.broadcast_ms = best_ms([&] {
+        text.clear();
+        wire.clear();
+        for (size_t i = 0; i < snapshot.keys.size(); ++i) {
+            uint8_t flags = snapshot.flags[i];
+            if (!(flags & CLIENT_ACTIVE) || flags & CLIENT_MULTICAST) continue;
+            (flags & CLIENT_V2 ? wire : text).push_back(unpack_addr(snapshot.keys[i]));
+        }
+    });
+    result.destinations = text.size() + wire.size();
+    std::cout << "sizeof: ClientInfo " << sizeof(ClientInfo) << ", ClientView " << sizeof(ClientView)
+            << "; горячие 13, ClientSession " << sizeof(ClientSession) << ", ClientCold " << sizeof(ClientCold)
+            << "; описаний оборудования " << store->hardware_count() << "\n";
+    delete registry;
+    delete store;
+    return result;
+}
+
+int main() {
+    std::cout << "Реестр на " << CLIENTS << " клиентов (лучшее из " << REPEATS << " проходов)\n";
+    Result legacy = run_legacy();
+    Result compact = run_compact();
+    if (legacy.swept != compact.swept || legacy.destinations != compact.destinations) {
+        std::cerr << "Раскладки дали разные результаты\n";
+        return 1;
+    }
+    std::cout << std::left << std::setw(20) << "layout" << std::setw(16) << "bytes/client" << std::setw(18)
+            << "snapshot B/client" << std::setw(16) << "snapshot (ms)" << std::setw(14) << "sweep (ms)"
+            << "broadcast (ms)\n";
+    for (int variant = 0; variant < 2; ++variant) {
+        const Result &r = variant == 0 ? legacy : compact;
+        std::cout << std::left << std::setw(20) << (variant == 0 ? "ClientInfo (before)" : "SoA (after)")
+                << std::fixed << std::setprecision(1) << std::setw(16) << r.bytes_per_client << std::setw(18)
+                << r.snapshot_bytes_per_client << std::setprecision(2) << std::setw(16) << r.snapshot_ms
+                << std::setw(14) << r.sweep_ms << r.broadcast_ms << "\n";
+    }
+    std::cout << "Неактивных по обходу: " << compact.swept << ", адресов рассылки: " << compact.destinations << "\n";
+    return 0;
+}
@@ -0,0 +1,312 @@
+// Детерминированная симуляция турниров: матчи сервера (server/match.h - тот же код раундов,
+// повторов CHOOSE и сроков) работают против виртуальных часов и модели сети в одном потоке.
+// Вместо ожидания реального времени цикл событий сразу переходит к следующему событию, так что
+// раунд со сроком в секунды и паузой между раундами стоит микросекунды процессора, и миллионы
+// виртуальных клиентов проходят турнир за секунды. Задержки и потери датаграмм в обе стороны
+// и время ответа клиентов задаются распределениями; все случайные величины берутся из одного
+// генератора с --seed, поэтому при тех же параметрах контрольная сумма итогов совпадает, а
+// пропускную способность (раундов, выборов и событий в секунду) можно сравнивать между коммитами.
+// Случайные выборы большого матча почти всегда дают все три варианта, то есть ничью, поэтому
+// матчи по умолчанию - по 4 участника, а матч дольше --max-rounds раундов снимается с игры.
+// Сборка: g++ -O2 -o match_sim bench/match_sim.cpp -lpthread
+#include <iostream>
+#include <iomanip>
+#include <algorithm>
+#include <vector>
+#include <string>
+#include <memory>
+#include <queue>
+#include <random>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+
+#include "../loadgen/delay_distribution.h"
+#include "../server/match.h"
+
+struct SimConfig {
+    uint64_t seed = 1;
+    size_t clients = 1'000'000;
+    size_t match_size = 4; // 0 - один матч со всеми
+    unsigned tournaments = 1;
+    int max_rounds = 1000;
+    double loss = 0; // вероятность потерять CHOOSE или выбор
+    double silent = 0; // доля клиентов, которые не отвечают никогда
+    DelayDistribution latency{DelayDistribution::UNIFORM, 1, 20}; // в одну сторону
+    DelayDistribution reply{DelayDistribution::EXP, 50, 0};
+};
+
+// Виртуальные клиенты: адрес клиента i - 10.0.0.0 + i, порт 1, так что номер клиента
+// восстанавливается из адреса назначения CHOOSE.
+sockaddr_in sim_addr(uint32_t client) {
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(0x0A000000u + client);
+    addr.sin_port = htons(1);
+    return addr;
+}
+
+uint32_t sim_client(const sockaddr_in &addr) { return ntohl(addr.sin_addr.s_addr) - 0x0A000000u; }
+
+// Цикл событий на виртуальном времени и окружение матчей: CHOOSE превращается в событие
+// прихода выбора через задержку туда, время ответа и задержку обратно (если ни одна из двух
+// датаграмм не потерялась), шаг матча планируется на момент, который вернул step().
+class Simulation final : public MatchHost {
+public:
+    explicit Simulation(const SimConfig &config) : config_(config), gen_(config.seed),
+                                                   client_match_(config.clients), client_slot_(config.clients),
+                                                   client_round_(config.clients), client_choice_(config.clients),
+                                                   client_silent_(config.clients) {
+        std::bernoulli_distribution silent(config.silent);
+        for (size_t i = 0; i < config.clients; ++i) client_silent_[i] = silent(gen_);
+    }
+
+    SteadyTime now() const override { return BASE + std::chrono::microseconds(now_us_); }
+    uint32_t unix_seconds() const override { return 1'700'000'000u + static_cast<uint32_t>(now_us_ / 1000000); }
+    bool running() const override { return true; }
+    uint32_t next_round_id() override { return next_round_id_++; }
+
+    void send_choose(uint32_t round, const std::vector<sockaddr_in> &text,
+                     const std::vector<sockaddr_in> &wire) override {
+        for (const auto *list: {&text, &wire}) {
+            for (const sockaddr_in &addr: *list) deliver_choose(sim_client(addr), round);
+        }
+    }
+
+    Notice notice(wire::ResultKind kind, std::string text, uint32_t match, uint32_t value,
+                  std::string_view name) override {
+        wire::ResultBody body{};
+        body.kind = kind;
+        body.match = htonl(match);
+        body.value = htonl(value);
+        wire::set_name(body.name, name);
+        return {std::move(text), wire::frame(wire::OP_RESULT, 0, wire_seq_++, body)};
+    }
+
+    void broadcast(const Notice &notice, const std::vector<uint32_t> *members) override {
+        uint64_t count = members ? members->size() : config_.clients;
+        totals_.results += count;
+        totals_.result_bytes += count * notice.frame.size();
+    }
+
+    std::string client_name(uint32_t id) const override { return "Sim_" + std::to_string(id); }
+
+    void record(MatchStat stat, uint64_t value) override {
+        if (stat == STAT_CHOOSE_RETRANSMITS) totals_.retransmits += value;
+        else if (stat == STAT_ROUNDS) totals_.rounds += value;
+        else if (stat == STAT_CHOICE_RTT_NS) totals_.choices++;
+    }
+
+    struct Totals {
+        uint64_t matches = 0, winners = 0, capped = 0, rounds = 0, choices = 0, stale = 0, retransmits = 0;
+        uint64_t chooses = 0, lost = 0, results = 0, result_bytes = 0, events = 0, virtual_us = 0;
+        uint64_t checksum = 1469598103934665603ULL; // FNV-1a по итогам матчей
+    };
+
+    // Один турнир: клиенты перемешиваются и делятся на матчи, как prepare_tournament.
+    void run_tournament(uint32_t number) {
+        std::vector<uint32_t> lobby(config_.clients);
+        for (uint32_t i = 0; i < lobby.size(); ++i) lobby[i] = i;
+        size_t size = config_.match_size >= 2 && config_.match_size < lobby.size() ? config_.match_size : lobby.size();
+        if (size < lobby.size()) std::shuffle(lobby.begin(), lobby.end(), gen_);
+
+        matches_.clear();
+        for (size_t begin = 0; begin < lobby.size(); begin += size) {
+            size_t end = std::min(lobby.size(), begin + size);
+            if (lobby.size() - end == 1) end = lobby.size();
+            auto match = std::make_unique<Match>();
+            match->host = this;
+            match->number = static_cast<uint32_t>(matches_.size() + 1);
+            match->whole_lobby = size == lobby.size();
+            std::vector<uint32_t> ids(lobby.begin() + begin, lobby.begin() + end);
+            std::vector<sockaddr_in> addrs;
+            for (uint32_t id: ids) {
+                client_match_[id] = static_cast<uint32_t>(matches_.size());
+                client_slot_[id] = static_cast<uint32_t>(addrs.size());
+                client_round_[id] = 0;
+                addrs.push_back(sim_addr(id));
+            }
+            match->assign(std::move(ids), std::move(addrs), std::vector<uint8_t>(end - begin, wire::VERSION));
+            matches_.push_back(std::move(match));
+            generation_.push_back(0);
+            capped_.push_back(0);
+            schedule_step(static_cast<uint32_t>(matches_.size() - 1), now_us_);
+            if (end == lobby.size()) break;
+        }
+
+        uint64_t started_us = now_us_;
+        while (!events_.empty()) {
+            Event event = events_.top();
+            events_.pop();
+            now_us_ = event.at_us;
+            totals_.events++;
+            if (event.kind == Event::STEP) step(event);
+            else choice(event);
+        }
+        totals_.virtual_us += now_us_ - started_us;
+
+        for (const auto &match: matches_) {
+            totals_.matches++;
+            totals_.winners += match->has_winner;
+            totals_.capped += capped_[match->number - 1];
+            for (uint64_t value: {uint64_t{number}, uint64_t{match->number}, uint64_t(match->rounds),
+                                  match->has_winner ? uint64_t{match->winner} : ~uint64_t{0}}) {
+                totals_.checksum = (totals_.checksum ^ value) * 1099511628211ULL;
+            }
+        }
+        matches_.clear();
+        generation_.clear();
+        capped_.clear();
+    }
+
+    const Totals &totals() const { return totals_; }
+
+private:
+    inline static const SteadyTime BASE = SteadyTime(std::chrono::hours(1));
+
+    struct Event {
+        enum Kind : uint8_t { STEP, CHOICE };
+        uint64_t at_us;
+        uint64_t order; // порядок постановки: одновременные события выполняются детерминированно
+        Kind kind;
+        uint8_t choice;
+        uint32_t target; // номер матча или клиента
+        uint32_t value; // поколение шага матча или идентификатор раунда
+
+        bool operator>(const Event &other) const {
+            return at_us != other.at_us ? at_us > other.at_us : order > other.order;
+        }
+    };
+
+    void push(uint64_t at_us, Event::Kind kind, uint32_t target, uint32_t value, uint8_t choice = 0) {
+        events_.push({at_us, next_order_++, kind, choice, target, value});
+    }
+
+    // Новый шаг отменяет запланированный раньше: step() всегда заново вычисляет свой срок.
+    void schedule_step(uint32_t match, uint64_t at_us) {
+        if (!capped_[match]) push(at_us, Event::STEP, match, ++generation_[match]);
+    }
+
+    void step(const Event &event) {
+        if (event.value != generation_[event.target] || capped_[event.target]) return;
+        Match &match = *matches_[event.target];
+        std::optional<SteadyTime> next = match.step(now());
+        if (!next) return;
+        if (match.rounds >= config_.max_rounds && match.state == Match::State::PAUSE) {
+            capped_[event.target] = 1;
+            return;
+        }
+        uint64_t at = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(*next - BASE).count());
+        schedule_step(event.target, std::max(at, now_us_));
+    }
+
+    bool lost() { return config_.loss > 0 && std::uniform_real_distribution<double>(0, 1)(gen_) < config_.loss; }
+
+    // Клиент отвечает на CHOOSE, как client/client.cpp: на повтор того же раунда - тем же выбором.
+    void deliver_choose(uint32_t client, uint32_t round) {
+        totals_.chooses++;
+        if (lost()) {
+            totals_.lost++;
+            return;
+        }
+        if (client_silent_[client]) return;
+        if (client_round_[client] != round) {
+            client_round_[client] = round;
+            client_choice_[client] = static_cast<uint8_t>(gen_() % 3);
+        }
+        uint64_t delay = config_.latency.sample_us(gen_) + config_.reply.sample_us(gen_);
+        if (lost()) {
+            totals_.lost++;
+            return;
+        }
+        push(now_us_ + delay + config_.latency.sample_us(gen_), Event::CHOICE, client, round, client_choice_[client]);
+    }
+
+    void choice(const Event &event) {
+        uint32_t client = event.target;
+        uint32_t index = client_match_[client];
+        uint32_t response_us;
+        Match::ChoiceOutcome outcome = matches_[index]->record_choice(
+            client_slot_[client], static_cast<GameChoice>(event.choice), event.value, response_us);
+        if (outcome == Match::ChoiceOutcome::STALE) totals_.stale++;
+        if (outcome == Match::ChoiceOutcome::ROUND_COMPLETE) schedule_step(index, now_us_);
+    }
+
+    SimConfig config_;
+    std::mt19937_64 gen_;
+    uint64_t now_us_ = 0;
+    uint64_t next_order_ = 0;
+    uint32_t next_round_id_ = 1;
+    uint32_t wire_seq_ = 0;
+    std::priority_queue<Event, std::vector<Event>, std::greater<> > events_;
+    std::vector<std::unique_ptr<Match> > matches_;
+    std::vector<uint32_t> generation_;
+    std::vector<uint8_t> capped_; // матч снят с игры после --max-rounds раундов
+    std::vector<uint32_t> client_match_;
+    std::vector<uint32_t> client_slot_;
+    std::vector<uint32_t> client_round_;
+    std::vector<uint8_t> client_choice_;
+    std::vector<uint8_t> client_silent_;
+    Totals totals_;
+};
+
+bool parse_args(int argc, char *argv[], SimConfig &config) {
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        bool has_value = i + 1 < argc;
+        if (arg == "--seed" && has_value) config.seed = strtoull(argv[++i], nullptr, 10);
+        else if (arg == "--clients" && has_value) config.clients = strtoull(argv[++i], nullptr, 10);
+        else if (arg == "--match-size" && has_value) config.match_size = strtoull(argv[++i], nullptr, 10);
+        else if (arg == "--tournaments" && has_value) config.tournaments = std::max(1, atoi(argv[++i]));
+        else if (arg == "--max-rounds" && has_value) config.max_rounds = std::max(1, atoi(argv[++i]));
+        else if (arg == "--loss" && has_value) config.loss = atof(argv[++i]);
+        else if (arg == "--silent" && has_value) config.silent = atof(argv[++i]);
+        else if ((arg == "--latency" || arg == "--reply-delay") && has_value) {
+            if (!(arg == "--latency" ? config.latency : config.reply).parse(argv[++i])) {
+                std::cerr << "[Sim] " << arg << ": const:MS | uniform:MIN:MAX | exp:MEAN | normal:MEAN:STDDEV" << std::endl;
+                return false;
+            }
+        } else {
+            std::cerr << "[Sim] Неизвестный аргумент: " << arg << "\n"
+                    << "Использование: " << argv[0] << " [--seed N] [--clients N] [--match-size N] [--tournaments N] [--max-rounds N]"
+                    << " [--loss P] [--silent P] [--latency SPEC] [--reply-delay SPEC]" << std::endl;
+            return false;
+        }
+    }
+    if (config.clients < 2 || config.clients > UINT32_MAX / 2 || config.loss < 0 || config.loss >= 1 ||
+        config.silent < 0 || config.silent > 1) {
+        std::cerr << "[Sim] Некорректные параметры: нужны --clients >= 2, 0 <= --loss < 1, 0 <= --silent <= 1" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+int main(int argc, char *argv[]) {
+    SimConfig config;
+    if (!parse_args(argc, argv, config)) return 1;
+    std::cout << "[Sim] seed " << config.seed << ", клиентов " << config.clients << ", матчи по "
+            << (config.match_size >= 2 ? std::to_string(config.match_size) : "всем") << ", турниров "
+            << config.tournaments << ", потери " << config.loss * 100 << "%, молчащих " << config.silent * 100 << "%"
+            << std::endl;
+
+    auto started = std::chrono::steady_clock::now();
+    Simulation simulation(config);
+    for (unsigned t = 1; t <= config.tournaments; ++t) simulation.run_tournament(t);
+    double wall_s = std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+    Simulation::Totals totals = simulation.totals();
+    double virtual_s = totals.virtual_us / 1e6;
+
+    std::cout << std::fixed << std::setprecision(2)
+            << "Матчей " << totals.matches << " (с победителем " << totals.winners << ", снято после "
+            << config.max_rounds << " раундов " << totals.capped << "), раундов " << totals.rounds
+            << ", выборов " << totals.choices << " (устаревших " << totals.stale << ")\n"
+            << "CHOOSE " << totals.chooses << " (повторов " << totals.retransmits << ", потеряно датаграмм "
+            << totals.lost << "), результатов " << totals.results << " (" << totals.result_bytes / 1048576.0
+            << " МБ)\n"
+            << "Виртуальное время " << virtual_s << " с, реальное " << std::setprecision(3) << wall_s
+            << " с (ускорение " << std::setprecision(0) << virtual_s / std::max(wall_s, 1e-9) << "x)\n"
+            << "Раундов/с " << totals.rounds / wall_s << ", выборов/с " << totals.choices / wall_s << ", событий/с "
+            << totals.events / wall_s << "\n"
+            << "Контрольная сумма итогов: " << std::hex << totals.checksum << std::dec << std::endl;
+    return 0;
+}
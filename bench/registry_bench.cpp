@@ -0,0 +1,91 @@
+// Сравнение реестра клиентов: старый std::unordered_map<std::string, ClientInfo> с ключом "ip:port"
+// против FlatMap с упакованным 64-битным адресом и плотным вектором клиентов.
+// Сборка: g++ -O2 -o registry_bench bench/registry_bench.cpp
+#include <iostream>
+#include <iomanip>
+#include <unordered_map>
+#include <vector>
+#include <string>
+#include <chrono>
+#include <random>
+#include <ctime>
+
+#include "../server/flat_map.h"
+
+struct ClientInfo {
+    std::string name;
+    std::string hardware;
+    time_t last_seen;
+    bool active;
+    sockaddr_in addr;
+};
+
+std::string legacy_key(const sockaddr_in &addr) {
+    char ip[INET_ADDRSTRLEN];
+    inet_ntop(AF_INET, &addr.sin_addr, ip, sizeof(ip));
+    return std::string(ip) + ":" + std::to_string(ntohs(addr.sin_port));
+}
+
+template<typename F>
+double mops(size_t ops, F &&body) {
+    auto start = std::chrono::steady_clock::now();
+    body();
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    return ops / elapsed.count() / 1e6;
+}
+
+int main() {
+    const size_t lookups = 4'000'000;
+    std::mt19937_64 gen(42);
+
+    std::cout << std::left << std::setw(10) << "clients"
+            << std::setw(22) << "insert map (Mops/s)" << std::setw(22) << "insert flat (Mops/s)"
+            << std::setw(22) << "lookup map (Mops/s)" << std::setw(22) << "lookup flat (Mops/s)" << "\n";
+
+    for (size_t n: {size_t{1'000}, size_t{100'000}, size_t{1'000'000}}) {
+        std::vector<sockaddr_in> addrs(n);
+        for (size_t i = 0; i < n; ++i) {
+            addrs[i].sin_family = AF_INET;
+            addrs[i].sin_addr.s_addr = htonl(0x0A000000u + static_cast<uint32_t>(i / 50000));
+            addrs[i].sin_port = htons(static_cast<uint16_t>(10000 + i % 50000));
+        }
+        std::vector<size_t> order(lookups);
+        std::uniform_int_distribution<size_t> pick(0, n - 1);
+        for (auto &i: order) i = pick(gen);
+
+        std::unordered_map<std::string, ClientInfo> map_clients;
+        std::vector<ClientInfo> flat_clients;
+        FlatMap<uint32_t> flat_ids;
+
+        double insert_map = mops(n, [&] {
+            for (const auto &addr: addrs) {
+                map_clients[legacy_key(addr)] = ClientInfo{"Client", "CPU:4 RAM:8000MB", 0, true, addr};
+            }
+        });
+        double insert_flat = mops(n, [&] {
+            for (const auto &addr: addrs) {
+                auto [id, is_new] = flat_ids.try_emplace(pack_addr(addr), static_cast<uint32_t>(flat_clients.size()));
+                if (is_new) flat_clients.push_back(ClientInfo{"Client", "CPU:4 RAM:8000MB", 0, true, addr});
+            }
+        });
+
+        // Путь PING: найти клиента по адресу отправителя и обновить last_seen.
+        time_t now = time(nullptr);
+        double lookup_map = mops(lookups, [&] {
+            for (size_t i: order) {
+                auto it = map_clients.find(legacy_key(addrs[i]));
+                if (it != map_clients.end()) it->second.last_seen = now;
+            }
+        });
+        double lookup_flat = mops(lookups, [&] {
+            for (size_t i: order) {
+                if (const uint32_t *id = flat_ids.find(pack_addr(addrs[i]))) flat_clients[*id].last_seen = now;
+            }
+        });
+
+        std::cout << std::left << std::setw(10) << n << std::fixed << std::setprecision(2)
+                << std::setw(22) << insert_map << std::setw(22) << insert_flat
+                << std::setw(22) << lookup_map << std::setw(22) << lookup_flat << "\n";
+    }
+    return 0;
+}
@@ -0,0 +1,140 @@
+// Задержка обработки PING во время админского списка 100k клиентов: прежний обход с выводом
+// под мьютексом шарда против снимка реестра (копия записей под мьютексом, вывод без него).
+// Это модель реестра до перехода на структуру массивов: записи ClientInfo с shared_ptr на
+// профиль, 4 шарда, снимок копируется заново на каждый список. Серверный RegistrySnapshot с
+// тех пор устроен иначе (массивы полей, интернированные профили, кэш снимка по версии шарда),
+// поэтому бенчмарк показывает только выигрыш от вывода без мьютекса, а не время серверного
+// снимка. Копию массивов нынешней раскладки шарда измеряет compact_registry_bench.cpp.
+// Сборка: g++ -O2 -o snapshot_bench bench/snapshot_bench.cpp -lpthread
+#include <iostream>
+#include <iomanip>
+#include <sstream>
+#include <algorithm>
+#include <vector>
+#include <string>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <ctime>
+
+#include "../server/flat_map.h"
+
+constexpr uint32_t CLIENTS = 100'000;
+constexpr uint32_t SHARDS = 4;
+
+struct ClientProfile {
+    std::string name;
+    std::string hardware;
+};
+
+struct ClientInfo {
+    std::shared_ptr<const ClientProfile> profile;
+    time_t last_seen;
+    bool active;
+    uint32_t addr;
+    uint16_t port;
+};
+
+struct ClientView {
+    std::shared_ptr<const ClientProfile> profile;
+    time_t last_seen;
+    bool active;
+    uint32_t addr;
+    uint16_t port;
+};
+
+struct Shard {
+    std::mutex mutex;
+    std::vector<ClientInfo> clients;
+    FlatMap<uint32_t> ids;
+};
+
+uint64_t key_of(uint32_t i) { return (uint64_t{0x0A000000u + i} << 16) | (10000 + i % 50000); }
+
+// Строка команды 5 админки.
+void format_client(std::ostream &out, const std::shared_ptr<const ClientProfile> &profile, uint32_t addr,
+                   uint16_t port, time_t last_seen, bool active) {
+    out << "  Адрес: " << (addr >> 24) << '.' << (addr >> 16 & 255) << '.' << (addr >> 8 & 255) << '.'
+            << (addr & 255) << ':' << port << "\n  Имя: " << profile->name << "\n  Железо: " << profile->hardware
+            << "\n  Статус: " << (active ? "Активен" : "Неактивен") << "\n  Посл. активность: "
+            << std::put_time(std::localtime(&last_seen), "%Y-%m-%d %H:%M:%S") << "\n";
+}
+
+void list_locked(std::vector<std::unique_ptr<Shard> > &shards, std::ostream &out) {
+    for (auto &shard: shards) {
+        std::lock_guard<std::mutex> lock(shard->mutex);
+        for (const auto &c: shard->clients) format_client(out, c.profile, c.addr, c.port, c.last_seen, c.active);
+    }
+}
+
+void list_snapshot(std::vector<std::unique_ptr<Shard> > &shards, std::ostream &out) {
+    std::vector<std::vector<ClientView> > views(shards.size());
+    for (size_t s = 0; s < shards.size(); ++s) {
+        std::lock_guard<std::mutex> lock(shards[s]->mutex);
+        views[s].reserve(shards[s]->clients.size());
+        for (const auto &c: shards[s]->clients) views[s].push_back({c.profile, c.last_seen, c.active, c.addr, c.port});
+    }
+    for (const auto &view: views)
+        for (const auto &c: view) format_client(out, c.profile, c.addr, c.port, c.last_seen, c.active);
+}
+
+struct Latency {
+    double p50, p99, max;
+};
+
+template<typename List>
+Latency measure(std::vector<std::unique_ptr<Shard> > &shards, List list) {
+    std::atomic<bool> listing{true};
+    std::thread admin([&] {
+        for (int i = 0; i < 5; ++i) {
+            std::ostringstream out;
+            list(shards, out);
+        }
+        listing = false;
+    });
+
+    // PING: поиск клиента по адресу и обновление last_seen под мьютексом его шарда.
+    std::vector<double> samples;
+    uint32_t i = 0;
+    while (listing) {
+        uint32_t client = (i++ * 2654435761u) % CLIENTS;
+        uint64_t key = key_of(client);
+        Shard &shard = *shards[client % SHARDS];
+        auto start = std::chrono::steady_clock::now();
+        {
+            std::lock_guard<std::mutex> lock(shard.mutex);
+            if (const uint32_t *index = shard.ids.find(key)) shard.clients[*index].last_seen = time(nullptr);
+        }
+        samples.push_back(std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count());
+        std::this_thread::sleep_for(std::chrono::microseconds(20));
+    }
+    admin.join();
+    std::sort(samples.begin(), samples.end());
+    return {samples[samples.size() / 2], samples[samples.size() * 99 / 100], samples.back()};
+}
+
+int main() {
+    std::vector<std::unique_ptr<Shard> > shards;
+    for (uint32_t s = 0; s < SHARDS; ++s) shards.push_back(std::make_unique<Shard>());
+    for (uint32_t i = 0; i < CLIENTS; ++i) {
+        Shard &shard = *shards[i % SHARDS];
+        auto profile = std::make_shared<const ClientProfile>(ClientProfile{
+            "Client_" + std::to_string(i), "CPU: 8 cores, RAM: 16384 MB"
+        });
+        shard.ids[key_of(i)] = static_cast<uint32_t>(shard.clients.size());
+        shard.clients.push_back({profile, time(nullptr), true, 0x0A000000u + i, static_cast<uint16_t>(10000 + i % 50000)});
+    }
+
+    std::cout << "PING во время 5 списков " << CLIENTS << " клиентов, " << SHARDS << " шарда\n";
+    std::cout << std::left << std::setw(24) << "listing" << std::setw(14) << "p50 (us)" << std::setw(14)
+            << "p99 (us)" << "max (us)\n";
+    for (int variant = 0; variant < 2; ++variant) {
+        Latency l = variant == 0 ? measure(shards, list_locked) : measure(shards, list_snapshot);
+        std::cout << std::left << std::setw(24) << (variant == 0 ? "locked (before)" : "snapshot (after)")
+                << std::fixed << std::setprecision(2) << std::setw(14) << l.p50 << std::setw(14) << l.p99
+                << l.max << "\n";
+    }
+    return 0;
+}
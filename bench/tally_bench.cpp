@@ -0,0 +1,120 @@
+// Оценка раунда: прежний determine_winner (строковые адреса участников, unordered_map выборов,
+// choice_map с векторами строк и choices_log) против подсчета по байтовому массиву слотов.
+// Сборка: g++ -O2 -o tally_bench bench/tally_bench.cpp
+#include <iostream>
+#include <iomanip>
+#include <unordered_map>
+#include <vector>
+#include <string>
+#include <chrono>
+#include <random>
+
+#include "../server/round_tally.h"
+
+enum GameChoice { ROCK, PAPER, SCISSORS, INVALID };
+
+struct ClientInfo {
+    std::string name;
+    bool active;
+};
+
+std::string choice_to_string(GameChoice c) {
+    switch (c) {
+        case ROCK: return "Камень";
+        case PAPER: return "Бумага";
+        case SCISSORS: return "Ножницы";
+        default: return "Неизвестно";
+    }
+}
+
+// Копия логики determine_winner до перехода на слоты (без вывода и рассылок).
+size_t legacy_round(std::vector<std::string> &participants,
+                    std::unordered_map<std::string, ClientInfo> &clients,
+                    std::unordered_map<std::string, GameChoice> &current_choices) {
+    std::unordered_map<GameChoice, std::vector<std::string> > choice_map;
+    std::string choices_log = "Выборы раунда (от активных): ";
+    std::vector<std::string> actual_participants_this_round;
+    for (const auto &addr: participants) {
+        if (!clients.count(addr) || !clients[addr].active) continue;
+        if (current_choices.count(addr)) {
+            GameChoice choice = current_choices[addr];
+            if (choice != INVALID) {
+                choice_map[choice].push_back(addr);
+                choices_log += clients[addr].name + "->" + choice_to_string(choice) + "; ";
+                actual_participants_this_round.push_back(addr);
+            }
+        }
+    }
+    if (actual_participants_this_round.empty()) {
+        participants.clear();
+        return 0;
+    }
+    bool rock = choice_map.count(ROCK), paper = choice_map.count(PAPER), scissors = choice_map.count(SCISSORS);
+    int types = rock + paper + scissors;
+    if (types == 2) {
+        if (rock && scissors) participants = choice_map[ROCK];
+        else if (paper && rock) participants = choice_map[PAPER];
+        else participants = choice_map[SCISSORS];
+    } else {
+        participants = actual_participants_this_round;
+    }
+    return participants.size() + choices_log.size() % 2;
+}
+
+size_t slot_round(std::vector<uint8_t> &slots) {
+    ChoiceCounts counts = tally_choices(slots.data(), slots.size());
+    bool rock = counts.rock > 0, paper = counts.paper > 0, scissors = counts.scissors > 0;
+    unsigned keep;
+    if (!rock && !paper && !scissors) keep = 0;
+    else if (rock && scissors && !paper) keep = slot_bit(SLOT_ROCK);
+    else if (paper && rock && !scissors) keep = slot_bit(SLOT_PAPER);
+    else if (scissors && paper && !rock) keep = slot_bit(SLOT_SCISSORS);
+    else keep = slot_bit(SLOT_ROCK) | slot_bit(SLOT_PAPER) | slot_bit(SLOT_SCISSORS);
+    return filter_slots(slots.data(), slots.size(), keep);
+}
+
+int main() {
+    std::mt19937 gen(7);
+    std::cout << std::left << std::setw(14) << "participants" << std::setw(20) << "legacy (ms/round)"
+            << std::setw(20) << "slots (ms/round)" << "speedup\n";
+
+    for (size_t n: {size_t{1'000}, size_t{100'000}, size_t{1'000'000}}) {
+        std::vector<GameChoice> picks(n);
+        // Два типа выборов - раунд решающий, отбор победителей тоже попадает в замер.
+        for (auto &c: picks) c = gen() % 2 ? ROCK : SCISSORS;
+
+        std::unordered_map<std::string, ClientInfo> clients;
+        std::unordered_map<std::string, GameChoice> current_choices;
+        std::vector<std::string> base_participants;
+        for (size_t i = 0; i < n; ++i) {
+            std::string addr = "10." + std::to_string(i >> 16 & 255) + "." + std::to_string(i >> 8 & 255) + "." +
+                               std::to_string(i & 255) + ":" + std::to_string(10000 + i % 50000);
+            clients[addr] = ClientInfo{"Client_" + std::to_string(i), true};
+            current_choices[addr] = picks[i];
+            base_participants.push_back(addr);
+        }
+        std::vector<uint8_t> base_slots(n);
+        for (size_t i = 0; i < n; ++i) base_slots[i] = static_cast<uint8_t>(picks[i]);
+
+        const int rounds = n >= 1'000'000 ? 3 : 20;
+        double legacy_ms = 0, slots_ms = 0;
+        volatile size_t sink = 0;
+        for (int r = 0; r < rounds; ++r) {
+            std::vector<std::string> participants = base_participants;
+            auto start = std::chrono::steady_clock::now();
+            sink = sink + legacy_round(participants, clients, current_choices);
+            legacy_ms += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+            std::vector<uint8_t> slots = base_slots;
+            start = std::chrono::steady_clock::now();
+            sink = sink + slot_round(slots);
+            slots_ms += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        }
+        legacy_ms /= rounds;
+        slots_ms /= rounds;
+        std::cout << std::left << std::setw(14) << n << std::fixed << std::setprecision(3)
+                << std::setw(20) << legacy_ms << std::setw(20) << slots_ms
+                << std::setprecision(0) << legacy_ms / slots_ms << "x\n";
+    }
+    return 0;
+}
@@ -10,11 +10,47 @@
 #include <cstring>
 #include <ctime>
 #include <netdb.h>
+#include <poll.h>
+#include <atomic>
+#include <mutex>
+#include <chrono>
+
+#include "../server/protocol.h"
+#include "../server/relay_tree.h"
 
 bool running = true;
 int client_socket;
+int multicast_socket = -1;
+// Адрес меняет только поток прослушивания (перенаправление узлом кластера), читают оба потока.
 sockaddr_in server_addr{};
+std::mutex server_addr_mutex;
+// Узел кластера может перенаправить REGISTER к узлу-владельцу клиента; больше нескольких
+// перенаправлений подряд - ошибка конфигурации кластера, и клиент остается на текущем узле.
+constexpr int MAX_REDIRECTS = 3;
+int redirects = 0;
 std::string client_name;
+// Бинарный протокол v2; если сервер не ответил на кадр REGISTER, клиент переходит на текстовый.
+std::atomic<bool> use_wire = true;
+// Клиент готов пересылать рассылки сервера другим клиентам (аргумент relay). Состояние
+// ретранслятора меняет только поток прослушивания.
+bool relay_capable = false;
+RelayNode relay;
+RelayKey relay_key; // из REGISTERED; пустой - кадры OP_RELAY не принимаются
+std::atomic<bool> registered = false;
+std::atomic<uint32_t> wire_seq = 0;
+// Последний PONG сервера (метка в сетевом порядке байт, 0 - нет) и момент его получения;
+// метка возвращается серверу в следующем PING для замера RTT.
+std::atomic<uint32_t> pong_stamp = 0;
+std::atomic<int64_t> pong_received_us = 0;
+// Интервал PING назначает сервер (в REGISTERED и PONG). PING уходит, только если за интервал
+// серверу не отправлено ничего другого: любая датаграмма клиента - признак жизни.
+std::atomic<uint32_t> heartbeat_ms = 3000;
+std::atomic<int64_t> last_sent_us = 0;
+
+int64_t steady_us() {
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
 
 void signal_handler(int sig) {
     std::cout << "[" << client_name << "] Получен сигнал " << sig << ", завершение..." << std::endl;
@@ -22,6 +58,33 @@ void signal_handler(int sig) {
     shutdown(client_socket, SHUT_RDWR);
 }
 
+ssize_t send_to_server(const void *data, size_t size) {
+    sockaddr_in to;
+    {
+        std::lock_guard<std::mutex> lock(server_addr_mutex);
+        to = server_addr;
+    }
+    ssize_t sent = sendto(client_socket, data, size, 0, (sockaddr *) &to, sizeof(to));
+    if (sent >= 0) last_sent_us = steady_us();
+    return sent;
+}
+
+// PING; в v2 возвращает серверу метку последнего PONG для замера RTT.
+ssize_t send_ping() {
+    std::string ping = "PING";
+    if (use_wire) {
+        wire::PingBody body{pong_stamp.exchange(0), 0};
+        if (body.echo_us) body.held_us = htonl(static_cast<uint32_t>(steady_us() - pong_received_us));
+        ping = wire::frame(wire::OP_PING, 0, wire_seq++, body);
+    }
+    return send_to_server(ping.data(), ping.size());
+}
+
+void set_heartbeat(uint32_t interval_ms) {
+    if (interval_ms == 0 || heartbeat_ms.exchange(interval_ms) == interval_ms) return;
+    std::cout << "[" << client_name << "] Сервер назначил интервал PING " << interval_ms << " мс." << std::endl;
+}
+
 std::string get_hardware() {
     struct sysinfo info{};
     if (sysinfo(&info) != 0) {
@@ -77,10 +140,22 @@ bool resolve_server_address(const char *hostname, int port, sockaddr_in &server_
 
 void register_client() {
     std::string hardware_info = get_hardware();
-    std::string msg = "REGISTER:" + client_name + ":" + hardware_info;
-    std::cout << "[" << client_name << "] Попытка регистрации с данными: " << hardware_info << std::endl;
-    ssize_t bytes_sent = sendto(client_socket, msg.c_str(), msg.size(), 0,
-                                (sockaddr *) &server_addr, sizeof(server_addr));
+    std::string msg;
+    if (use_wire) {
+        struct sysinfo info{};
+        sysinfo(&info);
+        wire::RegisterBody body{};
+        wire::set_name(body.name, client_name);
+        body.cpus = htons(static_cast<uint16_t>(std::max(0L, sysconf(_SC_NPROCESSORS_ONLN))));
+        body.ram_mb = htonl(static_cast<uint32_t>(info.totalram / (1024 * 1024)));
+        if (relay_capable) body.flags = htons(wire::REGISTER_RELAY);
+        msg = wire::frame(wire::OP_REGISTER, 0, wire_seq++, body);
+    } else {
+        msg = "REGISTER:" + client_name + ":" + hardware_info;
+    }
+    std::cout << "[" << client_name << "] Попытка регистрации (протокол " << (use_wire ? "v2" : "v1") <<
+            ") с данными: " << hardware_info << std::endl;
+    ssize_t bytes_sent = send_to_server(msg.data(), msg.size());
     if (bytes_sent < 0) {
         perror(("[" + client_name + "] Ошибка отправки REGISTER").c_str());
     } else {
@@ -88,57 +163,292 @@ void register_client() {
     }
 }
 
+// Переход на узел кластера, указанный в REDIRECT, и повторная регистрация у него.
+void redirect_to(const sockaddr_in &node) {
+    char ip[INET_ADDRSTRLEN];
+    inet_ntop(AF_INET, &node.sin_addr, ip, sizeof(ip));
+    if (registered || ++redirects > MAX_REDIRECTS || node.sin_port == 0) {
+        std::cout << "[" << client_name << "] Перенаправление на " << ip << ":" << ntohs(node.sin_port) <<
+                " отклонено." << std::endl;
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(server_addr_mutex);
+        server_addr = node;
+    }
+    std::cout << "[" << client_name << "] Сервер перенаправил на узел кластера " << ip << ":" << ntohs(node.sin_port)
+            << "." << std::endl;
+    register_client();
+}
+
+// Вступление в multicast-группу, объявленную сервером в ответе на REGISTER.
+// Интерфейс выбирается тот, через который идет маршрут до сервера.
+bool join_multicast(const std::string &group_str) {
+    size_t colon = group_str.find(':');
+    if (colon == std::string::npos) return false;
+    std::string group_ip = group_str.substr(0, colon);
+    int group_port = atoi(group_str.c_str() + colon + 1);
+
+    ip_mreq mreq{};
+    if (inet_pton(AF_INET, group_ip.c_str(), &mreq.imr_multiaddr) <= 0 || group_port <= 0) return false;
+
+    int probe = socket(AF_INET, SOCK_DGRAM, 0);
+    sockaddr_in local_addr{};
+    socklen_t local_len = sizeof(local_addr);
+    if (probe >= 0 && connect(probe, (sockaddr *) &server_addr, sizeof(server_addr)) == 0 &&
+        getsockname(probe, (sockaddr *) &local_addr, &local_len) == 0) {
+        mreq.imr_interface = local_addr.sin_addr;
+    } else {
+        mreq.imr_interface.s_addr = htonl(INADDR_ANY);
+    }
+    if (probe >= 0) close(probe);
+
+    int sock = socket(AF_INET, SOCK_DGRAM, 0);
+    if (sock < 0) return false;
+    int reuse = 1;
+    setsockopt(sock, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+
+    sockaddr_in bind_addr{};
+    bind_addr.sin_family = AF_INET;
+    bind_addr.sin_port = htons(group_port);
+    bind_addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    if (bind(sock, (sockaddr *) &bind_addr, sizeof(bind_addr)) < 0 ||
+        setsockopt(sock, IPPROTO_IP, IP_ADD_MEMBERSHIP, &mreq, sizeof(mreq)) < 0) {
+        perror(("[" + client_name + "] Не удалось вступить в multicast-группу").c_str());
+        close(sock);
+        return false;
+    }
+    multicast_socket = sock;
+    return true;
+}
+
+void handle_command(const std::string &cmd, std::mt19937 &gen, std::uniform_int_distribution<> &distrib) {
+    static const std::vector<std::string> options = {"ROCK", "PAPER", "SCISSORS"};
+
+    if (cmd == "CHOOSE") {
+
+        // задержка ответа
+        // int delay_s = delay_distrib(gen);
+        // std::cout << "[" << client_name << "] Получена команда CHOOSE, задержка " << delay_s << " секунд." << std::endl;
+        // std::this_thread::sleep_for(std::chrono::seconds(delay_s));
+
+        std::string choice = options[distrib(gen)];
+        std::cout << "[" << client_name << "] Получена команда CHOOSE, отправляем: " << choice << std::endl;
+        ssize_t bytes_sent = send_to_server(choice.data(), choice.size());
+        if (bytes_sent < 0) {
+            perror(("[" + client_name + "] Ошибка отправки выбора").c_str());
+        }
+    } else if (cmd == "SHUTDOWN") {
+        std::cout << "[" << client_name << "] Получена команда на отключение SHUTDOWN" << std::endl;
+        running = false;
+    } else if (cmd.rfind("REDIRECT:", 0) == 0) {
+        std::string node = cmd.substr(9);
+        size_t colon = node.find(':');
+        sockaddr_in addr{};
+        addr.sin_family = AF_INET;
+        if (colon != std::string::npos && inet_pton(AF_INET, node.substr(0, colon).c_str(), &addr.sin_addr) == 1) {
+            addr.sin_port = htons(static_cast<uint16_t>(atoi(node.c_str() + colon + 1)));
+        }
+        redirect_to(addr);
+    } else if (cmd.rfind("REGISTERED", 0) == 0) {
+        std::cout << "[" << client_name << "] Регистрация подтверждена сервером." << std::endl;
+        registered = true;
+        const std::string mcast_prefix = "REGISTERED:MCAST:";
+        if (cmd.rfind(mcast_prefix, 0) == 0 && multicast_socket < 0) {
+            std::string group = cmd.substr(mcast_prefix.size());
+            if (join_multicast(group)) {
+                std::cout << "[" << client_name << "] Вступили в multicast-группу " << group << "." << std::endl;
+                send_to_server("MCAST:OK", 8);
+            } else {
+                std::cout << "[" << client_name << "] Multicast недоступен, рассылки будут приходить по unicast." <<
+                        std::endl;
+            }
+        }
+    } else {
+        std::cout << "[" << client_name << "] Сообщение от сервера: " << cmd << std::endl;
+    }
+}
+
+std::string describe_result(const wire::ResultBody &result) {
+    uint32_t match = ntohl(result.match), value = ntohl(result.value);
+    std::string prefix = match ? "МАТЧ #" + std::to_string(match) + ": " : "";
+    switch (result.kind) {
+        case wire::RESULT_GAME_START: return "ИГРА НАЧИНАЕТСЯ! Участников: " + std::to_string(value);
+        case wire::RESULT_ROCK_WINS: return prefix + "Камень бьет ножницы!";
+        case wire::RESULT_PAPER_WINS: return prefix + "Бумага покрывает камень!";
+        case wire::RESULT_SCISSORS_WINS: return prefix + "Ножницы режут бумагу!";
+        case wire::RESULT_DRAW: return prefix + "НИЧЬЯ! Новый раунд...";
+        case wire::RESULT_NO_CHOICES: return prefix + "НИКТО НЕ СДЕЛАЛ ВЫБОР! Ничья. Новый раунд...";
+        case wire::RESULT_WINNER: return prefix + "ИГРА ОКОНЧЕНА! ПОБЕДИТЕЛЬ: " + std::string(wire::get_name(result.name)) + "!!!";
+        case wire::RESULT_NO_WINNER: return prefix + "ИГРА ОКОНЧЕНА! Победителя нет.";
+        case wire::RESULT_ALL_OUT: return prefix + "Все участники выбыли или стали неактивны!";
+        case wire::RESULT_ABORTED: return "ИГРА ПРЕРВАНА ИЗ-ЗА ОСТАНОВКИ СЕРВЕРА!";
+        default: return "Неизвестный результат " + std::to_string(result.kind);
+    }
+}
+
+// Кадр протокола v2 от сервера.
+void handle_frame(std::string_view data, std::mt19937 &gen, std::uniform_int_distribution<> &distrib) {
+    static const char *const names[] = {"ROCK", "PAPER", "SCISSORS"};
+    wire::Header header = wire::header(data);
+
+    // Сервер повторяет CHOOSE, пока не получит ответ; на повтор уходит тот же выбор.
+    static uint32_t last_round = 0;
+    static uint8_t last_choice = 0;
+
+    if (header.opcode == wire::OP_CHOOSE) {
+        bool repeat = header.round != 0 && header.round == last_round;
+        if (!repeat) last_choice = static_cast<uint8_t>(distrib(gen));
+        last_round = header.round;
+        wire::ChoiceBody body{last_choice};
+        std::cout << "[" << client_name << "] Получена " << (repeat ? "повторная " : "") << "команда CHOOSE (раунд " <<
+                header.round << "), отправляем: " << names[body.choice] << std::endl;
+        std::string frame = wire::frame(wire::OP_CHOICE, header.round, wire_seq++, body);
+        if (send_to_server(frame.data(), frame.size()) < 0) {
+            perror(("[" + client_name + "] Ошибка отправки выбора").c_str());
+        }
+    } else if (header.opcode == wire::OP_SHUTDOWN) {
+        std::cout << "[" << client_name << "] Получена команда на отключение SHUTDOWN" << std::endl;
+        running = false;
+    } else if (header.opcode == wire::OP_REGISTERED) {
+        wire::RegisteredBody body{};
+        wire::body(data, body);
+        std::cout << "[" << client_name << "] Регистрация подтверждена сервером (протокол v2)." << std::endl;
+        registered = true;
+        set_heartbeat(ntohl(body.heartbeat_ms));
+        RelayKey key = RelayKey::from_bytes(body.relay_key);
+        if (key != relay_key) relay.reset_deliveries(); // новый запуск сервера нумерует рассылки заново
+        relay_key = key;
+        if ((body.flags & wire::REGISTERED_MULTICAST) && multicast_socket < 0) {
+            sockaddr_in group{};
+            group.sin_family = AF_INET;
+            group.sin_port = body.multicast_port;
+            group.sin_addr.s_addr = body.multicast_group;
+            char ip[INET_ADDRSTRLEN];
+            inet_ntop(AF_INET, &group.sin_addr, ip, sizeof(ip));
+            std::string group_str = std::string(ip) + ":" + std::to_string(ntohs(group.sin_port));
+            if (join_multicast(group_str)) {
+                std::cout << "[" << client_name << "] Вступили в multicast-группу " << group_str << "." << std::endl;
+                std::string frame = wire::frame(wire::OP_MCAST_OK, 0, wire_seq++);
+                send_to_server(frame.data(), frame.size());
+            } else {
+                std::cout << "[" << client_name << "] Multicast недоступен, рассылки будут приходить по unicast." <<
+                        std::endl;
+            }
+        }
+    } else if (header.opcode == wire::OP_REDIRECT) {
+        wire::RedirectBody body{};
+        if (wire::body(data, body)) {
+            sockaddr_in addr{};
+            addr.sin_family = AF_INET;
+            addr.sin_addr.s_addr = body.addr;
+            addr.sin_port = body.port;
+            redirect_to(addr);
+        }
+    } else if (header.opcode == wire::OP_PONG) {
+        wire::PongBody body{};
+        if (wire::body(data, body)) {
+            pong_received_us = steady_us();
+            pong_stamp = body.stamp_us;
+            set_heartbeat(ntohl(body.heartbeat_ms));
+            if ((body.flags & wire::PONG_REPLY_NOW) && send_ping() < 0) {
+                perror(("[" + client_name + "] Ошибка отправки PING").c_str());
+            }
+        }
+    } else if (header.opcode == wire::OP_RESULT) {
+        wire::ResultBody body{};
+        if (wire::body(data, body)) {
+            std::cout << "[" << client_name << "] Сообщение от сервера: " << describe_result(body) << std::endl;
+        }
+    } else {
+        std::cout << "[" << client_name << "] Неизвестный кадр от сервера (код " << int(header.opcode) << ")" << std::endl;
+    }
+}
+
+void send_to_peer(const wire::RelayMember &to, const std::string &frame) {
+    sockaddr_in addr = relay_addr(to);
+    if (sendto(client_socket, frame.data(), frame.size(), 0, (sockaddr *) &addr, sizeof(addr)) < 0) {
+        perror(("[" + client_name + "] Ошибка отправки кадра ретрансляции").c_str());
+    }
+}
+
+// Рассылка через дерево ретрансляторов: первый адрес поддерева - этот клиент, остальные - его
+// потомки. Отправитель получает подтверждение, дети - свои поддеревья. Кадр без верной метки
+// сервера или повтор старой рассылки отбрасывается молча: его мог прислать кто угодно.
+void handle_relay(std::string_view data, const sockaddr_in &from, std::mt19937 &gen,
+                  std::uniform_int_distribution<> &distrib) {
+    RelayView view;
+    wire::Header header = wire::header(data);
+    if (!parse_relay(data, view) || !relay_verify(relay_key, header.round, view)) return;
+    RelayDelivery delivery = relay.delivery(header.round);
+    if (delivery == RelayDelivery::STALE) return;
+    std::string ack = wire::frame(wire::OP_RELAY_ACK, header.round, wire_seq++);
+    sendto(client_socket, ack.data(), ack.size(), 0, (const sockaddr *) &from, sizeof(from));
+    if (delivery == RelayDelivery::REPEAT) return;
+    if (view.members.size() > 1) {
+        auto payload = std::make_shared<const std::string>(view.payload);
+        relay.forward(header.round, payload, view.fanout, view.members.data() + 1, view.members.size() - 1,
+                      std::min<size_t>(view.fanout, view.members.size() - 1), steady_us(), send_to_peer);
+    }
+    handle_frame(view.payload, gen, distrib);
+}
+
 void handle_server_commands() {
     // задержка ответа
     // std::uniform_int_distribution<> delay_distrib(10, 20);
 
-    char buffer[1024];
+    char buffer[2048];
     std::random_device rd;
     std::mt19937 gen(rd());
     std::uniform_int_distribution<> distrib(0, 2);
-    const std::vector<std::string> options = {"ROCK", "PAPER", "SCISSORS"};
 
     std::cout << "[" << client_name << "] Поток прослушивания сервера запущен." << std::endl;
 
     while (running) {
-        sockaddr_in server_addr_tmp{};
-        socklen_t addr_len = sizeof(server_addr_tmp);
-        memset(buffer, 0, sizeof(buffer));
-
-        ssize_t len = recvfrom(client_socket, buffer, sizeof(buffer) - 1, 0,
-                               (sockaddr *) &server_addr_tmp, &addr_len);
-
+        pollfd fds[2] = {{client_socket, POLLIN, 0}, {multicast_socket, POLLIN, 0}};
+        // Ожидание ограничено сроком подтверждения от детей этого ретранслятора.
+        int64_t timeout_ms = 500;
+        uint64_t deadline_us = relay.next_deadline_us();
+        if (deadline_us != UINT64_MAX) {
+            timeout_ms = std::clamp<int64_t>((static_cast<int64_t>(deadline_us) - steady_us() + 999) / 1000, 0, 500);
+        }
+        int ready = poll(fds, multicast_socket >= 0 ? 2 : 1, static_cast<int>(timeout_ms));
         if (!running) break;
+        if (ready < 0) {
+            if (errno != EINTR) perror(("[" + client_name + "] Ошибка poll").c_str());
+            continue;
+        }
+        if (size_t expired = relay.expire(steady_us(), send_to_peer)) {
+            std::cout << "[" << client_name << "] Ретрансляторов без подтверждения: " << expired <<
+                    ", рассылка отправлена их детям." << std::endl;
+        }
 
-        if (len > 0) {
-            std::string cmd(buffer, len);
-            char sender_ip[INET_ADDRSTRLEN];
-            inet_ntop(AF_INET, &server_addr_tmp.sin_addr, sender_ip, sizeof(sender_ip));
-
-            if (cmd == "CHOOSE") {
-
-                // задержка ответа
-                // int delay_s = delay_distrib(gen);
-                // std::cout << "[" << client_name << "] Получена команда CHOOSE, задержка " << delay_s << " секунд." << std::endl;
-                // std::this_thread::sleep_for(std::chrono::seconds(delay_s));
-
-                std::string choice = options[distrib(gen)];
-                std::cout << "[" << client_name << "] Получена команда CHOOSE, отправляем: " << choice << std::endl;
-                ssize_t bytes_sent = sendto(client_socket, choice.c_str(), choice.size(), 0,
-                                            (sockaddr *) &server_addr, sizeof(server_addr));
-                if (bytes_sent < 0) {
-                    perror(("[" + client_name + "] Ошибка отправки выбора").c_str());
+        for (int i = 0; i < 2 && running; ++i) {
+            if (!(fds[i].revents & (POLLIN | POLLERR | POLLHUP))) continue;
+
+            sockaddr_in server_addr_tmp{};
+            socklen_t addr_len = sizeof(server_addr_tmp);
+            ssize_t len = recvfrom(fds[i].fd, buffer, sizeof(buffer) - 1, MSG_DONTWAIT,
+                                   (sockaddr *) &server_addr_tmp, &addr_len);
+
+            if (!running) break;
+
+            if (len > 0) {
+                // Multicast-группа всегда вещает текстом, unicast - в протоколе клиента.
+                std::string_view data(buffer, len);
+                if (wire::is_frame(data) && wire::header(data).opcode == wire::OP_RELAY) {
+                    handle_relay(data, server_addr_tmp, gen, distrib);
+                } else if (wire::is_frame(data) && wire::header(data).opcode == wire::OP_RELAY_ACK) {
+                    relay.ack(wire::header(data).round, relay_member(server_addr_tmp));
+                } else if (wire::is_frame(data)) {
+                    handle_frame(data, gen, distrib);
+                } else {
+                    handle_command(std::string(data), gen, distrib);
+                }
+            } else if (len < 0 && errno != EAGAIN && errno != EWOULDBLOCK) {
+                if (running) {
+                    perror(("[" + client_name + "] Ошибка приема recvfrom").c_str());
                 }
-            } else if (cmd == "SHUTDOWN") {
-                std::cout << "[" << client_name << "] Получена команда на отключение SHUTDOWN" << std::endl;
-                running = false;
-                break;
-            } else {
-                std::cout << "[" << client_name << "] Сообщение от сервера: " << cmd << std::endl;
-            }
-        } else if (len < 0) {
-            if (running) {
-                perror(("[" + client_name + "] Ошибка приема recvfrom").c_str());
             }
         }
     }
@@ -165,8 +475,14 @@ int main(int argc, char *argv[]) {
     }
     std::cout << "[" << client_name << "] Сокет создан." << std::endl;
 
-    std::cout << "[" << client_name << "] Попытка разрешить имя хоста сервера 'server'..." << std::endl;
-    if (!resolve_server_address("server", 8080, server_addr)) {
+    const char *server_host = argc >= 3 ? argv[2] : "server";
+    int server_port = argc >= 4 ? atoi(argv[3]) : 8080;
+    for (int i = 4; i < argc; ++i) {
+        if (std::string(argv[i]) == "text") use_wire = false;
+        else if (std::string(argv[i]) == "relay") relay_capable = true;
+    }
+    std::cout << "[" << client_name << "] Попытка разрешить имя хоста сервера '" << server_host << "'..." << std::endl;
+    if (!resolve_server_address(server_host, server_port, server_addr)) {
         std::cerr << "[" << client_name << "] Не удалось разрешить адрес сервера. Завершение." << std::endl;
         close(client_socket);
         return 1;
@@ -193,19 +509,32 @@ int main(int argc, char *argv[]) {
     // std::uniform_int_distribution<> ping_delay(5, 15);
 
     while (running) {
-        sleep(3);
+        // Следующий PING - через интервал после последней датаграммы серверу; пока клиент шлет
+        // выборы и подтверждения, PING не нужен.
+        int64_t wait_us = last_sent_us + int64_t{heartbeat_ms} * 1000 - steady_us();
+        if (wait_us > 0) {
+            std::this_thread::sleep_for(std::chrono::microseconds(std::min<int64_t>(wait_us, 200000)));
+            continue;
+        }
 
         // int delay = ping_delay(gen);
         // std::cout << "[" << client_name << "] Ожидание " << delay << " секунд перед отправкой PING..." << std::endl;
         // std::this_thread::sleep_for(std::chrono::seconds(delay));
         if (!running) break;
 
-        ssize_t bytes_sent = sendto(client_socket, "PING", 4, 0,
-                                    (sockaddr *) &server_addr, sizeof(server_addr));
+        if (!registered && use_wire) {
+            std::cout << "[" << client_name << "] Сервер не ответил на REGISTER v2, переходим на текстовый протокол." <<
+                    std::endl;
+            use_wire = false;
+            register_client();
+        }
+
+        ssize_t bytes_sent = send_ping();
         if (bytes_sent < 0) {
             if (running && errno != EBADF && errno != EPIPE) {
                 perror(("[" + client_name + "] Ошибка отправки PING").c_str());
             }
+            sleep(1);
         } else {
             time_t now = time(nullptr);
             if (now - last_ping_log_time >= 10) {
@@ -223,6 +552,7 @@ int main(int argc, char *argv[]) {
     }
 
     close(client_socket);
+    if (multicast_socket >= 0) close(multicast_socket);
     std::cout << "[" << client_name << "] Клиент завершил работу." << std::endl;
     return 0;
 }
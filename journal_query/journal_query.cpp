@@ -0,0 +1,248 @@
+// Анализ журнала результатов сервера (--journal DIR): доли побед клиентов и квантили
+// длительности раундов по всем сегментам. Сегменты читаются параллельно, каждый - потоком
+// крупными блоками pread, без отображения в память, за один последовательный проход. Буфер
+// чтения у потока постоянный, но для точных квантилей каждая запись раунда и выбора оставляет
+// в памяти свою длительность (4 байта), так что память растет с журналом: ~4 байта на запись
+// плюс счетчики клиентов.
+// Берутся только зафиксированные записи (committed в заголовке), поэтому журнал можно
+// разбирать на ходу, пока сервер пишет следующий сегмент.
+// Сборка: g++ -O2 -o journal_query journal_query/journal_query.cpp -lpthread
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <string>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <algorithm>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "../server/flat_map.h"
+#include "../server/protocol.h"
+#include "../server/results_journal.h"
+
+constexpr size_t READ_CHUNK = 4 << 20;
+
+struct QueryConfig {
+    std::string dir;
+    unsigned threads = std::max(1u, std::thread::hardware_concurrency());
+    size_t top = 20;
+    uint64_t min_rounds = 1;
+};
+
+struct ClientStats {
+    uint64_t rounds = 0;
+    uint64_t won = 0;
+    uint64_t draw = 0;
+    uint64_t lost = 0;
+    uint64_t no_choice = 0; // раунды без выбора (входят в lost)
+    uint64_t matches_won = 0;
+};
+
+// Итоги одного потока; после прохода сливаются в один.
+struct Partial {
+    FlatMap<ClientStats> clients{1024};
+    std::vector<uint32_t> round_us;
+    std::vector<uint32_t> choice_us;
+    uint64_t segments = 0, records = 0, bytes = 0, matches = 0, skipped = 0;
+
+    void add(const JournalRecord &record) {
+        switch (record.type) {
+            case JOURNAL_ROUND:
+                round_us.push_back(record.value);
+                break;
+            case JOURNAL_CHOICE: {
+                ClientStats &stats = *clients.try_emplace(record.client).first;
+                stats.rounds++;
+                if (record.outcome == JOURNAL_WON) stats.won++;
+                else if (record.outcome == JOURNAL_DRAW) stats.draw++;
+                else stats.lost++;
+                if (record.kind > 2) stats.no_choice++;
+                if (record.value) choice_us.push_back(record.value);
+                break;
+            }
+            case JOURNAL_MATCH:
+                matches++;
+                // В кластере победитель турнира есть в журнале только его узла; остальные
+                // узлы пишут RESULT_WINNER с client = 0.
+                if (record.kind == wire::RESULT_WINNER && record.client) {
+                    clients.try_emplace(record.client).first->matches_won++;
+                }
+                break;
+            default:
+                skipped++;
+        }
+    }
+
+    void merge(Partial &other) {
+        for (const auto &slot: other.clients) {
+            ClientStats &stats = *clients.try_emplace(slot.key).first;
+            stats.rounds += slot.value.rounds;
+            stats.won += slot.value.won;
+            stats.draw += slot.value.draw;
+            stats.lost += slot.value.lost;
+            stats.no_choice += slot.value.no_choice;
+            stats.matches_won += slot.value.matches_won;
+        }
+        round_us.insert(round_us.end(), other.round_us.begin(), other.round_us.end());
+        choice_us.insert(choice_us.end(), other.choice_us.begin(), other.choice_us.end());
+        segments += other.segments;
+        records += other.records;
+        bytes += other.bytes;
+        matches += other.matches;
+        skipped += other.skipped;
+        other = Partial{};
+    }
+};
+
+// Потоковое чтение одного сегмента: заголовок, затем committed записей блоками READ_CHUNK.
+bool scan_segment(const std::string &path, std::vector<char> &buffer, Partial &out) {
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return false;
+    JournalSegmentHeader header{};
+    if (pread(fd, &header, sizeof(header), 0) != static_cast<ssize_t>(sizeof(header)) ||
+        !ResultsJournal::valid(header)) {
+        close(fd);
+        return false;
+    }
+    posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+    uint64_t remaining = header.committed * sizeof(JournalRecord);
+    off_t offset = ResultsJournal::HEADER_SIZE;
+    bool ok = true;
+    while (remaining > 0) {
+        size_t want = static_cast<size_t>(std::min<uint64_t>(remaining, buffer.size()));
+        ssize_t got = pread(fd, buffer.data(), want, offset);
+        if (got <= 0) {
+            ok = false;
+            break;
+        }
+        size_t whole = static_cast<size_t>(got) / sizeof(JournalRecord) * sizeof(JournalRecord);
+        if (whole == 0) {
+            ok = false;
+            break;
+        }
+        for (size_t at = 0; at < whole; at += sizeof(JournalRecord)) {
+            JournalRecord record;
+            memcpy(&record, buffer.data() + at, sizeof(record));
+            out.add(record);
+        }
+        out.records += whole / sizeof(JournalRecord);
+        out.bytes += whole;
+        offset += static_cast<off_t>(whole);
+        remaining -= whole;
+    }
+    // Прочитанный сегмент больше не нужен в кеше страниц.
+    posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+    close(fd);
+    out.segments++;
+    return ok;
+}
+
+// Точный квантиль через nth_element; массив при этом переупорядочивается.
+uint32_t quantile(std::vector<uint32_t> &values, double q) {
+    if (values.empty()) return 0;
+    size_t index = std::min(values.size() - 1, static_cast<size_t>(q * values.size()));
+    std::nth_element(values.begin(), values.begin() + index, values.end());
+    return values[index];
+}
+
+void print_quantiles(const char *title, std::vector<uint32_t> &values) {
+    std::cout << title << " (" << values.size() << "), мс:";
+    if (values.empty()) {
+        std::cout << " нет данных\n";
+        return;
+    }
+    for (const char *q: {"50", "90", "99", "99.9"}) {
+        std::cout << " p" << q << " " << std::fixed << std::setprecision(1) << quantile(values, atof(q) / 100) / 1000.0;
+    }
+    std::cout << " max " << *std::max_element(values.begin(), values.end()) / 1000.0 << "\n";
+}
+
+bool parse_args(int argc, char *argv[], QueryConfig &config) {
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        bool has_value = i + 1 < argc;
+        if (arg == "--threads" && has_value) config.threads = std::max(1, atoi(argv[++i]));
+        else if (arg == "--top" && has_value) config.top = strtoull(argv[++i], nullptr, 10);
+        else if (arg == "--min-rounds" && has_value) config.min_rounds = strtoull(argv[++i], nullptr, 10);
+        else if (arg[0] != '-' && config.dir.empty()) config.dir = arg;
+        else {
+            config.dir.clear();
+            break;
+        }
+    }
+    if (config.dir.empty()) {
+        std::cerr << "Использование: " << argv[0] << " DIR [--threads N] [--top N] [--min-rounds N]" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+int main(int argc, char *argv[]) {
+    QueryConfig config;
+    if (!parse_args(argc, argv, config)) return 1;
+    std::vector<uint64_t> segments = ResultsJournal::segments(config.dir);
+    if (segments.empty()) {
+        std::cerr << "[Journal] В " << config.dir << " нет сегментов журнала" << std::endl;
+        return 1;
+    }
+
+    auto started = std::chrono::steady_clock::now();
+    unsigned threads = std::min<unsigned>(config.threads, segments.size());
+    std::vector<Partial> partials(threads);
+    std::atomic<size_t> next{0};
+    std::atomic<size_t> damaged{0};
+    std::vector<std::thread> workers;
+    for (unsigned t = 0; t < threads; ++t) {
+        workers.emplace_back([&, t] {
+            std::vector<char> buffer(READ_CHUNK);
+            for (size_t i; (i = next.fetch_add(1)) < segments.size();) {
+                std::string path = ResultsJournal::segment_path(config.dir, segments[i]);
+                if (!scan_segment(path, buffer, partials[t])) {
+                    damaged++;
+                    std::cerr << "[Journal] Сегмент " << path << " пропущен или прочитан не полностью" << std::endl;
+                }
+            }
+        });
+    }
+    for (auto &worker: workers) worker.join();
+    for (unsigned t = 1; t < threads; ++t) partials[0].merge(partials[t]);
+    Partial &total = partials[0];
+    double scan_s = std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+
+    std::cout << "Сегментов " << total.segments << " (поврежденных " << damaged << "), записей " << total.records
+            << ", " << std::fixed << std::setprecision(1) << total.bytes / 1048576.0 << " МБ за " << std::setprecision(3)
+            << scan_s << " с (" << std::setprecision(0) << total.bytes / 1048576.0 / std::max(scan_s, 1e-9)
+            << " МБ/с, потоков " << threads << ")\n";
+    std::cout << "Раундов " << total.round_us.size() << ", матчей " << total.matches << ", клиентов "
+            << total.clients.size() << "\n";
+    print_quantiles("Длительность раунда", total.round_us);
+    print_quantiles("Время ответа участника", total.choice_us);
+
+    std::vector<std::pair<uint64_t, ClientStats> > ranked;
+    for (const auto &slot: total.clients) {
+        if (slot.value.rounds >= config.min_rounds) ranked.emplace_back(slot.key, slot.value);
+    }
+    auto win_rate = [](const ClientStats &stats) { return double(stats.won) / std::max<uint64_t>(stats.rounds, 1); };
+    size_t shown = std::min(config.top, ranked.size());
+    std::partial_sort(ranked.begin(), ranked.begin() + shown, ranked.end(), [&](const auto &a, const auto &b) {
+        double ra = win_rate(a.second), rb = win_rate(b.second);
+        return ra != rb ? ra > rb : a.second.rounds > b.second.rounds;
+    });
+    std::cout << "\nКлиенты с наибольшей долей выигранных раундов (не меньше " << config.min_rounds << " раундов):\n"
+            << std::left << std::setw(24) << "client" << std::right << std::setw(10) << "rounds" << std::setw(10)
+            << "won" << std::setw(10) << "draw" << std::setw(10) << "lost" << std::setw(11) << "no choice"
+            << std::setw(10) << "win %" << std::setw(13) << "matches won" << "\n";
+    for (size_t i = 0; i < shown; ++i) {
+        const auto &[key, stats] = ranked[i];
+        sockaddr_in addr = unpack_addr(key);
+        char text[INET_ADDRSTRLEN];
+        inet_ntop(AF_INET, &addr.sin_addr, text, sizeof(text));
+        std::cout << std::left << std::setw(24) << (std::string(text) + ":" + std::to_string(ntohs(addr.sin_port)))
+                << std::right << std::setw(10) << stats.rounds << std::setw(10) << stats.won << std::setw(10)
+                << stats.draw << std::setw(10) << stats.lost << std::setw(11) << stats.no_choice << std::setw(10)
+                << std::setprecision(1) << win_rate(stats) * 100 << std::setw(13) << stats.matches_won << "\n";
+    }
+    return damaged ? 2 : 0;
+}
@@ -0,0 +1,44 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdlib>
+#include <algorithm>
+#include <random>
+#include <string>
+
+// Распределение задержки в миллисекундах: const:MS, uniform:MIN:MAX, exp:MEAN, normal:MEAN:STDDEV.
+// Общее для генератора нагрузки (ответ на CHOOSE) и bench/match_sim.cpp (задержки сети и ответа).
+struct DelayDistribution {
+    enum Kind { CONST, UNIFORM, EXP, NORMAL } kind = CONST;
+    double a = 0, b = 0;
+
+    bool parse(const std::string &spec) {
+        size_t colon = spec.find(':');
+        if (colon == std::string::npos) return false;
+        std::string name = spec.substr(0, colon);
+        std::string rest = spec.substr(colon + 1);
+        size_t second = rest.find(':');
+        a = atof(rest.substr(0, second).c_str());
+        b = second == std::string::npos ? 0 : atof(rest.c_str() + second + 1);
+        if (name == "const") kind = CONST;
+        else if (name == "uniform" && second != std::string::npos && b >= a) kind = UNIFORM;
+        else if (name == "exp" && a > 0) kind = EXP;
+        else if (name == "normal" && second != std::string::npos) kind = NORMAL;
+        else return false;
+        return a >= 0;
+    }
+
+    uint64_t sample_us(std::mt19937_64 &gen) const {
+        double ms = a;
+        switch (kind) {
+            case CONST: break;
+            case UNIFORM: ms = std::uniform_real_distribution<double>(a, b)(gen);
+                break;
+            case EXP: ms = std::exponential_distribution<double>(1.0 / a)(gen);
+                break;
+            case NORMAL: ms = std::normal_distribution<double>(a, b)(gen);
+                break;
+        }
+        return static_cast<uint64_t>(std::max(0.0, ms) * 1000);
+    }
+};
@@ -0,0 +1,580 @@
+// Генератор нагрузки: тысячи виртуальных клиентов в одном процессе. У каждого клиента свой
+// UDP-сокет (свой порт), все сокеты обслуживает один цикл epoll с кучей таймеров (PING,
+// повтор REGISTER, отложенный ответ на CHOOSE). Клиенты говорят по протоколу v2 из
+// server/protocol.h и отвечают случайным выбором, как client/client.cpp. С --relay клиенты
+// объявляют себя ретрансляторами и пересылают рассылки сервера друг другу (server/relay_tree.h).
+// Сборка: g++ -O2 -o loadgen loadgen/loadgen.cpp
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <string>
+#include <queue>
+#include <random>
+#include <chrono>
+#include <unordered_map>
+#include <csignal>
+#include <cstring>
+#include <cmath>
+#include <unistd.h>
+#include <netdb.h>
+#include <sys/socket.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+
+#include "../server/metrics.h"
+#include "../server/protocol.h"
+#include "../server/relay_tree.h"
+#include "delay_distribution.h"
+
+volatile sig_atomic_t stop_requested = 0;
+
+void handle_signal(int) { stop_requested = 1; }
+
+uint64_t now_us() {
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// Гистограмма задержек в микросекундах (LogHistogram сервера, погрешность квантилей ~6%) с
+// точным максимумом; память не зависит от числа замеров.
+class LatencyHistogram {
+public:
+    void record(uint64_t us) {
+        histogram_.record(us);
+        max_ = std::max(max_, us);
+    }
+
+    uint64_t count() const { return histogram_.count; }
+    uint64_t max() const { return max_; }
+    uint64_t quantile(double q) const { return std::min(histogram_.quantile(q), max_); }
+
+private:
+    LogHistogram histogram_;
+    uint64_t max_ = 0;
+};
+
+struct LoadConfig {
+    std::string host = "127.0.0.1";
+    int port = 8080;
+    size_t clients = 1000;
+    uint64_t ping_ms = 3000; // интервал PING, пока сервер не назначил свой
+    bool fixed_ping = false; // PING строго каждые ping_ms, как клиенты до интервалов от сервера
+    uint64_t ramp_ms = 2000; // регистрации равномерно распределяются по этому окну
+    uint64_t register_retry_ms = 1000;
+    uint64_t duration_s = 60;
+    uint64_t report_s = 5;
+    double loss = 0; // вероятность потерять входящую или исходящую датаграмму
+    bool relay = false; // клиенты готовы ретранслировать рассылки (флаг REGISTER_RELAY)
+    double crash = 0; // доля клиентов, замолкающих при GAME_START (проверка обхода мертвых ретрансляторов)
+    DelayDistribution reply_delay;
+};
+
+struct VirtualClient {
+    int fd = -1;
+    sockaddr_in server{}; // узел сервера; REDIRECT узла кластера меняет его
+    bool registered = false;
+    bool stopped = false;
+    uint64_t register_sent_us = 0;
+    uint64_t choose_us = 0; // момент получения последнего CHOOSE, 0 - ответ на раунд уже получен
+    uint32_t round = 0;
+    uint8_t choice = 0; // выбор в текущем раунде: на повтор CHOOSE уходит тот же
+    uint32_t tournament = 0; // seq кадра GAME_START текущего турнира
+    uint32_t pong_stamp = 0; // метка последнего PONG (сетевой порядок байт), вернется в следующем PING
+    uint64_t pong_us = 0;
+    uint64_t heartbeat_us = 0; // интервал PING от сервера, 0 - еще не назначен
+    uint64_t last_sent_us = 0; // последняя датаграмма серверу: PING нужен только после интервала тишины
+    uint32_t crash_seq = 0; // seq GAME_START, для которого уже решено, замолкнет ли клиент (--crash)
+    RelayNode relay;
+    RelayKey relay_key; // из REGISTERED
+};
+
+// Разброс времени раунда: от первого CHOOSE до последнего результата среди всех клиентов.
+struct Span {
+    uint64_t first_us = UINT64_MAX;
+    uint64_t last_us = 0;
+    uint32_t count = 0;
+
+    void add(uint64_t start_us, uint64_t end_us) {
+        first_us = std::min(first_us, start_us);
+        last_us = std::max(last_us, end_us);
+        count++;
+    }
+};
+
+class LoadGenerator {
+public:
+    explicit LoadGenerator(const LoadConfig &config) : config_(config), gen_(std::random_device{}()),
+                                                       clients_(config.clients) {
+    }
+
+    bool open() {
+        addrinfo hints{}, *res = nullptr;
+        hints.ai_family = AF_INET;
+        hints.ai_socktype = SOCK_DGRAM;
+        if (getaddrinfo(config_.host.c_str(), std::to_string(config_.port).c_str(), &hints, &res) != 0 || !res) {
+            std::cerr << "[LoadGen] Не удалось разрешить адрес сервера " << config_.host << std::endl;
+            return false;
+        }
+        memcpy(&server_addr_, res->ai_addr, sizeof(server_addr_));
+        freeaddrinfo(res);
+
+        rlimit limit{};
+        getrlimit(RLIMIT_NOFILE, &limit);
+        if (limit.rlim_cur < config_.clients + 64) {
+            limit.rlim_cur = std::min<rlim_t>(limit.rlim_max, config_.clients + 64);
+            setrlimit(RLIMIT_NOFILE, &limit);
+        }
+
+        epoll_fd_ = epoll_create1(EPOLL_CLOEXEC);
+        if (epoll_fd_ < 0) {
+            perror("[LoadGen] epoll_create1");
+            return false;
+        }
+        uint64_t start = now_us();
+        for (uint32_t i = 0; i < clients_.size(); ++i) {
+            int fd = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+            if (fd < 0) {
+                perror("[LoadGen] Ошибка создания сокета (увеличьте ulimit -n)");
+                return false;
+            }
+            // Сокет не привязан к серверу: рассылки приходят и от других клиентов-ретрансляторов.
+            clients_[i].server = server_addr_;
+            epoll_event ev{};
+            ev.events = EPOLLIN;
+            ev.data.u32 = i;
+            epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, fd, &ev);
+            clients_[i].fd = fd;
+            uint64_t offset = config_.ramp_ms * 1000 * i / std::max<size_t>(clients_.size(), 1);
+            schedule(start + offset, REGISTER, i);
+        }
+        return true;
+    }
+
+    void run() {
+        uint64_t start = now_us();
+        uint64_t deadline = start + config_.duration_s * 1000000;
+        uint64_t next_report = start + config_.report_s * 1000000;
+        std::vector<epoll_event> events(256);
+        while (!stop_requested && now_us() < deadline) {
+            uint64_t now = now_us();
+            run_timers(now);
+            if (now >= next_report) {
+                report_progress(now - start);
+                next_report += config_.report_s * 1000000;
+            }
+            uint64_t wake = std::min(deadline, next_report);
+            if (!timers_.empty()) wake = std::min(wake, timers_.top().at);
+            int timeout_ms = wake > now ? static_cast<int>((wake - now + 999) / 1000) : 0;
+            int n = epoll_wait(epoll_fd_, events.data(), static_cast<int>(events.size()), timeout_ms);
+            if (n < 0) {
+                if (errno == EINTR) continue;
+                perror("[LoadGen] epoll_wait");
+                break;
+            }
+            for (int i = 0; i < n; ++i) receive(events[i].data.u32);
+        }
+        report_final(now_us() - start);
+    }
+
+    ~LoadGenerator() {
+        for (auto &client: clients_) if (client.fd >= 0) close(client.fd);
+        if (epoll_fd_ >= 0) close(epoll_fd_);
+    }
+
+private:
+    enum TimerKind : uint8_t { REGISTER, PING, REPLY, RELAY };
+
+    struct Timer {
+        uint64_t at;
+        uint32_t client;
+        TimerKind kind;
+        uint32_t round;
+
+        bool operator>(const Timer &other) const { return at > other.at; }
+    };
+
+    void schedule(uint64_t at, TimerKind kind, uint32_t client, uint32_t round = 0) {
+        timers_.push({at, client, kind, round});
+    }
+
+    bool lost() { return config_.loss > 0 && std::uniform_real_distribution<double>(0, 1)(gen_) < config_.loss; }
+
+    void send(uint32_t i, const std::string &frame) {
+        clients_[i].last_sent_us = now_us();
+        if (lost()) {
+            dropped_out_++;
+            return;
+        }
+        const sockaddr_in &to = clients_[i].server;
+        if (sendto(clients_[i].fd, frame.data(), frame.size(), 0, (const sockaddr *) &to, sizeof(to)) < 0) {
+            send_errors_++;
+        } else {
+            sent_++;
+        }
+    }
+
+    // Датаграмма другому клиенту (кадр или подтверждение ретрансляции) теряется так же, как серверу.
+    void send_peer(uint32_t i, const sockaddr_in &to, const std::string &frame) {
+        if (lost()) {
+            dropped_out_++;
+            return;
+        }
+        if (sendto(clients_[i].fd, frame.data(), frame.size(), 0, (const sockaddr *) &to, sizeof(to)) < 0) {
+            send_errors_++;
+        } else {
+            sent_++;
+        }
+    }
+
+    RelayNode::Send peer_sender(uint32_t i) {
+        return [this, i](const wire::RelayMember &to, const std::string &frame) {
+            relay_frames_++;
+            send_peer(i, relay_addr(to), frame);
+        };
+    }
+
+    void run_timers(uint64_t now) {
+        while (!timers_.empty() && timers_.top().at <= now) {
+            Timer timer = timers_.top();
+            timers_.pop();
+            VirtualClient &client = clients_[timer.client];
+            if (client.stopped) continue;
+            switch (timer.kind) {
+                case REGISTER:
+                    if (client.registered) break;
+                    if (client.register_sent_us) register_retries_++;
+                    send_register(timer.client, now);
+                    schedule(now + config_.register_retry_ms * 1000, REGISTER, timer.client);
+                    break;
+                case PING: {
+                    uint64_t due = client.last_sent_us + ping_interval_us(client);
+                    if (!config_.fixed_ping && due > now) {
+                        // Клиент недавно отправлял другие датаграммы - они и есть признак жизни.
+                        schedule(due, PING, timer.client);
+                        break;
+                    }
+                    send_ping(timer.client, now);
+                    schedule(now + ping_interval_us(client), PING, timer.client);
+                    break;
+                }
+                case REPLY: {
+                    wire::ChoiceBody body{clients_[timer.client].choice};
+                    send(timer.client, wire::frame(wire::OP_CHOICE, timer.round, seq_++, body));
+                    choices_++;
+                    break;
+                }
+                case RELAY:
+                    relay_fallbacks_ += client.relay.expire(now, peer_sender(timer.client));
+                    break;
+            }
+        }
+    }
+
+    uint64_t ping_interval_us(const VirtualClient &client) const {
+        return config_.fixed_ping || !client.heartbeat_us ? config_.ping_ms * 1000 : client.heartbeat_us;
+    }
+
+    // PING с эхо метки последнего PONG для замера RTT на сервере.
+    void send_ping(uint32_t i, uint64_t now) {
+        VirtualClient &client = clients_[i];
+        wire::PingBody body{client.pong_stamp, 0};
+        if (body.echo_us) body.held_us = htonl(static_cast<uint32_t>(now - client.pong_us));
+        client.pong_stamp = 0;
+        send(i, wire::frame(wire::OP_PING, 0, seq_++, body));
+        pings_++;
+    }
+
+    void send_register(uint32_t i, uint64_t now) {
+        wire::RegisterBody body{};
+        wire::set_name(body.name, "Load_" + std::to_string(i));
+        body.cpus = htons(static_cast<uint16_t>(1 + i % 16));
+        body.ram_mb = htonl(1024u << (i % 5));
+        if (config_.relay) body.flags = htons(wire::REGISTER_RELAY);
+        clients_[i].register_sent_us = now;
+        send(i, wire::frame(wire::OP_REGISTER, 0, seq_++, body));
+    }
+
+    void receive(uint32_t i) {
+        char buffer[2048];
+        VirtualClient &client = clients_[i];
+        while (true) {
+            sockaddr_in from{};
+            socklen_t from_len = sizeof(from);
+            ssize_t len = recvfrom(client.fd, buffer, sizeof(buffer), MSG_DONTWAIT, (sockaddr *) &from, &from_len);
+            if (len <= 0) return;
+            if (lost()) {
+                dropped_in_++;
+                continue;
+            }
+            if (client.stopped) continue;
+            received_++;
+            std::string_view data(buffer, static_cast<size_t>(len));
+            if (!wire::is_frame(data)) {
+                unexpected_++;
+                continue;
+            }
+            uint8_t opcode = wire::header(data).opcode;
+            if (opcode == wire::OP_RELAY) {
+                handle_relay(i, client, data, from, now_us());
+            } else if (opcode == wire::OP_RELAY_ACK) {
+                client.relay.ack(wire::header(data).round, relay_member(from));
+            } else {
+                handle_frame(i, client, data, now_us());
+            }
+        }
+    }
+
+    // С --crash часть клиентов перестает отвечать, получив GAME_START: ни подтверждений, ни
+    // пересылки, ни выборов. Для сервера и родителей в дереве это мертвые ретрансляторы.
+    bool crashes(VirtualClient &client, std::string_view frame) {
+        wire::ResultBody body{};
+        if (config_.crash <= 0 || wire::header(frame).opcode != wire::OP_RESULT || !wire::body(frame, body) ||
+            body.kind != wire::RESULT_GAME_START || client.crash_seq == wire::header(frame).seq) {
+            return false;
+        }
+        client.crash_seq = wire::header(frame).seq;
+        if (std::uniform_real_distribution<double>(0, 1)(gen_) >= config_.crash) return false;
+        client.stopped = true;
+        crashed_++;
+        return true;
+    }
+
+    // Кадр дерева ретрансляции: подтверждение отправителю, поддеревья детям, вложенный кадр - себе.
+    void handle_relay(uint32_t i, VirtualClient &client, std::string_view data, const sockaddr_in &from, uint64_t now) {
+        RelayView view;
+        uint32_t id = wire::header(data).round;
+        if (!parse_relay(data, view) || !relay_verify(client.relay_key, id, view)) {
+            unexpected_++;
+            return;
+        }
+        if (crashes(client, view.payload)) return;
+        RelayDelivery delivery = client.relay.delivery(id);
+        if (delivery == RelayDelivery::STALE) {
+            unexpected_++;
+            return;
+        }
+        send_peer(i, from, wire::frame(wire::OP_RELAY_ACK, id, seq_++));
+        relayed_++;
+        if (delivery == RelayDelivery::REPEAT) return;
+        if (view.members.size() > 1) {
+            auto payload = std::make_shared<const std::string>(view.payload);
+            client.relay.forward(id, payload, view.fanout, view.members.data() + 1, view.members.size() - 1,
+                                 std::min<size_t>(view.fanout, view.members.size() - 1), now, peer_sender(i));
+            schedule(client.relay.next_deadline_us(), RELAY, i);
+        }
+        handle_frame(i, client, view.payload, now);
+    }
+
+    void handle_frame(uint32_t i, VirtualClient &client, std::string_view data, uint64_t now) {
+        wire::Header header = wire::header(data);
+        switch (header.opcode) {
+            case wire::OP_REGISTERED:
+                if (!client.registered) {
+                    wire::RegisteredBody body{};
+                    if (wire::body(data, body)) {
+                        client.heartbeat_us = uint64_t{ntohl(body.heartbeat_ms)} * 1000;
+                        RelayKey key = RelayKey::from_bytes(body.relay_key);
+                        if (key != client.relay_key) client.relay.reset_deliveries();
+                        client.relay_key = key;
+                    }
+                    client.registered = true;
+                    registered_++;
+                    register_latency_.record(now - client.register_sent_us);
+                    // Фаза пингов случайна, чтобы клиенты не пинговали сервер синхронно.
+                    schedule(now + std::uniform_int_distribution<uint64_t>(0, ping_interval_us(client))(gen_), PING, i);
+                }
+                break;
+            case wire::OP_REDIRECT: {
+                // Узел кластера перенаправил к владельцу: клиент переключается на него (локальный
+                // порт, а с ним и ключ клиента, не меняется) и REGISTER уходит сразу.
+                wire::RedirectBody body{};
+                if (client.registered || !wire::body(data, body)) break;
+                client.server.sin_addr.s_addr = body.addr;
+                client.server.sin_port = body.port;
+                redirects_++;
+                send_register(i, now);
+                break;
+            }
+            case wire::OP_CHOOSE:
+                chooses_++;
+                if (client.choose_us && client.round == header.round) {
+                    // Повтор CHOOSE: сервер не получил ответ, время раунда считается от первого CHOOSE.
+                    choose_retransmits_++;
+                } else {
+                    client.choose_us = now;
+                    client.round = header.round;
+                    client.choice = static_cast<uint8_t>(gen_() % 3);
+                }
+                schedule(now + config_.reply_delay.sample_us(gen_), REPLY, i, header.round);
+                break;
+            case wire::OP_RESULT: {
+                wire::ResultBody body{};
+                if (!wire::body(data, body)) break;
+                results_++;
+                broadcasts_[header.seq].add(now, now);
+                uint32_t match = ntohl(body.match);
+                if (crashes(client, data)) break;
+                if (body.kind == wire::RESULT_GAME_START) {
+                    client.tournament = header.seq;
+                    tournaments_[header.seq].first_us = std::min(tournaments_[header.seq].first_us, now);
+                    break;
+                }
+                if (client.choose_us) {
+                    choose_result_latency_.record(now - client.choose_us);
+                    rounds_[static_cast<uint64_t>(match) << 32 | client.round].add(client.choose_us, now);
+                    client.choose_us = 0;
+                }
+                if (body.kind == wire::RESULT_WINNER || body.kind == wire::RESULT_NO_WINNER ||
+                    body.kind == wire::RESULT_ALL_OUT || body.kind == wire::RESULT_ABORTED) {
+                    if (client.tournament) {
+                        Span &span = tournaments_[client.tournament];
+                        span.last_us = std::max(span.last_us, now);
+                    }
+                    // Следующий турнир начнется с новым идентификатором раунда.
+                    client.round = 0;
+                }
+                break;
+            }
+            case wire::OP_PONG: {
+                wire::PongBody body{};
+                if (!wire::body(data, body)) break;
+                pongs_++;
+                client.pong_stamp = body.stamp_us;
+                client.pong_us = now;
+                if (body.heartbeat_ms) client.heartbeat_us = uint64_t{ntohl(body.heartbeat_ms)} * 1000;
+                if (body.flags & wire::PONG_REPLY_NOW) {
+                    probes_++;
+                    send_ping(i, now);
+                }
+                break;
+            }
+            case wire::OP_SHUTDOWN:
+                client.stopped = true;
+                shutdowns_++;
+                break;
+            default:
+                unexpected_++;
+                break;
+        }
+    }
+
+    void report_progress(uint64_t elapsed_us) const {
+        std::cout << "[LoadGen] " << elapsed_us / 1000000 << " с: зарегистрировано " << registered_ << "/" <<
+                clients_.size() << ", PING " << pings_ << " (PONG " << pongs_ << "), CHOOSE " << chooses_ <<
+                " (повторов " << choose_retransmits_ << "), выборов " << choices_ << ", результатов " << results_ <<
+                std::endl;
+    }
+
+    static void print_row(const char *phase, const LatencyHistogram &h) {
+        std::cout << std::left << std::setw(22) << phase << std::right << std::setw(10) << h.count()
+                << std::fixed << std::setprecision(2)
+                << std::setw(12) << h.quantile(0.5) / 1000.0 << std::setw(12) << h.quantile(0.9) / 1000.0
+                << std::setw(12) << h.quantile(0.99) / 1000.0 << std::setw(12) << h.max() / 1000.0
+                << std::defaultfloat << "\n";
+    }
+
+    void report_final(uint64_t elapsed_us) {
+        LatencyHistogram round_duration, tournament_duration;
+        for (const auto &[key, span]: rounds_) round_duration.record(span.last_us - span.first_us);
+        LatencyHistogram broadcast_spread;
+        for (const auto &[seq, span]: broadcasts_) {
+            // Рассылки всем активным; итоги раундов матчей на двоих не учитываются.
+            if (span.count > 2) broadcast_spread.record(span.last_us - span.first_us);
+        }
+        for (const auto &[key, span]: tournaments_) {
+            // Турнир, не доигранный до конца замера, не учитывается.
+            if (span.last_us > span.first_us) tournament_duration.record(span.last_us - span.first_us);
+        }
+
+        std::cout << "\n[LoadGen] Итоги за " << elapsed_us / 1000000.0 << " с, виртуальных клиентов: " << clients_.size()
+                << "\n  отправлено " << sent_ << " (потеряно намеренно " << dropped_out_ << ", ошибок " << send_errors_
+                << "), получено " << received_ << " (потеряно намеренно " << dropped_in_ << ", непонятных "
+                << unexpected_ << ")\n  повторов REGISTER " << register_retries_ << ", перенаправлений "
+                << redirects_ << ", SHUTDOWN " << shutdowns_
+                << "\n  ретрансляция: получено кадров " << relayed_ << ", переслано " << relay_frames_
+                << ", обходов мертвых ретрансляторов " << relay_fallbacks_ << ", замолкло клиентов " << crashed_
+                << "\n  PING " << pings_ << " (" << std::fixed << std::setprecision(1) << pings_ * 1e6 / elapsed_us
+                << std::defaultfloat << "/с), запросов PING от сервера " << probes_ << "\n\n";
+        std::cout << std::left << std::setw(22) << "phase (ms)" << std::right << std::setw(10) << "count"
+                << std::setw(12) << "p50" << std::setw(12) << "p90" << std::setw(12) << "p99" << std::setw(12)
+                << "max" << "\n";
+        print_row("REGISTER->ack", register_latency_);
+        print_row("CHOOSE->result", choose_result_latency_);
+        print_row("round", round_duration);
+        print_row("tournament", tournament_duration);
+        print_row("broadcast spread", broadcast_spread);
+    }
+
+    LoadConfig config_;
+    std::mt19937_64 gen_;
+    std::vector<VirtualClient> clients_;
+    sockaddr_in server_addr_{};
+    int epoll_fd_ = -1;
+    uint32_t seq_ = 0;
+    std::priority_queue<Timer, std::vector<Timer>, std::greater<> > timers_;
+
+    LatencyHistogram register_latency_;
+    LatencyHistogram choose_result_latency_;
+    std::unordered_map<uint64_t, Span> rounds_; // (матч << 32 | раунд) -> разброс
+    std::unordered_map<uint32_t, Span> tournaments_; // seq GAME_START -> от начала до последнего итога матча
+    std::unordered_map<uint32_t, Span> broadcasts_; // seq кадра RESULT -> первое и последнее получение
+
+    uint64_t sent_ = 0, received_ = 0, dropped_out_ = 0, dropped_in_ = 0, send_errors_ = 0, unexpected_ = 0;
+    uint64_t registered_ = 0, register_retries_ = 0, redirects_ = 0, pings_ = 0, pongs_ = 0, probes_ = 0;
+    uint64_t chooses_ = 0, choose_retransmits_ = 0, choices_ = 0, results_ = 0;
+    uint64_t shutdowns_ = 0;
+    uint64_t relayed_ = 0, relay_frames_ = 0, relay_fallbacks_ = 0, crashed_ = 0;
+};
+
+bool parse_args(int argc, char *argv[], LoadConfig &config) {
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        bool has_value = i + 1 < argc;
+        if (arg == "--host" && has_value) config.host = argv[++i];
+        else if (arg == "--port" && has_value) config.port = atoi(argv[++i]);
+        else if (arg == "--clients" && has_value) config.clients = strtoull(argv[++i], nullptr, 10);
+        else if (arg == "--ping-ms" && has_value) config.ping_ms = strtoull(argv[++i], nullptr, 10);
+        else if (arg == "--fixed-ping") config.fixed_ping = true;
+        else if (arg == "--ramp-ms" && has_value) config.ramp_ms = strtoull(argv[++i], nullptr, 10);
+        else if (arg == "--duration" && has_value) config.duration_s = strtoull(argv[++i], nullptr, 10);
+        else if (arg == "--report" && has_value) config.report_s = std::max(1ULL, strtoull(argv[++i], nullptr, 10));
+        else if (arg == "--loss" && has_value) config.loss = atof(argv[++i]);
+        else if (arg == "--relay") config.relay = true;
+        else if (arg == "--crash" && has_value) config.crash = atof(argv[++i]);
+        else if (arg == "--reply-delay" && has_value) {
+            if (!config.reply_delay.parse(argv[++i])) {
+                std::cerr << "[LoadGen] --reply-delay: const:MS | uniform:MIN:MAX | exp:MEAN | normal:MEAN:STDDEV" <<
+                        std::endl;
+                return false;
+            }
+        } else {
+            std::cerr << "[LoadGen] Неизвестный аргумент: " << arg << "\n"
+                    << "Использование: " << argv[0] << " [--host H] [--port P] [--clients N] [--ping-ms MS] [--fixed-ping]"
+                    << " [--ramp-ms MS] [--reply-delay SPEC] [--loss P] [--relay] [--crash P] [--duration S] [--report S]"
+                    << std::endl;
+            return false;
+        }
+    }
+    if (config.clients == 0 || config.ping_ms == 0 || config.loss < 0 || config.loss >= 1 || config.crash < 0 ||
+        config.crash >= 1) {
+        std::cerr << "[LoadGen] Некорректные параметры: нужны --clients > 0, --ping-ms > 0, 0 <= --loss < 1,"
+                << " 0 <= --crash < 1" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+int main(int argc, char *argv[]) {
+    LoadConfig config;
+    if (!parse_args(argc, argv, config)) return 1;
+    signal(SIGINT, handle_signal);
+    signal(SIGTERM, handle_signal);
+
+    std::cout << "[LoadGen] " << config.clients << " виртуальных клиентов -> " << config.host << ":" << config.port
+            << ", PING каждые " << config.ping_ms << " мс, потери " << config.loss * 100 << "%, длительность "
+            << config.duration_s << " с" << std::endl;
+    LoadGenerator generator(config);
+    if (!generator.open()) return 1;
+    generator.run();
+    return 0;
+}
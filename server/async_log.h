@@ -0,0 +1,310 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <atomic>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <chrono>
+#include <algorithm>
+#include <thread>
+#include <type_traits>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+
+enum class LogLevel : uint8_t { DEBUG, INFO, WARN, ERROR };
+
+// Асинхронный журнал. Производитель только копирует аргументы в запись фиксированного размера
+// в кольцевом буфере (очередь Вьюкова без блокировок), а форматирует и пишет в stdout/stderr
+// фоновый поток. Формат - строковый литерал с {} на месте аргументов; поддерживаются целые,
+// double, строки (копируются в запись и обрезаются по ее размеру) и sockaddr_in.
+// При переполнении буфера запись отбрасывается, при превышении лимита категории за секунду -
+// подавляется (кроме WARN и ERROR); счетчики потерь периодически попадают в журнал.
+class AsyncLog {
+public:
+    static constexpr size_t MAX_ARGS = 6;
+    static constexpr size_t TEXT_LEN = 168;
+    static constexpr size_t MAX_CATEGORIES = 16;
+
+    explicit AsyncLog(size_t capacity = 16384) : mask_(round_up(capacity) - 1), ring_(new Record[mask_ + 1]) {
+        for (size_t i = 0; i <= mask_; ++i) ring_[i].sequence.store(i, std::memory_order_relaxed);
+    }
+
+    ~AsyncLog() { stop(); }
+
+    // Имя категории и лимит сообщений DEBUG/INFO в секунду (0 - без лимита). Вызывать до start().
+    void set_category(uint8_t category, const char *name, uint32_t per_second) {
+        categories_[category].name = name;
+        categories_[category].limit = per_second;
+    }
+
+    void set_level(LogLevel level) { level_.store(level, std::memory_order_relaxed); }
+
+    bool enabled(LogLevel level) const { return level >= level_.load(std::memory_order_relaxed); }
+
+    void start() {
+        running_ = true;
+        writer_ = std::thread([this] { run(); });
+    }
+
+    // Дописывает все, что успели положить производители, и останавливает фоновый поток.
+    void stop() {
+        if (!writer_.joinable()) return;
+        running_ = false;
+        writer_.join();
+    }
+
+    template<typename... Args>
+    void debug(uint8_t category, const char *format, const Args &... args) {
+        write(LogLevel::DEBUG, category, nullptr, format, args...);
+    }
+
+    template<typename... Args>
+    void info(uint8_t category, const char *format, const Args &... args) {
+        write(LogLevel::INFO, category, nullptr, format, args...);
+    }
+
+    template<typename... Args>
+    void warn(uint8_t category, const char *format, const Args &... args) {
+        write(LogLevel::WARN, category, nullptr, format, args...);
+    }
+
+    template<typename... Args>
+    void error(uint8_t category, const char *format, const Args &... args) {
+        write(LogLevel::ERROR, category, nullptr, format, args...);
+    }
+
+    // prefix - второй литерал, который форматируется перед format и первым забирает аргументы.
+    template<typename... Args>
+    void write(LogLevel level, uint8_t category, const char *prefix, const char *format, const Args &... args) {
+        static_assert(sizeof...(Args) <= MAX_ARGS, "слишком много аргументов записи журнала");
+        if (!enabled(level)) return;
+        timespec now;
+        clock_gettime(CLOCK_REALTIME_COARSE, &now);
+        if (level < LogLevel::WARN && !admit(categories_[category], now.tv_sec)) return;
+
+        size_t pos = tail_.load(std::memory_order_relaxed);
+        Record *record;
+        for (;;) {
+            record = &ring_[pos & mask_];
+            size_t sequence = record->sequence.load(std::memory_order_acquire);
+            intptr_t diff = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(pos);
+            if (diff == 0) {
+                if (tail_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) break;
+            } else if (diff < 0) {
+                dropped_.fetch_add(1, std::memory_order_relaxed);
+                return;
+            } else {
+                pos = tail_.load(std::memory_order_relaxed);
+            }
+        }
+
+        record->wall_ms = static_cast<int64_t>(now.tv_sec) * 1000 + now.tv_nsec / 1'000'000;
+        record->prefix = prefix;
+        record->format = format;
+        record->level = static_cast<uint8_t>(level);
+        record->category = category;
+        record->nargs = 0;
+        record->text_used = 0;
+        (put(*record, args), ...);
+        record->sequence.store(pos + 1, std::memory_order_release);
+    }
+
+private:
+    enum ArgType : uint8_t { ARG_INT, ARG_UINT, ARG_DOUBLE, ARG_TEXT, ARG_ADDR };
+
+    struct alignas(64) Record {
+        std::atomic<size_t> sequence;
+        int64_t wall_ms;
+        const char *prefix;
+        const char *format;
+        uint8_t level;
+        uint8_t category;
+        uint8_t nargs;
+        uint8_t text_used;
+        uint8_t types[MAX_ARGS];
+        uint64_t values[MAX_ARGS]; // для ARG_TEXT - смещение << 8 | длина в text
+        char text[TEXT_LEN];
+    };
+
+    struct Category {
+        const char *name = "log";
+        uint32_t limit = 0;
+        std::atomic<int64_t> window{0};
+        std::atomic<uint32_t> in_window{0};
+        std::atomic<uint64_t> suppressed{0};
+    };
+
+    static size_t round_up(size_t n) {
+        size_t capacity = 2;
+        while (capacity < n) capacity <<= 1;
+        return capacity;
+    }
+
+    // Лимит по окну в одну секунду; гонка на смене окна допускает лишь несколько лишних записей.
+    static bool admit(Category &category, int64_t second) {
+        if (!category.limit) return true;
+        int64_t window = category.window.load(std::memory_order_relaxed);
+        if (window != second && category.window.compare_exchange_strong(window, second, std::memory_order_relaxed)) {
+            category.in_window.store(0, std::memory_order_relaxed);
+        }
+        if (category.in_window.fetch_add(1, std::memory_order_relaxed) < category.limit) return true;
+        category.suppressed.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+
+    template<typename T>
+    static void put(Record &record, const T &value) {
+        uint8_t i = record.nargs++;
+        if constexpr (std::is_same_v<T, sockaddr_in>) {
+            record.types[i] = ARG_ADDR;
+            record.values[i] = static_cast<uint64_t>(ntohl(value.sin_addr.s_addr)) << 16 | ntohs(value.sin_port);
+        } else if constexpr (std::is_floating_point_v<T>) {
+            record.types[i] = ARG_DOUBLE;
+            double d = value;
+            memcpy(&record.values[i], &d, sizeof(d));
+        } else if constexpr (std::is_integral_v<T> && std::is_signed_v<T>) {
+            record.types[i] = ARG_INT;
+            record.values[i] = static_cast<uint64_t>(static_cast<int64_t>(value));
+        } else if constexpr (std::is_integral_v<T> || std::is_enum_v<T>) {
+            record.types[i] = ARG_UINT;
+            record.values[i] = static_cast<uint64_t>(value);
+        } else {
+            std::string_view text(value);
+            size_t length = std::min(text.size(), TEXT_LEN - record.text_used);
+            memcpy(record.text + record.text_used, text.data(), length);
+            record.types[i] = ARG_TEXT;
+            record.values[i] = static_cast<uint64_t>(record.text_used) << 8 | length;
+            record.text_used = static_cast<uint8_t>(record.text_used + length);
+        }
+    }
+
+    static void append_arg(std::string &out, const Record &record, size_t i) {
+        char buffer[32];
+        uint64_t value = record.values[i];
+        switch (record.types[i]) {
+            case ARG_INT:
+                out += std::to_string(static_cast<int64_t>(value));
+                break;
+            case ARG_UINT:
+                out += std::to_string(value);
+                break;
+            case ARG_DOUBLE: {
+                double d;
+                memcpy(&d, &value, sizeof(d));
+                snprintf(buffer, sizeof(buffer), "%.2f", d);
+                out += buffer;
+                break;
+            }
+            case ARG_TEXT:
+                out.append(record.text + (value >> 8), value & 0xFF);
+                break;
+            case ARG_ADDR:
+                snprintf(buffer, sizeof(buffer), "%u.%u.%u.%u:%u", unsigned(value >> 40 & 0xFF),
+                         unsigned(value >> 32 & 0xFF), unsigned(value >> 24 & 0xFF), unsigned(value >> 16 & 0xFF),
+                         unsigned(value & 0xFFFF));
+                out += buffer;
+                break;
+        }
+    }
+
+    static void append_format(std::string &out, const char *format, const Record &record, size_t &arg) {
+        for (const char *p = format; *p; ++p) {
+            if (p[0] == '{' && p[1] == '}') {
+                if (arg < record.nargs) append_arg(out, record, arg++);
+                ++p;
+            } else {
+                out += *p;
+            }
+        }
+    }
+
+    void format(std::string &out, const Record &record) const {
+        time_t seconds = record.wall_ms / 1000;
+        tm local;
+        localtime_r(&seconds, &local);
+        char stamp[32];
+        snprintf(stamp, sizeof(stamp), "%02d:%02d:%02d.%03d ", local.tm_hour, local.tm_min, local.tm_sec,
+                 int(record.wall_ms % 1000));
+        out += stamp;
+        if (record.level == static_cast<uint8_t>(LogLevel::WARN)) out += "ПРЕДУПРЕЖДЕНИЕ: ";
+        if (record.level == static_cast<uint8_t>(LogLevel::ERROR)) out += "ОШИБКА: ";
+        size_t arg = 0;
+        if (record.prefix) append_format(out, record.prefix, record, arg);
+        append_format(out, record.format, record, arg);
+        out += '\n';
+    }
+
+    // Забирает готовые записи подряд, начиная с head_; false, если забирать нечего.
+    bool drain(std::string &out, std::string &errors) {
+        bool any = false;
+        for (;;) {
+            Record &record = ring_[head_ & mask_];
+            if (record.sequence.load(std::memory_order_acquire) != head_ + 1) break;
+            format(record.level >= static_cast<uint8_t>(LogLevel::WARN) ? errors : out, record);
+            record.sequence.store(head_ + mask_ + 1, std::memory_order_release);
+            head_++;
+            any = true;
+        }
+        return any;
+    }
+
+    void report_losses(std::string &errors) {
+        char line[160];
+        for (auto &category: categories_) {
+            if (uint64_t suppressed = category.suppressed.exchange(0, std::memory_order_relaxed)) {
+                snprintf(line, sizeof(line), "[Log] Категория %s: подавлено сообщений сверх лимита %u/с: %llu\n",
+                         category.name, category.limit, static_cast<unsigned long long>(suppressed));
+                errors += line;
+            }
+        }
+        if (uint64_t dropped = dropped_.exchange(0, std::memory_order_relaxed)) {
+            snprintf(line, sizeof(line), "[Log] Буфер журнала переполнен, отброшено записей: %llu\n",
+                     static_cast<unsigned long long>(dropped));
+            errors += line;
+        }
+    }
+
+    void flush(std::string &out, std::string &errors) {
+        if (!out.empty()) {
+            fwrite(out.data(), 1, out.size(), stdout);
+            fflush(stdout);
+            out.clear();
+        }
+        if (!errors.empty()) {
+            fwrite(errors.data(), 1, errors.size(), stderr);
+            errors.clear();
+        }
+    }
+
+    void run() {
+        std::string out, errors;
+        auto last_report = std::chrono::steady_clock::now();
+        for (;;) {
+            bool stopping = !running_.load(std::memory_order_acquire);
+            bool any = drain(out, errors);
+            auto now = std::chrono::steady_clock::now();
+            if (stopping || now - last_report >= std::chrono::seconds(1)) {
+                report_losses(errors);
+                last_report = now;
+            }
+            flush(out, errors);
+            if (stopping) break;
+            if (!any) std::this_thread::sleep_for(std::chrono::milliseconds(2));
+        }
+    }
+
+    const size_t mask_;
+    std::unique_ptr<Record[]> ring_;
+    alignas(64) std::atomic<size_t> tail_{0};
+    alignas(64) size_t head_ = 0;
+    std::atomic<uint64_t> dropped_{0};
+    std::atomic<LogLevel> level_{LogLevel::INFO};
+    std::atomic<bool> running_{false};
+    Category categories_[MAX_CATEGORIES];
+    std::thread writer_;
+};
@@ -0,0 +1,119 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+// Разобранное описание оборудования клиента. Строку "CPU:n RAM:nMB" присылают клиенты
+// обеих версий протокола, и у парка машин таких пар (CPU, RAM) единицы, поэтому каждая хранится
+// один раз.
+struct HardwareProfile {
+    uint16_t cpus; // 0 - строку не удалось разобрать (общий профиль "unknown")
+    uint32_t ram_mb;
+    std::string text;
+};
+
+// Холодные строковые данные реестра: имена клиентов и интернированные описания оборудования.
+// Память только добавляется и никогда не перемещается, поэтому выданные указатели остаются
+// действительными до конца работы процесса и снимки реестра читают их без блокировок.
+// Имена лежат в арене блоками по BLOCK_SIZE, перед текстом - длина (2 байта).
+// Освободить строку нельзя (ее может читать снимок), поэтому рост ограничен: клиент получает
+// не больше MAX_RENAMES новых имен за время работы, различных профилей оборудования - не
+// больше MAX_HARDWARE, а неразобранные описания сводятся к одному общему профилю.
+class ProfileStore {
+public:
+    static constexpr size_t BLOCK_SIZE = 64 * 1024;
+    static constexpr size_t MAX_NAME = 1024;
+    static constexpr uint8_t MAX_RENAMES = 4;
+    static constexpr size_t MAX_HARDWARE = 4096;
+
+    // Имя в арене. current - прежнее имя клиента: при повторной регистрации с тем же именем
+    // возвращается оно, так что переподключения не растят арену. renames - счетчик смен имени
+    // клиента; исчерпав MAX_RENAMES, клиент сохраняет прежнее имя.
+    const char *intern_name(std::string_view name, const char *current, uint8_t &renames) {
+        name = name.substr(0, MAX_NAME);
+        if (current && ProfileStore::name(current) == name) return current;
+        if (current && renames >= MAX_RENAMES) return current;
+        if (current) renames++;
+        return intern_name(name);
+    }
+
+    const char *intern_name(std::string_view name) {
+        name = name.substr(0, MAX_NAME);
+        size_t need = sizeof(uint16_t) + name.size();
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (blocks_.empty() || used_ + need > BLOCK_SIZE) {
+            blocks_.push_back(std::make_unique<char[]>(BLOCK_SIZE));
+            used_ = 0;
+        }
+        char *slot = blocks_.back().get() + used_;
+        uint16_t length = static_cast<uint16_t>(name.size());
+        memcpy(slot, &length, sizeof(length));
+        memcpy(slot + sizeof(length), name.data(), name.size());
+        used_ += need;
+        return slot;
+    }
+
+    static std::string_view name(const char *slot) {
+        uint16_t length;
+        memcpy(&length, slot, sizeof(length));
+        return {slot + sizeof(length), length};
+    }
+
+    // Профиль пары (CPU, RAM); текст - в каноническом виде "CPU:n RAM:nMB".
+    const HardwareProfile *intern_hardware(uint16_t cpus, uint32_t ram_mb) {
+        if (cpus == 0) return &unknown_;
+        uint64_t key = uint64_t{cpus} << 32 | ram_mb;
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = hardware_index_.find(key);
+        if (it != hardware_index_.end()) return it->second;
+        if (hardware_.size() >= MAX_HARDWARE) return &unknown_;
+        hardware_.push_back(HardwareProfile{cpus, ram_mb,
+                                            "CPU:" + std::to_string(cpus) + " RAM:" + std::to_string(ram_mb) + "MB"});
+        return hardware_index_.emplace(key, &hardware_.back()).first->second;
+    }
+
+    // Текст клиента v1 или файла реестра; все, что не разбирается, - общий профиль "unknown".
+    const HardwareProfile *intern_hardware(std::string_view text) {
+        char buffer[64];
+        if (text.size() >= sizeof(buffer)) return &unknown_;
+        memcpy(buffer, text.data(), text.size());
+        buffer[text.size()] = '\0';
+        unsigned cpus = 0, ram_mb = 0;
+        int consumed = 0;
+        if (sscanf(buffer, "CPU:%u RAM:%uMB%n", &cpus, &ram_mb, &consumed) != 2 ||
+            consumed != static_cast<int>(text.size()) || cpus > UINT16_MAX) {
+            return &unknown_;
+        }
+        return intern_hardware(static_cast<uint16_t>(cpus), ram_mb);
+    }
+
+    // Занятая память: блоки арены и интернированные описания (с оценкой узлов индекса).
+    size_t bytes() const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        size_t total = blocks_.size() * BLOCK_SIZE;
+        for (const auto &hardware: hardware_) total += sizeof(hardware) + hardware.text.capacity() + 1 + 32;
+        return total;
+    }
+
+    size_t hardware_count() const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return hardware_.size();
+    }
+
+private:
+    mutable std::mutex mutex_;
+    std::vector<std::unique_ptr<char[]> > blocks_;
+    size_t used_ = 0;
+    std::deque<HardwareProfile> hardware_;
+    std::unordered_map<uint64_t, const HardwareProfile *> hardware_index_; // cpus << 32 | ram_mb
+    const HardwareProfile unknown_{0, 0, "unknown"};
+};
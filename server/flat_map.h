@@ -0,0 +1,165 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+#include <utility>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+
+// Ключ клиента: IPv4-адрес и порт, упакованные в одно 64-битное число (в порядке хоста).
+inline uint64_t pack_addr(const sockaddr_in &addr) {
+    return (static_cast<uint64_t>(ntohl(addr.sin_addr.s_addr)) << 16) | ntohs(addr.sin_port);
+}
+
+inline sockaddr_in unpack_addr(uint64_t key) {
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(static_cast<uint32_t>(key >> 16));
+    addr.sin_port = htons(static_cast<uint16_t>(key & 0xFFFF));
+    return addr;
+}
+
+// Хеш-таблица с открытой адресацией (линейное пробирование) для 64-битных ключей.
+// Ключ и значение лежат рядом в одном слоте, поэтому поиск обычно укладывается в одну
+// кеш-линию и не ходит по указателям. Удаление - обратным сдвигом, без "надгробий".
+template<typename V>
+class FlatMap {
+public:
+    static constexpr uint64_t EMPTY = ~0ULL;
+
+    struct Slot {
+        uint64_t key;
+        V value;
+    };
+
+    template<typename SlotT>
+    class Iterator {
+    public:
+        Iterator(SlotT *pos, SlotT *end) : pos_(pos), end_(end) { skip(); }
+
+        SlotT &operator*() const { return *pos_; }
+        SlotT *operator->() const { return pos_; }
+
+        Iterator &operator++() {
+            ++pos_;
+            skip();
+            return *this;
+        }
+
+        bool operator==(const Iterator &other) const { return pos_ == other.pos_; }
+        bool operator!=(const Iterator &other) const { return pos_ != other.pos_; }
+
+    private:
+        void skip() { while (pos_ != end_ && pos_->key == EMPTY) ++pos_; }
+
+        SlotT *pos_;
+        SlotT *end_;
+    };
+
+    using iterator = Iterator<Slot>;
+    using const_iterator = Iterator<const Slot>;
+
+    explicit FlatMap(size_t expected = 16) { rehash(capacity_for(expected)); }
+
+    V *find(uint64_t key) {
+        size_t i = hash(key) & mask_;
+        while (slots_[i].key != EMPTY) {
+            if (slots_[i].key == key) return &slots_[i].value;
+            i = (i + 1) & mask_;
+        }
+        return nullptr;
+    }
+
+    const V *find(uint64_t key) const { return const_cast<FlatMap *>(this)->find(key); }
+
+    bool contains(uint64_t key) const { return find(key) != nullptr; }
+
+    // Возвращает указатель на значение и признак того, что ключ был вставлен.
+    std::pair<V *, bool> try_emplace(uint64_t key, const V &value = V{}) {
+        if ((size_ + 1) * 10 > slots_.size() * 7) rehash(slots_.size() * 2);
+        size_t i = hash(key) & mask_;
+        while (slots_[i].key != EMPTY) {
+            if (slots_[i].key == key) return {&slots_[i].value, false};
+            i = (i + 1) & mask_;
+        }
+        slots_[i].key = key;
+        slots_[i].value = value;
+        size_++;
+        return {&slots_[i].value, true};
+    }
+
+    V &operator[](uint64_t key) { return *try_emplace(key).first; }
+
+    bool erase(uint64_t key) {
+        size_t i = hash(key) & mask_;
+        while (slots_[i].key != key) {
+            if (slots_[i].key == EMPTY) return false;
+            i = (i + 1) & mask_;
+        }
+        size_t hole = i;
+        for (size_t j = (hole + 1) & mask_; slots_[j].key != EMPTY; j = (j + 1) & mask_) {
+            size_t home = hash(slots_[j].key) & mask_;
+            // Элемент j можно сдвинуть в дыру, если его "домашний" слот не лежит между дырой и j.
+            if (((j - home) & mask_) >= ((j - hole) & mask_)) {
+                slots_[hole] = std::move(slots_[j]);
+                hole = j;
+            }
+        }
+        slots_[hole].key = EMPTY;
+        slots_[hole].value = V{};
+        size_--;
+        return true;
+    }
+
+    void clear() {
+        if (size_ == 0) return;
+        for (auto &slot: slots_) slot.key = EMPTY;
+        size_ = 0;
+    }
+
+    void reserve(size_t expected) {
+        size_t capacity = capacity_for(expected);
+        if (capacity > slots_.size()) rehash(capacity);
+    }
+
+    size_t size() const { return size_; }
+    bool empty() const { return size_ == 0; }
+    size_t capacity() const { return slots_.size(); }
+
+    iterator begin() { return {slots_.data(), slots_.data() + slots_.size()}; }
+    iterator end() { return {slots_.data() + slots_.size(), slots_.data() + slots_.size()}; }
+    const_iterator begin() const { return {slots_.data(), slots_.data() + slots_.size()}; }
+    const_iterator end() const { return {slots_.data() + slots_.size(), slots_.data() + slots_.size()}; }
+
+private:
+    static uint64_t hash(uint64_t key) {
+        key ^= key >> 33;
+        key *= 0xff51afd7ed558ccdULL;
+        key ^= key >> 33;
+        key *= 0xc4ceb9fe1a85ec53ULL;
+        key ^= key >> 33;
+        return key;
+    }
+
+    static size_t capacity_for(size_t expected) {
+        size_t capacity = 16;
+        while (capacity * 7 < expected * 10) capacity *= 2;
+        return capacity;
+    }
+
+    void rehash(size_t capacity) {
+        std::vector<Slot> old;
+        old.swap(slots_);
+        slots_.assign(capacity, Slot{EMPTY, V{}});
+        mask_ = capacity - 1;
+        size_ = 0;
+        for (auto &slot: old) {
+            if (slot.key != EMPTY) try_emplace(slot.key, slot.value);
+        }
+    }
+
+    std::vector<Slot> slots_;
+    size_t mask_ = 0;
+    size_t size_ = 0;
+};
@@ -0,0 +1,657 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <algorithm>
+#include <chrono>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+
+#include "flat_map.h"
+#include "round_tally.h"
+#include "protocol.h"
+#include "async_log.h"
+#include "results_journal.h"
+
+// Матч турнира отдельно от сетевой части сервера: все, что матчу нужно снаружи (часы,
+// отправка датаграмм, имена клиентов, журнал, метрики, связь с координатором), он получает
+// через MatchHost. Сервер подставляет реальные часы и UDP-сокеты, симуляция bench/match_sim.cpp -
+// виртуальное время и модель сети, поэтому один и тот же код раундов работает в обоих.
+
+#define GAME_TIMEOUT 15
+#define ROUND_LOG_DETAILS 16
+#define CHOOSE_RTO_MS 200
+#define ROUND_DEADLINE_SLACK_MS 1000
+// Повторная проверка команд координатора ждущим матчем шарда кластера.
+#define CLUSTER_IDLE_MS 1000
+
+enum GameChoice { ROCK, PAPER, SCISSORS, INVALID };
+static_assert(ROCK == SLOT_ROCK && PAPER == SLOT_PAPER && SCISSORS == SLOT_SCISSORS, "GameChoice хранится в слотах матча");
+
+using SteadyTime = std::chrono::steady_clock::time_point;
+
+inline const char *choice_name(GameChoice c) {
+    switch (c) {
+        case ROCK: return "Камень";
+        case PAPER: return "Бумага";
+        case SCISSORS: return "Ножницы";
+        default: return "Неизвестно";
+    }
+}
+
+// Строка "ip:port" нужна только для логов и админских команд.
+inline std::string format_addr(const sockaddr_in &addr) {
+    char ip[INET_ADDRSTRLEN];
+    inet_ntop(AF_INET, &addr.sin_addr, ip, sizeof(ip));
+    return std::string(ip) + ":" + std::to_string(ntohs(addr.sin_port));
+}
+
+// Рассылаемое сообщение в двух кодировках: текст для клиентов v1 (и multicast-группы,
+// которую слушают клиенты обеих версий) и кадр RESULT/SHUTDOWN для клиентов v2.
+struct Notice {
+    std::string text;
+    std::string frame;
+};
+
+// Замеры матча; сервер переводит их в свои метрики. Длительности - в наносекундах.
+enum MatchStat : uint8_t {
+    STAT_CHOICE_RTT_NS, STAT_CHOOSE_RETRANSMITS, STAT_ROUND_DEADLINE_NS, STAT_ROUNDS, STAT_DETERMINE_NS, STAT_ROUND_NS
+};
+
+// Окружение матча. Методы вызываются из потоков, выполняющих шаги матчей, а now() и record()
+// еще и из потоков приема (record_choice), поэтому реализация сервера потокобезопасна.
+class MatchHost {
+public:
+    virtual ~MatchHost() = default;
+
+    // Часы: now() - для сроков раунда, повторов CHOOSE и времени ответа, unix_seconds() - для журнала.
+    virtual SteadyTime now() const = 0;
+    virtual uint32_t unix_seconds() const = 0;
+    // false после команды остановки: матч завершается на ближайшем шаге.
+    virtual bool running() const = 0;
+    // Идентификатор раунда, уникальный среди всех матчей хоста (0 не выдается).
+    virtual uint32_t next_round_id() = 0;
+
+    // Транспорт: CHOOSE участникам без выбора (текстом или кадром v2 с идентификатором раунда)
+    // и рассылка итогов - участникам матча или, если members == nullptr, всем активным клиентам.
+    virtual void send_choose(uint32_t round, const std::vector<sockaddr_in> &text,
+                             const std::vector<sockaddr_in> &wire) = 0;
+    virtual Notice notice(wire::ResultKind kind, std::string text, uint32_t match, uint32_t value,
+                          std::string_view name) = 0;
+    virtual void broadcast(const Notice &notice, const std::vector<uint32_t> *members) = 0;
+
+    virtual std::string client_name(uint32_t id) const = 0;
+    virtual bool journaling() const { return false; }
+    virtual void journal(const JournalRecord *, size_t) {}
+    virtual void cluster_send(const std::string &) {}
+    virtual void record(MatchStat, uint64_t) {}
+
+    // Журнал сообщений матча; nullptr - матч не пишет лог.
+    AsyncLog *log = nullptr;
+    uint8_t log_category = 0;
+};
+
+// Итог раунда по числу выборов: какие выборы остаются в игре. Общий для подсчета в матче
+// и для координатора кластера, который получает от шардов только счетчики.
+struct RoundVerdict {
+    unsigned keep = 0; // маска slot_bit выборов, остающихся в игре
+    wire::ResultKind result = wire::RESULT_NO_CHOICES;
+};
+
+inline RoundVerdict decide_round(const ChoiceCounts &counts) {
+    bool rock = counts.rock > 0, paper = counts.paper > 0, scissors = counts.scissors > 0;
+    if (!rock && !paper && !scissors) return {};
+    if (rock && scissors && !paper) return {slot_bit(SLOT_ROCK), wire::RESULT_ROCK_WINS};
+    if (paper && rock && !scissors) return {slot_bit(SLOT_PAPER), wire::RESULT_PAPER_WINS};
+    if (scissors && paper && !rock) return {slot_bit(SLOT_SCISSORS), wire::RESULT_SCISSORS_WINS};
+    return {slot_bit(SLOT_ROCK) | slot_bit(SLOT_PAPER) | slot_bit(SLOT_SCISSORS), wire::RESULT_DRAW};
+}
+
+// Сколько участников остается после раунда с такими счетчиками.
+inline size_t kept_count(const ChoiceCounts &counts, unsigned keep) {
+    return (keep & slot_bit(SLOT_ROCK) ? counts.rock : 0) + (keep & slot_bit(SLOT_PAPER) ? counts.paper : 0) +
+           (keep & slot_bit(SLOT_SCISSORS) ? counts.scissors : 0);
+}
+
+inline const char *round_message(wire::ResultKind result) {
+    switch (result) {
+        case wire::RESULT_ROCK_WINS: return "Камень бьет ножницы!";
+        case wire::RESULT_PAPER_WINS: return "Бумага покрывает камень!";
+        case wire::RESULT_SCISSORS_WINS: return "Ножницы режут бумагу!";
+        case wire::RESULT_DRAW: return "НИЧЬЯ! Новый раунд...";
+        default: return nullptr;
+    }
+}
+
+// Итог турнира кластера от координатора. announce = false - турнир отменен до начала.
+struct ClusterFinish {
+    wire::ResultKind result = wire::RESULT_ABORTED;
+    std::string winner; // имя победителя
+    std::string winner_addr;
+    bool announce = true;
+};
+
+// Один матч турнира: участники играют раунды на выбывание, пока не останется один.
+// Матч - конечный автомат: step() выполняет очередной шаг и возвращает момент, когда его
+// нужно вызвать снова, сам матч никогда не ждет. Шаги выполняют потоки MatchScheduler
+// (или реактор) сервера, а в симуляции - ее цикл событий; время, сеть, реестр и журнал
+// матч получает только через host.
+// Участники адресуются плотными номерами слотов 0..members.size()-1.
+struct Match {
+    enum class State { START, ROUND, PAUSE, VERDICT, DONE };
+
+    MatchHost *host = nullptr;
+    uint32_t number = 0;
+    bool whole_lobby = false; // в матче все активные клиенты: рассылки идут всем, как в одиночной игре
+    std::vector<uint32_t> members; // id клиента по слоту
+    std::vector<sockaddr_in> member_addrs;
+    std::vector<uint8_t> member_protocols;
+
+    // Состояние слотов (см. round_tally.h) и счетчики раунда, защищены mutex.
+    std::mutex mutex;
+    std::vector<uint8_t> slots;
+    size_t participants = 0;
+    size_t choices_expected = 0;
+    size_t choices_received = 0;
+    SteadyTime round_started{}; // момент рассылки CHOOSE, для времени ответа участников
+    uint32_t round_id = 0; // идентификатор текущего раунда в кадрах CHOOSE/CHOICE
+    bool collecting = false; // раунд принимает выборы: от рассылки CHOOSE до подсчета
+    bool choose_resent = false; // в раунде был повтор CHOOSE: время ответа неоднозначно (алгоритм Карна)
+    std::vector<uint32_t> response_bound_us; // RttEstimate::bound_us ответа участника по слоту, 0 - нет замеров
+    std::vector<uint32_t> choice_us; // время первого выбора в раунде по слоту, мкс, 0 - нет выбора; для журнала
+
+    // Матч шарда кластера (см. ClusterLink): раунды начинает и итог раунда решает координатор
+    // по сумме счетчиков всех шардов. Команды координатора защищены mutex.
+    bool clustered = false;
+    uint32_t cluster_round = 0; // последний раунд, объявленный координатором
+    std::optional<RoundVerdict> cluster_verdict;
+    size_t cluster_remaining = 0; // участников во всем кластере после раунда
+    std::optional<ClusterFinish> cluster_finish;
+
+    // Поля ниже меняет только поток, выполняющий step() под step_mutex.
+    std::mutex step_mutex;
+    State state = State::START;
+    SteadyTime wake_at{};
+    std::chrono::milliseconds round_deadline{GAME_TIMEOUT * 1000};
+    SteadyTime retransmit_at{}; // следующий повтор CHOOSE тем, кто еще не ответил
+    std::chrono::milliseconds rto{CHOOSE_RTO_MS};
+    int rounds = 0;
+    bool abandoned = false;
+    bool has_winner = false;
+    uint32_t winner = 0;
+    SteadyTime started{};
+    SteadyTime finished{};
+    uint32_t cluster_started = 0; // последний начатый раунд координатора
+
+    // Поля планировщика, защищены его мьютексом.
+    bool queued = false;
+    bool retired = false;
+    SteadyTime timer_at{};
+
+    void assign(std::vector<uint32_t> ids, std::vector<sockaddr_in> addrs, std::vector<uint8_t> protocols) {
+        members = std::move(ids);
+        member_addrs = std::move(addrs);
+        member_protocols = std::move(protocols);
+        slots.assign(members.size(), SLOT_PENDING);
+        response_bound_us.assign(members.size(), 0);
+        choice_us.assign(members.size(), 0);
+        participants = members.size();
+    }
+
+    enum class ChoiceOutcome { REJECTED, STALE, RECORDED, ROUND_COMPLETE };
+
+    // round - идентификатор раунда из кадра v2, 0 - текстовый выбор без идентификатора (такой
+    // принимается в любой момент сбора выборов). Выбор к другому раунду или вне сбора - STALE.
+    // response_us - время ответа участника, если оно однозначно (первый выбор, CHOOSE не повторялся), иначе 0.
+    ChoiceOutcome record_choice(uint32_t slot, GameChoice choice, uint32_t round, uint32_t &response_us) {
+        response_us = 0;
+        std::lock_guard<std::mutex> lock(mutex);
+        uint8_t &value = slots[slot];
+        if (value == SLOT_OUT) return ChoiceOutcome::REJECTED;
+        if (!collecting || (round && round != round_id)) return ChoiceOutcome::STALE;
+        bool first = value == SLOT_PENDING;
+        value = static_cast<uint8_t>(choice);
+        if (first) {
+            uint64_t elapsed = since_ns(round_started);
+            host->record(STAT_CHOICE_RTT_NS, elapsed);
+            choice_us[slot] = static_cast<uint32_t>(std::clamp<uint64_t>(elapsed / 1000, 1, UINT32_MAX));
+            if (!choose_resent) response_us = static_cast<uint32_t>(std::max<uint64_t>(elapsed / 1000, 1));
+        }
+        return first && ++choices_received >= choices_expected
+                   ? ChoiceOutcome::ROUND_COMPLETE
+                   : ChoiceOutcome::RECORDED;
+    }
+
+    void update_response_bound(uint32_t slot, uint32_t bound_us) {
+        std::lock_guard<std::mutex> lock(mutex);
+        response_bound_us[slot] = bound_us;
+    }
+
+    // Участник стал неактивным и выбывает из матча. Возвращает true, если без него раунд завершился.
+    bool participant_lost(uint32_t slot) {
+        std::lock_guard<std::mutex> lock(mutex);
+        uint8_t &value = slots[slot];
+        if (value == SLOT_OUT) return false;
+        if (value != SLOT_PENDING) choices_received--;
+        choices_expected--;
+        participants--;
+        value = SLOT_OUT;
+        return choices_received >= choices_expected;
+    }
+
+    // Команды координатора кластера; вызывающий затем будит матч.
+    void remote_round(uint32_t round) {
+        std::lock_guard<std::mutex> lock(mutex);
+        cluster_round = std::max(cluster_round, round);
+    }
+
+    void remote_verdict(uint32_t round, RoundVerdict verdict, size_t remaining) {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (round != cluster_round) return;
+        cluster_verdict = verdict;
+        cluster_remaining = remaining;
+    }
+
+    void remote_finish(ClusterFinish finish) {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (!cluster_finish) cluster_finish = std::move(finish);
+    }
+
+    std::optional<SteadyTime> step(SteadyTime now) {
+        std::lock_guard<std::mutex> step_lock(step_mutex);
+        switch (state) {
+            case State::START:
+                started = now;
+                state = State::PAUSE;
+                wake_at = now;
+                [[fallthrough]];
+            case State::PAUSE:
+                if (clustered) return cluster_pause(now);
+                // При остановке сервера пауза не дожидается конца: MatchScheduler, разбудивший
+                // матч, заново его таймер не заводит.
+                if (now < wake_at && host->running()) return wake_at;
+                if (!host->running() || !start_round(now)) return finish(now);
+                return retransmit_at;
+            case State::ROUND: {
+                bool complete; {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    complete = choices_received >= choices_expected;
+                }
+                if (!complete && now < wake_at && host->running()) {
+                    // Потерянный CHOOSE или выбор не ждет конца раунда: повтор только тем, кто не
+                    // ответил, с удвоением интервала в пределах срока раунда.
+                    if (now >= retransmit_at) {
+                        size_t resent = send_choose(true);
+                        host->record(STAT_CHOOSE_RETRANSMITS, resent);
+                        if (members.size() <= ROUND_LOG_DETAILS) {
+                            log("Повтор CHOOSE участникам без ответа: {} (интервал {} мс).", resent, rto.count());
+                        }
+                        rto *= 2;
+                        retransmit_at = now + rto;
+                    }
+                    return std::min(wake_at, retransmit_at);
+                }
+                if (!host->running()) return finish(now);
+                if (!complete) {
+                    log("Время ожидания выборов ({} мс) истекло.", round_deadline.count());
+                }
+                if (clustered) {
+                    report_counts();
+                    state = State::VERDICT;
+                    return now + std::chrono::milliseconds(CLUSTER_IDLE_MS);
+                }
+                determine_winner();
+                if (participants > 1) {
+                    log("Пауза 1 секунду перед следующим раундом...");
+                    state = State::PAUSE;
+                    wake_at = now + std::chrono::seconds(1);
+                    return wake_at;
+                }
+                return finish(now);
+            }
+            case State::VERDICT:
+                return cluster_verdict_step(now);
+            case State::DONE:
+                break;
+        }
+        return std::nullopt;
+    }
+
+    void broadcast(const Notice &notice) { host->broadcast(notice, whole_lobby ? nullptr : &members); }
+
+private:
+    uint64_t since_ns(SteadyTime since) const {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(host->now() - since).count();
+    }
+
+    template<typename... Args>
+    void log(const char *format, const Args &... args) const {
+        if (!host->log) return;
+        if (whole_lobby) host->log->write(LogLevel::INFO, host->log_category, "[Game Round] ", format, args...);
+        else host->log->write(LogLevel::INFO, host->log_category, "[Match #{}] ", format, number, args...);
+    }
+
+    std::string message_prefix() const {
+        return whole_lobby ? "" : "МАТЧ #" + std::to_string(number) + ": ";
+    }
+
+    Notice notice(wire::ResultKind kind, const std::string &text, uint32_t value = 0, std::string_view name = {}) const {
+        return host->notice(kind, message_prefix() + text, whole_lobby ? 0 : number, value, name);
+    }
+
+    // Начало раунда; false, если играть больше некому. В кластере раунд нужен, пока у шарда
+    // есть хоть один участник: соперники могут быть на других узлах.
+    bool start_round(SteadyTime now) {
+        size_t needed = clustered ? 1 : 2;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            participants = filter_slots(slots.data(), slots.size(),
+                                        slot_bit(SLOT_ROCK) | slot_bit(SLOT_PAPER) | slot_bit(SLOT_SCISSORS) |
+                                        slot_bit(SLOT_PENDING));
+            choices_expected = participants;
+            choices_received = 0;
+            round_started = now;
+            std::fill(choice_us.begin(), choice_us.end(), 0);
+            if (participants >= needed) {
+                round_id = host->next_round_id();
+                collecting = true;
+                choose_resent = false;
+                round_deadline = response_deadline();
+            }
+        }
+        if (participants < needed) {
+            if (clustered) return false;
+            log("Недостаточно активных участников ({}) для продолжения игры.", participants);
+            if (participants == 0) {
+                abandoned = true;
+                broadcast(notice(wire::RESULT_ALL_OUT, "Все участники выбыли или стали неактивны!"));
+            }
+            return false;
+        }
+
+        log("Начало раунда для {} участников, срок ответа {} мс.", participants, round_deadline.count());
+        host->record(STAT_ROUND_DEADLINE_NS, std::chrono::duration_cast<std::chrono::nanoseconds>(round_deadline).count());
+        rounds++;
+        state = State::ROUND;
+        wake_at = now + round_deadline;
+        rto = std::chrono::milliseconds(CHOOSE_RTO_MS);
+        retransmit_at = now + rto;
+        send_choose(false);
+        return true;
+    }
+
+    // Срок раунда: наибольшая граница времени ответа среди участников плюс запас на повторы
+    // CHOOSE, но не больше GAME_TIMEOUT. Участник без замеров ждется полный GAME_TIMEOUT.
+    // Вызывается под mutex.
+    std::chrono::milliseconds response_deadline() const {
+        uint32_t bound_us = 0;
+        for (size_t slot = 0; slot < slots.size(); ++slot) {
+            if (slots[slot] != SLOT_PENDING) continue;
+            if (!response_bound_us[slot]) return std::chrono::seconds(GAME_TIMEOUT);
+            bound_us = std::max(bound_us, response_bound_us[slot]);
+        }
+        return std::min<std::chrono::milliseconds>(std::chrono::milliseconds(bound_us / 1000 + ROUND_DEADLINE_SLACK_MS),
+                                                   std::chrono::seconds(GAME_TIMEOUT));
+    }
+
+    // CHOOSE участникам, еще не сделавшим выбор в текущем раунде; возвращает их число.
+    // Кадр v2 несет идентификатор раунда, текстовый CHOOSE - прежний, без него.
+    size_t send_choose(bool resend) {
+        thread_local std::vector<sockaddr_in> text_destinations, wire_destinations;
+        text_destinations.clear();
+        wire_destinations.clear();
+        uint32_t round; {
+            std::lock_guard<std::mutex> lock(mutex);
+            round = round_id;
+            choose_resent |= resend;
+            for (size_t slot = 0; slot < slots.size(); ++slot) {
+                if (slots[slot] != SLOT_PENDING) continue;
+                (member_protocols[slot] == wire::VERSION ? wire_destinations : text_destinations)
+                        .push_back(member_addrs[slot]);
+            }
+        }
+        host->send_choose(round, text_destinations, wire_destinations);
+        return text_destinations.size() + wire_destinations.size();
+    }
+
+    // Подробный лог с именами - только для небольших матчей. Записи журнала фиксированного
+    // размера, поэтому выбор каждого участника пишется отдельной строкой.
+    void log_round_details() {
+        std::vector<uint8_t> choices; {
+            std::lock_guard<std::mutex> lock(mutex);
+            choices = slots;
+        }
+        for (size_t slot = 0; slot < choices.size(); ++slot) {
+            std::string name = host->client_name(members[slot]);
+            if (choices[slot] <= SLOT_SCISSORS) {
+                log("Выбор раунда: {} -> {}", name, choice_name(static_cast<GameChoice>(choices[slot])));
+            } else if (choices[slot] == SLOT_PENDING) {
+                log("Активный участник {} ({}) не сделал выбор.", name, member_addrs[slot]);
+            }
+        }
+    }
+
+    // Подсчет и отбор победителей идут по массиву слотов без выделения памяти.
+    void determine_winner() {
+        SteadyTime started = host->now();
+        log("Определение победителя раунда...");
+        if (members.size() <= ROUND_LOG_DETAILS && host->log) log_round_details();
+        ChoiceCounts counts = close_round();
+        if (members.size() > ROUND_LOG_DETAILS) {
+            log("Выборы раунда: Камень {}, Бумага {}, Ножницы {}, без выбора {}", counts.rock, counts.paper,
+                counts.scissors, counts.pending);
+        }
+        apply_verdict(decide_round(counts), started);
+    }
+
+    // Конец сбора выборов и их подсчет.
+    ChoiceCounts close_round() {
+        std::lock_guard<std::mutex> lock(mutex);
+        collecting = false;
+        return tally_choices(slots.data(), slots.size());
+    }
+
+    // Отбор оставшихся в игре, журнал и рассылка результата раунда. В кластере в результате
+    // - число участников во всем кластере, а не только на этом шарде.
+    void apply_verdict(const RoundVerdict &verdict, SteadyTime started) {
+        host->record(STAT_ROUNDS, 1);
+        thread_local std::vector<uint8_t> choices; // слоты до отбора, только для журнала
+        uint32_t round;
+        uint64_t round_us;
+        size_t remaining; {
+            std::lock_guard<std::mutex> lock(mutex);
+            round = round_id;
+            round_us = since_ns(round_started) / 1000;
+            if (host->journaling()) choices = slots;
+            participants = filter_slots(slots.data(), slots.size(), verdict.keep);
+            remaining = clustered ? cluster_remaining : participants;
+        }
+        if (host->journaling()) journal_round(choices, verdict.keep, verdict.result, round, round_us);
+
+        const char *message = round_message(verdict.result);
+        if (!message) {
+            log("Никто из активных участников раунда не сделал валидный выбор.");
+            broadcast(notice(wire::RESULT_NO_CHOICES, "НИКТО НЕ СДЕЛАЛ ВЫБОР! Ничья. Новый раунд..."));
+        } else {
+            log("Результат раунда: {}. Следующий раунд с {} участниками.", message, remaining);
+            broadcast(notice(verdict.result, message, static_cast<uint32_t>(remaining)));
+        }
+        record_round(started);
+    }
+
+    // Шард ждет команды координатора: начать следующий раунд или закончить турнир. Если своих
+    // участников у шарда не осталось, он сразу отвечает нулевыми счетчиками.
+    std::optional<SteadyTime> cluster_pause(SteadyTime now) {
+        uint32_t announced;
+        bool finishing; {
+            std::lock_guard<std::mutex> lock(mutex);
+            announced = cluster_round;
+            finishing = cluster_finish.has_value();
+        }
+        if (!host->running() || finishing) return finish(now);
+        if (announced == cluster_started) return now + std::chrono::milliseconds(CLUSTER_IDLE_MS);
+        cluster_started = announced;
+        if (start_round(now)) return retransmit_at;
+        report_counts();
+        state = State::VERDICT;
+        return now + std::chrono::milliseconds(CLUSTER_IDLE_MS);
+    }
+
+    std::optional<SteadyTime> cluster_verdict_step(SteadyTime now) {
+        std::optional<RoundVerdict> verdict;
+        bool finishing; {
+            std::lock_guard<std::mutex> lock(mutex);
+            verdict = cluster_verdict;
+            cluster_verdict.reset();
+            finishing = cluster_finish.has_value();
+        }
+        if (!host->running() || (finishing && !verdict)) return finish(now);
+        if (!verdict) return now + std::chrono::milliseconds(CLUSTER_IDLE_MS);
+        apply_verdict(*verdict, now);
+        // Имя и адрес последнего оставшегося участника нужны координатору для объявления победителя.
+        std::string kept = "KEPT\t" + std::to_string(cluster_started) + "\t" + std::to_string(participants);
+        if (participants == 1) {
+            size_t slot;
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                slot = std::find_if(slots.begin(), slots.end(), [](uint8_t value) { return value != SLOT_OUT; }) -
+                       slots.begin();
+            }
+            kept += "\t" + host->client_name(members[slot]) + "\t" +
+                    format_addr(member_addrs[slot]);
+        }
+        host->cluster_send(kept + "\n");
+        state = State::PAUSE;
+        return now + std::chrono::milliseconds(CLUSTER_IDLE_MS);
+    }
+
+    // Счетчики выборов раунда координатору; итог раунда придет командой VERDICT.
+    void report_counts() {
+        ChoiceCounts counts = close_round();
+        host->cluster_send("COUNTS\t" + std::to_string(cluster_started) + "\t" + std::to_string(counts.rock) + "\t" +
+                     std::to_string(counts.paper) + "\t" + std::to_string(counts.scissors) + "\t" +
+                     std::to_string(counts.pending) + "\n");
+    }
+
+    // Запись раунда в журнал: итог раунда и по записи на каждого участника, еще не выбывшего
+    // до раунда. choices - слоты до отбора, keep - маска оставшихся в игре выборов.
+    // choice_us читается без mutex: после подсчета выборы раунда уже не принимаются.
+    void journal_round(const std::vector<uint8_t> &choices, unsigned keep, wire::ResultKind result, uint32_t round,
+                       uint64_t round_us) {
+        thread_local std::vector<JournalRecord> records;
+        records.clear();
+        uint32_t now = host->unix_seconds();
+        uint32_t match = whole_lobby ? 0 : number;
+        bool decisive = result == wire::RESULT_ROCK_WINS || result == wire::RESULT_PAPER_WINS ||
+                        result == wire::RESULT_SCISSORS_WINS;
+        uint32_t players = 0;
+        records.push_back({});
+        for (size_t slot = 0; slot < choices.size(); ++slot) {
+            uint8_t choice = choices[slot];
+            if (choice == SLOT_OUT) continue;
+            players++;
+            uint8_t outcome = !(keep & slot_bit(choice))
+                                  ? JOURNAL_LOST
+                                  : decisive
+                                        ? JOURNAL_WON
+                                        : JOURNAL_DRAW;
+            records.push_back({JOURNAL_CHOICE, choice, outcome, 0, round, match, choice_us[slot], 0, now,
+                               pack_addr(member_addrs[slot])});
+        }
+        records[0] = {JOURNAL_ROUND, static_cast<uint8_t>(result), 0, 0, round, match,
+                      static_cast<uint32_t>(std::min<uint64_t>(round_us, UINT32_MAX)), players, now, 0};
+        host->journal(records.data(), records.size());
+    }
+
+    // Длительность подсчета (с рассылкой результата) и всего раунда от рассылки CHOOSE.
+    void record_round(SteadyTime determine_started) {
+        host->record(STAT_DETERMINE_NS, since_ns(determine_started));
+        std::lock_guard<std::mutex> lock(mutex);
+        host->record(STAT_ROUND_NS, since_ns(round_started));
+    }
+
+    std::optional<SteadyTime> finish(SteadyTime now) {
+        state = State::DONE;
+        finished = now;
+        size_t winner_slot = members.size();
+        if (participants == 1) {
+            std::lock_guard<std::mutex> lock(mutex);
+            winner_slot = std::find_if(slots.begin(), slots.end(),
+                                       [](uint8_t value) { return value != SLOT_OUT; }) - slots.begin();
+        }
+        ClusterFinish remote;
+        if (clustered) {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (cluster_finish) remote = *cluster_finish;
+        }
+        if (host->journaling() && remote.announce) {
+            wire::ResultKind result = !host->running()
+                                          ? wire::RESULT_ABORTED
+                                          : clustered
+                                                ? remote.result
+                                                : winner_slot < members.size()
+                                                ? wire::RESULT_WINNER
+                                                : abandoned
+                                                      ? wire::RESULT_ALL_OUT
+                                                      : wire::RESULT_NO_WINNER;
+            JournalRecord record{JOURNAL_MATCH, static_cast<uint8_t>(result), 0, 0, round_id, whole_lobby ? 0 : number,
+                                 static_cast<uint32_t>(rounds), static_cast<uint32_t>(members.size()), host->unix_seconds(),
+                                 winner_slot < members.size() ? pack_addr(member_addrs[winner_slot]) : 0};
+            host->journal(&record, 1);
+        }
+        if (!host->running()) return std::nullopt;
+        if (clustered) {
+            announce_cluster_finish(remote, winner_slot);
+            return std::nullopt;
+        }
+
+        if (winner_slot < members.size()) {
+            has_winner = true;
+            winner = members[winner_slot];
+            std::string winner_name = host->client_name(winner);
+            Notice final_notice = notice(wire::RESULT_WINNER, "ИГРА ОКОНЧЕНА! ПОБЕДИТЕЛЬ: " + winner_name + " (" +
+                                                              format_addr(member_addrs[winner_slot]) + ")!!!", 1,
+                                         winner_name);
+            log("ИГРА ОКОНЧЕНА! ПОБЕДИТЕЛЬ: {} ({})!!!", winner_name, member_addrs[winner_slot]);
+            broadcast(final_notice);
+        } else if (!abandoned) {
+            Notice final_notice = notice(wire::RESULT_NO_WINNER, "ИГРА ОКОНЧЕНА! Победителя нет.");
+            log("ИГРА ОКОНЧЕНА! Победителя нет.");
+            broadcast(final_notice);
+        }
+        return std::nullopt;
+    }
+
+    // Итог турнира кластера: каждый шард объявляет его своим клиентам.
+    void announce_cluster_finish(const ClusterFinish &remote, size_t winner_slot) {
+        if (!remote.announce) return;
+        switch (remote.result) {
+            case wire::RESULT_WINNER:
+                if (winner_slot < members.size()) {
+                    has_winner = true;
+                    winner = members[winner_slot];
+                }
+                log("ИГРА ОКОНЧЕНА! ПОБЕДИТЕЛЬ: {} ({})!!!", remote.winner, remote.winner_addr);
+                broadcast(notice(wire::RESULT_WINNER, "ИГРА ОКОНЧЕНА! ПОБЕДИТЕЛЬ: " + remote.winner + " (" +
+                                                      remote.winner_addr + ")!!!", 1, remote.winner));
+                break;
+            case wire::RESULT_ALL_OUT:
+                abandoned = true;
+                broadcast(notice(wire::RESULT_ALL_OUT, "Все участники выбыли или стали неактивны!"));
+                break;
+            case wire::RESULT_NO_WINNER:
+                log("ИГРА ОКОНЧЕНА! Победителя нет.");
+                broadcast(notice(wire::RESULT_NO_WINNER, "ИГРА ОКОНЧЕНА! Победителя нет."));
+                break;
+            default:
+                log("Турнир кластера прерван: нет связи с координатором.");
+                broadcast(notice(wire::RESULT_ABORTED, "ИГРА ПРЕРВАНА: НЕТ СВЯЗИ С КООРДИНАТОРОМ!"));
+                break;
+        }
+    }
+};
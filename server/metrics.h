@@ -0,0 +1,141 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <cmath>
+#include <atomic>
+#include <algorithm>
+#include <array>
+
+// Логарифмически-линейная гистограмма в духе HDR: 16 корзин на каждую степень двойки
+// (относительная погрешность не более 1/16), значения до 2^40. Сама по себе однопоточная -
+// ее используют генератор нагрузки и слияние блоков Metrics.
+struct LogHistogram {
+    static constexpr int SUB_BITS = 4;
+    static constexpr int MAX_EXP = 40;
+    static constexpr size_t BUCKETS = (MAX_EXP - SUB_BITS + 2) << SUB_BITS;
+
+    std::array<uint64_t, BUCKETS> buckets{};
+    uint64_t count = 0;
+    uint64_t sum = 0;
+
+    void record(uint64_t value) {
+        buckets[bucket_of(value)]++;
+        count++;
+        sum += value;
+    }
+
+    uint64_t quantile(double q) const {
+        if (count == 0) return 0;
+        uint64_t rank = std::max<uint64_t>(static_cast<uint64_t>(std::ceil(q * count)), 1);
+        uint64_t seen = 0;
+        for (size_t bucket = 0; bucket < BUCKETS; ++bucket) {
+            seen += buckets[bucket];
+            if (seen >= rank) return upper_bound(bucket);
+        }
+        return upper_bound(BUCKETS - 1);
+    }
+
+    static size_t bucket_of(uint64_t v) {
+        if (v < (1u << SUB_BITS)) return static_cast<size_t>(v);
+        if (v >> (MAX_EXP + 1)) return BUCKETS - 1;
+        int exp = 63 - __builtin_clzll(v);
+        uint64_t sub = (v >> (exp - SUB_BITS)) & ((1u << SUB_BITS) - 1);
+        return static_cast<size_t>((exp - SUB_BITS + 1) << SUB_BITS) + sub;
+    }
+
+    static uint64_t upper_bound(size_t bucket) {
+        if (bucket < (1u << SUB_BITS)) return bucket;
+        int exp = static_cast<int>(bucket >> SUB_BITS) + SUB_BITS - 1;
+        uint64_t sub = bucket & ((1u << SUB_BITS) - 1);
+        return ((uint64_t{1} << SUB_BITS | sub) + 1) << (exp - SUB_BITS);
+    }
+};
+
+// Счетчики и гистограммы LogHistogram без блокировок. Каждый поток пишет в свой блок (только он меняет
+// его значения, поэтому хватает relaxed load + store без атомарных RMW и без разделения кэш-линий
+// между потоками), а чтение суммирует все блоки. Блоки связаны в список без удаления: блок
+// завершившегося потока освобождается и достается следующему новому потоку вместе с накопленными
+// значениями, так что счетчики остаются монотонными.
+// Один экземпляр на конкретный набор параметров шаблона: блок потока хранится в thread_local.
+template<size_t Counters, size_t Histograms>
+class Metrics {
+public:
+    using Histogram = LogHistogram;
+    static constexpr size_t BUCKETS = LogHistogram::BUCKETS;
+
+    void add(size_t counter, uint64_t n = 1) {
+        auto &value = block().counters[counter];
+        value.store(value.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+    }
+
+    void record(size_t histogram, uint64_t value) {
+        Block &b = block();
+        auto &bucket = b.buckets[histogram][LogHistogram::bucket_of(value)];
+        bucket.store(bucket.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        auto &sum = b.sums[histogram];
+        sum.store(sum.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+    }
+
+    uint64_t counter(size_t counter) const {
+        uint64_t total = 0;
+        for (Block *b = head_.load(std::memory_order_acquire); b; b = b->next) {
+            total += b->counters[counter].load(std::memory_order_relaxed);
+        }
+        return total;
+    }
+
+    Histogram histogram(size_t histogram) const {
+        Histogram merged;
+        for (Block *b = head_.load(std::memory_order_acquire); b; b = b->next) {
+            for (size_t bucket = 0; bucket < BUCKETS; ++bucket) {
+                uint64_t n = b->buckets[histogram][bucket].load(std::memory_order_relaxed);
+                merged.buckets[bucket] += n;
+                merged.count += n;
+            }
+            merged.sum += b->sums[histogram].load(std::memory_order_relaxed);
+        }
+        return merged;
+    }
+
+private:
+    struct alignas(64) Block {
+        std::atomic<uint64_t> counters[Counters]{};
+        std::atomic<uint64_t> buckets[Histograms][BUCKETS]{};
+        std::atomic<uint64_t> sums[Histograms]{};
+        std::atomic<bool> owned{true};
+        Block *next = nullptr;
+    };
+
+    // Владение блоком на время жизни потока.
+    struct Lease {
+        Block *block = nullptr;
+
+        ~Lease() {
+            if (block) block->owned.store(false, std::memory_order_release);
+        }
+    };
+
+    Block &block() {
+        thread_local Lease lease;
+        if (!lease.block) lease.block = acquire();
+        return *lease.block;
+    }
+
+    Block *acquire() {
+        for (Block *b = head_.load(std::memory_order_acquire); b; b = b->next) {
+            bool owned = false;
+            if (!b->owned.load(std::memory_order_relaxed) &&
+                b->owned.compare_exchange_strong(owned, true, std::memory_order_acquire)) {
+                return b;
+            }
+        }
+        Block *b = new Block;
+        b->next = head_.load(std::memory_order_relaxed);
+        while (!head_.compare_exchange_weak(b->next, b, std::memory_order_release, std::memory_order_relaxed)) {
+        }
+        return b;
+    }
+
+    std::atomic<Block *> head_{nullptr};
+};
@@ -0,0 +1,187 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#include <algorithm>
+#include <string>
+#include <string_view>
+#include <arpa/inet.h>
+
+// Бинарный протокол v2, общий для сервера и клиента. Каждая датаграмма - заголовок
+// фиксированного размера и тело фиксированного размера для своего кода операции.
+// Многобайтовые поля передаются в сетевом порядке байт. Клиент выбирает протокол при
+// регистрации: кадр REGISTER переводит его на v2, текстовый REGISTER:... оставляет на v1.
+namespace wire {
+    constexpr uint16_t MAGIC = 0x5250; // "RP"
+    constexpr uint8_t VERSION = 2;
+    constexpr size_t NAME_LEN = 32;
+
+    enum Opcode : uint8_t {
+        OP_REGISTER = 1, // клиент -> сервер, RegisterBody
+        OP_REGISTERED = 2, // сервер -> клиент, RegisteredBody
+        OP_PING = 3, // PingBody; без тела - PING без эхо
+        OP_CHOOSE = 4, // round - идентификатор раунда
+        OP_CHOICE = 5, // ChoiceBody, round повторяет идентификатор из CHOOSE
+        OP_RESULT = 6, // ResultBody
+        OP_SHUTDOWN = 7,
+        OP_MCAST_OK = 8,
+        OP_PONG = 9, // сервер -> клиент, PongBody
+        OP_REDIRECT = 10, // сервер -> клиент, RedirectBody: клиента обслуживает другой узел кластера
+        OP_RELAY = 11, // рассылка по дереву ретрансляторов, RelayBody; round - идентификатор рассылки
+        OP_RELAY_ACK = 12, // получатель OP_RELAY -> отправитель, round - идентификатор рассылки
+    };
+
+    enum ResultKind : uint8_t {
+        RESULT_GAME_START = 1, // value - число участников
+        RESULT_ROCK_WINS = 2, // value - сколько участников осталось
+        RESULT_PAPER_WINS = 3,
+        RESULT_SCISSORS_WINS = 4,
+        RESULT_DRAW = 5,
+        RESULT_NO_CHOICES = 6,
+        RESULT_WINNER = 7, // name - имя победителя
+        RESULT_NO_WINNER = 8,
+        RESULT_ALL_OUT = 9,
+        RESULT_ABORTED = 10,
+    };
+
+    constexpr uint8_t REGISTERED_MULTICAST = 1;
+    constexpr uint16_t REGISTER_RELAY = 1; // клиент умеет пересылать рассылки OP_RELAY
+    constexpr uint8_t PONG_REPLY_NOW = 1; // сервер давно не слышал клиента: ответить PING сразу
+
+    struct Header {
+        uint16_t magic;
+        uint8_t version;
+        uint8_t opcode;
+        uint32_t round;
+        uint32_t seq;
+    } __attribute__((packed));
+
+    struct RegisterBody {
+        char name[NAME_LEN]; // без завершающего нуля, если имя занимает все поле
+        uint16_t cpus;
+        uint16_t flags; // REGISTER_RELAY; сетевой порядок байт
+        uint32_t ram_mb;
+    } __attribute__((packed));
+
+    struct RegisteredBody {
+        uint8_t flags;
+        uint8_t reserved;
+        uint16_t multicast_port;
+        uint32_t multicast_group;
+        uint32_t heartbeat_ms; // интервал PING, который назначил сервер
+        uint8_t relay_key[16]; // ключ проверки кадров OP_RELAY; нули - клиент не в дереве ретрансляции
+    } __attribute__((packed));
+
+    struct ChoiceBody {
+        uint8_t choice; // 0..2 в порядке ROCK, PAPER, SCISSORS
+    } __attribute__((packed));
+
+    // Эхо последнего PONG: метка сервера и сколько клиент держал ее до отправки PING;
+    // сервер получает RTT без отдельного ответа клиента. echo_us = 0 - эхо нет.
+    struct PingBody {
+        uint32_t echo_us;
+        uint32_t held_us;
+    } __attribute__((packed));
+
+    struct PongBody {
+        uint32_t stamp_us; // младшие 32 бита монотонных часов сервера, мкс
+        uint32_t heartbeat_ms; // новый интервал PING
+        uint8_t flags;
+        uint8_t reserved[3];
+    } __attribute__((packed));
+
+    // Узел кластера, которому принадлежит клиент; клиент повторяет REGISTER по этому адресу.
+    struct RedirectBody {
+        uint32_t addr; // IPv4, сетевой порядок байт
+        uint16_t port; // сетевой порядок байт
+        uint16_t reserved;
+    } __attribute__((packed));
+
+    // За телом идут payload_size байт вложенного кадра (RESULT, SHUTDOWN) и members адресов
+    // RelayMember поддерева получателя (сам получатель - первый). Адреса - в порядке k-арной
+    // кучи, поэтому каждый узел сам выделяет поддеревья своих детей (см. relay_tree.h).
+    // У каждого адреса - метка сервера, которую проверяет только сам этот получатель.
+    struct RelayBody {
+        uint16_t payload_size;
+        uint16_t members;
+        uint8_t fanout;
+        uint8_t reserved[3];
+    } __attribute__((packed));
+
+    struct RelayMember {
+        uint32_t addr; // IPv4, сетевой порядок байт
+        uint16_t port; // сетевой порядок байт
+        uint8_t tag[8]; // SipHash ключом получателя от рассылки и его поддерева
+    } __attribute__((packed));
+
+    struct ResultBody {
+        uint8_t kind;
+        uint8_t reserved[3];
+        uint32_t match; // номер матча турнира, 0 - игра всем лобби
+        uint32_t value;
+        char name[NAME_LEN];
+    } __attribute__((packed));
+
+    static_assert(sizeof(Header) == 12 && sizeof(RegisterBody) == 40 && sizeof(RegisteredBody) == 28 &&
+                  sizeof(ResultBody) == 44 && sizeof(RelayBody) == 8 && sizeof(RelayMember) == 14,
+                  "размеры кадров - часть протокола");
+
+    // Кадр v2 распознается по магическому числу и версии в начале датаграммы.
+    inline bool is_frame(std::string_view data) {
+        if (data.size() < sizeof(Header)) return false;
+        uint16_t magic;
+        memcpy(&magic, data.data(), sizeof(magic));
+        return ntohs(magic) == MAGIC && static_cast<uint8_t>(data[2]) == VERSION;
+    }
+
+    // Заголовок в порядке байт хоста. Данные читаются прямо из буфера приема.
+    inline Header header(std::string_view data) {
+        Header h;
+        memcpy(&h, data.data(), sizeof(h));
+        h.magic = ntohs(h.magic);
+        h.round = ntohl(h.round);
+        h.seq = ntohl(h.seq);
+        return h;
+    }
+
+    // Тело кадра; false, если датаграмма короче заголовка и тела.
+    template<typename Body>
+    bool body(std::string_view data, Body &out) {
+        if (data.size() < sizeof(Header) + sizeof(Body)) return false;
+        memcpy(&out, data.data() + sizeof(Header), sizeof(Body));
+        return true;
+    }
+
+    inline std::string frame(uint8_t opcode, uint32_t round, uint32_t seq, const void *body = nullptr,
+                             size_t body_size = 0) {
+        Header h{htons(MAGIC), VERSION, opcode, htonl(round), htonl(seq)};
+        std::string out(sizeof(h) + body_size, '\0');
+        memcpy(out.data(), &h, sizeof(h));
+        if (body_size) memcpy(out.data() + sizeof(h), body, body_size);
+        return out;
+    }
+
+    template<typename Body>
+    std::string frame(uint8_t opcode, uint32_t round, uint32_t seq, const Body &body) {
+        return frame(opcode, round, seq, &body, sizeof(body));
+    }
+
+    // Имя длиннее NAME_LEN байт обрезается по границе символа UTF-8.
+    inline std::string_view clip_name(std::string_view name) {
+        if (name.size() <= NAME_LEN) return name;
+        size_t size = NAME_LEN;
+        while (size > 0 && (static_cast<uint8_t>(name[size]) & 0xC0) == 0x80) size--;
+        return name.substr(0, size);
+    }
+
+    inline void set_name(char (&field)[NAME_LEN], std::string_view name) {
+        name = clip_name(name);
+        memset(field, 0, NAME_LEN);
+        memcpy(field, name.data(), name.size());
+    }
+
+    inline std::string_view get_name(const char (&field)[NAME_LEN]) {
+        return {field, strnlen(field, NAME_LEN)};
+    }
+}
@@ -0,0 +1,172 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <algorithm>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+// Файл реестра клиентов, отображенный в память, для теплого перезапуска сервера.
+// Файл - заголовок и массив слотов фиксированного размера; у каждого слота две копии записи
+// с номером поколения и контрольной суммой. Новая запись идет в копию, не содержащую последнюю
+// целую запись, поэтому запись, оборванная падением процесса, портит только ее, а загрузка
+// берет целую копию с наибольшим поколением. Слоты никогда не освобождаются:
+// клиент сохраняет свой слот между перезапусками.
+struct PersistedClient {
+    uint64_t generation; // 0 - копия не записывалась
+    uint64_t key; // pack_addr адреса клиента
+    int64_t last_seen;
+    int64_t inactive_since_ms;
+    uint8_t protocol;
+    uint8_t active;
+    uint8_t multicast;
+    uint8_t reserved[5];
+    char name[32];
+    char hardware[48];
+    uint64_t checksum;
+};
+
+static_assert(sizeof(PersistedClient) == 128, "запись реестра - часть формата файла");
+
+class RegistryFile {
+public:
+    static constexpr uint32_t NONE = ~0u;
+
+    ~RegistryFile() { close(); }
+
+    // Открывает или создает файл на capacity слотов (у существующего файла емкость берется из
+    // заголовка). context - значение, которое сервер хочет сверить с прошлым запуском;
+    // прежнее доступно через previous_context().
+    bool open(const std::string &path, uint32_t capacity, uint64_t context) {
+        fd_ = ::open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+        if (fd_ < 0) return false;
+        Header header{};
+        bool fresh = pread(fd_, &header, sizeof(header), 0) != static_cast<ssize_t>(sizeof(header)) ||
+                     memcmp(header.magic, MAGIC, sizeof(header.magic)) != 0 || header.version != VERSION ||
+                     header.record_size != sizeof(PersistedClient) || header.checksum != checksum(&header, offsetof(Header, checksum));
+        if (fresh) {
+            header = Header{};
+            memcpy(header.magic, MAGIC, sizeof(header.magic));
+            header.version = VERSION;
+            header.record_size = sizeof(PersistedClient);
+            header.capacity = capacity;
+        }
+        previous_context_ = fresh ? context : header.context;
+        capacity_ = header.capacity;
+        size_ = HEADER_SIZE + static_cast<size_t>(capacity_) * 2 * sizeof(PersistedClient);
+        if (fresh && ftruncate(fd_, 0) < 0) return false;
+        if (ftruncate(fd_, static_cast<off_t>(size_)) < 0) return false;
+        void *map = mmap(nullptr, size_, PROT_READ | PROT_WRITE, MAP_SHARED, fd_, 0);
+        if (map == MAP_FAILED) return false;
+        base_ = static_cast<char *>(map);
+
+        header.context = context;
+        header.checksum = checksum(&header, offsetof(Header, checksum));
+        memcpy(base_, &header, sizeof(header));
+        return true;
+    }
+
+    bool is_open() const { return base_ != nullptr; }
+    uint32_t capacity() const { return capacity_; }
+    uint64_t previous_context() const { return previous_context_; }
+
+    // visit(slot, record) для каждого слота с целой копией.
+    template<typename F>
+    size_t load(F &&visit) const {
+        size_t loaded = 0;
+        uint32_t used = std::min(__atomic_load_n(&header()->slots_used, __ATOMIC_RELAXED), capacity_);
+        for (uint32_t slot = 0; slot < used; ++slot) {
+            if (const PersistedClient *record = latest(slot)) {
+                visit(slot, *record);
+                loaded++;
+            }
+        }
+        return loaded;
+    }
+
+    // Новый слот; NONE, если файл заполнен. Счетчик занятых слотов лежит в заголовке файла,
+    // поэтому загрузка просматривает только их, а не всю (разреженную) емкость.
+    uint32_t allocate() {
+        uint32_t slot = __atomic_fetch_add(&header()->slots_used, 1, __ATOMIC_RELAXED);
+        return slot < capacity_ ? slot : NONE;
+    }
+
+    // Запись слота. Один слот одновременно пишет только один поток (вызывающий держит
+    // мьютекс шарда клиента).
+    void write(uint32_t slot, PersistedClient record) {
+        PersistedClient *copies = copies_of(slot);
+        PersistedClient *target = latest(slot) == &copies[0] ? &copies[1] : &copies[0];
+        record.generation = std::max(copies[0].generation, copies[1].generation) + 1;
+        record.checksum = checksum(&record, offsetof(PersistedClient, checksum));
+        memcpy(target, &record, sizeof(record));
+    }
+
+    void close() {
+        if (base_) {
+            msync(base_, size_, MS_SYNC);
+            munmap(base_, size_);
+            base_ = nullptr;
+        }
+        if (fd_ >= 0) ::close(fd_);
+        fd_ = -1;
+    }
+
+    static void set_text(char *field, size_t size, std::string_view text) {
+        memset(field, 0, size);
+        memcpy(field, text.data(), std::min(text.size(), size));
+    }
+
+    static std::string_view get_text(const char *field, size_t size) { return {field, strnlen(field, size)}; }
+
+private:
+    static constexpr char MAGIC[8] = {'R', 'P', 'S', 'R', 'E', 'G', '0', '1'};
+    static constexpr uint32_t VERSION = 1;
+    static constexpr size_t HEADER_SIZE = 4096;
+
+    struct Header {
+        char magic[8];
+        uint32_t version;
+        uint32_t record_size;
+        uint32_t capacity;
+        uint32_t reserved;
+        uint64_t context;
+        uint64_t checksum;
+        uint32_t slots_used; // меняется атомарно после открытия, в контрольную сумму не входит
+    };
+
+    Header *header() const { return reinterpret_cast<Header *>(base_); }
+
+    // FNV-1a, 64 бита.
+    static uint64_t checksum(const void *data, size_t size) {
+        uint64_t hash = 0xCBF29CE484222325ULL;
+        const auto *bytes = static_cast<const unsigned char *>(data);
+        for (size_t i = 0; i < size; ++i) hash = (hash ^ bytes[i]) * 0x100000001B3ULL;
+        return hash;
+    }
+
+    PersistedClient *copies_of(uint32_t slot) const {
+        return reinterpret_cast<PersistedClient *>(base_ + HEADER_SIZE) + static_cast<size_t>(slot) * 2;
+    }
+
+    const PersistedClient *latest(uint32_t slot) const {
+        const PersistedClient *copies = copies_of(slot);
+        const PersistedClient *best = nullptr;
+        for (int i = 0; i < 2; ++i) {
+            const PersistedClient &copy = copies[i];
+            if (copy.generation == 0 || copy.checksum != checksum(&copy, offsetof(PersistedClient, checksum))) continue;
+            if (!best || copy.generation > best->generation) best = &copy;
+        }
+        return best;
+    }
+
+    int fd_ = -1;
+    char *base_ = nullptr;
+    size_t size_ = 0;
+    uint32_t capacity_ = 0;
+    uint64_t previous_context_ = 0;
+};
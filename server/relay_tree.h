@@ -0,0 +1,339 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#include <algorithm>
+#include <array>
+#include <functional>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <netinet/in.h>
+
+#include "protocol.h"
+
+// Дерево ретрансляции рассылок, общее для сервера, клиента и генератора нагрузки.
+//
+// Получатели рассылки лежат в массиве в порядке k-арной кучи, обобщенной до леса: у леса
+// roots корней, дети узла i - элементы roots + i * fanout + j (j < fanout). Поддерево любого
+// узла - по непрерывному отрезку массива на каждом уровне, и, выписанное уровнями, оно само
+// становится кучей с одним корнем. Поэтому кадр OP_RELAY несет поддерево получателя целиком:
+// получатель ничего не хранит между рассылками и сам вычисляет поддеревья своих детей.
+//
+// Кадр может прийти от любого адреса, поэтому каждый адрес в нем несет метку сервера: SipHash
+// ключом этого получателя (выдан в REGISTERED) от идентификатора рассылки, вложенного кадра и
+// поддерева получателя. Получатель проверяет свою метку и только тогда подтверждает, пересылает
+// и исполняет кадр: поддельный кадр не превращает ретранслятор в усилитель UDP-трафика.
+// Метки детей получатель пересылает как есть - поддеревья детей сервер подписал заранее.
+
+// Адресов в одном кадре: с вложенным кадром RESULT он не длиннее ~1200 байт и проходит без
+// IP-фрагментации. Больше получателей - больше корней леса у сервера.
+constexpr size_t RELAY_MAX_MEMBERS = 80;
+// Сколько отправитель ждет OP_RELAY_ACK, прежде чем сам доставить рассылку внукам.
+constexpr uint64_t RELAY_ACK_TIMEOUT_US = 200000;
+// Насколько рассылка может отстать от самой новой принятой, чтобы ее еще приняли.
+constexpr uint32_t RELAY_REPLAY_WINDOW = 64;
+
+inline wire::RelayMember relay_member(const sockaddr_in &addr) { return {addr.sin_addr.s_addr, addr.sin_port, {}}; }
+
+inline sockaddr_in relay_addr(const wire::RelayMember &member) {
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = member.addr;
+    addr.sin_port = member.port;
+    return addr;
+}
+
+inline bool operator==(const wire::RelayMember &a, const wire::RelayMember &b) {
+    return a.addr == b.addr && a.port == b.port;
+}
+
+// Поддерево узла root леса members в порядке кучи с одним корнем.
+inline void relay_subtree(const wire::RelayMember *members, size_t count, size_t roots, unsigned fanout, size_t root,
+                          std::vector<wire::RelayMember> &out) {
+    out.clear();
+    for (size_t first = root, last = root; first < count;) {
+        out.insert(out.end(), members + first, members + std::min(last + 1, count));
+        first = roots + first * fanout;
+        last = roots + last * fanout + fanout - 1;
+    }
+}
+
+inline size_t relay_subtree_size(size_t count, size_t roots, unsigned fanout, size_t root) {
+    size_t size = 0;
+    for (size_t first = root, last = root; first < count;) {
+        size += std::min(last + 1, count) - first;
+        first = roots + first * fanout;
+        last = roots + last * fanout + fanout - 1;
+    }
+    return size;
+}
+
+// Число корней леса для count получателей: не меньше fanout и столько, чтобы самое большое
+// поддерево (у первого корня) помещалось в один кадр.
+inline size_t relay_roots(size_t count, unsigned fanout) {
+    size_t roots = std::max<size_t>(fanout, (count + RELAY_MAX_MEMBERS - 1) / RELAY_MAX_MEMBERS);
+    while (roots < count && relay_subtree_size(count, roots, fanout, 0) > RELAY_MAX_MEMBERS) {
+        roots += std::max<size_t>(1, roots / 8);
+    }
+    return std::min(roots, count);
+}
+
+// 128-битный ключ SipHash; в REGISTERED передается 16 байтами в порядке little-endian.
+struct RelayKey {
+    uint64_t k0 = 0, k1 = 0;
+
+    bool empty() const { return k0 == 0 && k1 == 0; }
+    bool operator==(const RelayKey &other) const { return k0 == other.k0 && k1 == other.k1; }
+    bool operator!=(const RelayKey &other) const { return !(*this == other); }
+
+    static RelayKey from_bytes(const uint8_t (&bytes)[16]) {
+        RelayKey key;
+        for (int i = 7; i >= 0; --i) {
+            key.k0 = key.k0 << 8 | bytes[i];
+            key.k1 = key.k1 << 8 | bytes[8 + i];
+        }
+        return key;
+    }
+
+    void to_bytes(uint8_t (&bytes)[16]) const {
+        for (int i = 0; i < 8; ++i) {
+            bytes[i] = static_cast<uint8_t>(k0 >> (8 * i));
+            bytes[8 + i] = static_cast<uint8_t>(k1 >> (8 * i));
+        }
+    }
+};
+
+// SipHash-2-4 (Aumasson, Bernstein): 64-битная метка по 128-битному ключу, данные - частями.
+class SipHash {
+public:
+    explicit SipHash(const RelayKey &key)
+        : v_{key.k0 ^ 0x736f6d6570736575ULL, key.k1 ^ 0x646f72616e646f6dULL, key.k0 ^ 0x6c7967656e657261ULL,
+             key.k1 ^ 0x7465646279746573ULL} {}
+
+    SipHash &update(const void *data, size_t size) {
+        const auto *bytes = static_cast<const uint8_t *>(data);
+        total_ += size;
+        for (size_t i = 0; i < size; ++i) {
+            word_ |= uint64_t{bytes[i]} << (8 * filled_);
+            if (++filled_ == 8) {
+                compress(word_);
+                word_ = 0;
+                filled_ = 0;
+            }
+        }
+        return *this;
+    }
+
+    uint64_t final() {
+        compress(word_ | total_ << 56);
+        v_[2] ^= 0xff;
+        for (int i = 0; i < 4; ++i) round();
+        return v_[0] ^ v_[1] ^ v_[2] ^ v_[3];
+    }
+
+private:
+    static uint64_t rotl(uint64_t x, int b) { return x << b | x >> (64 - b); }
+
+    void round() {
+        v_[0] += v_[1], v_[1] = rotl(v_[1], 13), v_[1] ^= v_[0], v_[0] = rotl(v_[0], 32);
+        v_[2] += v_[3], v_[3] = rotl(v_[3], 16), v_[3] ^= v_[2];
+        v_[0] += v_[3], v_[3] = rotl(v_[3], 21), v_[3] ^= v_[0];
+        v_[2] += v_[1], v_[1] = rotl(v_[1], 17), v_[1] ^= v_[2], v_[2] = rotl(v_[2], 32);
+    }
+
+    void compress(uint64_t m) {
+        v_[3] ^= m;
+        round();
+        round();
+        v_[0] ^= m;
+    }
+
+    uint64_t v_[4];
+    uint64_t word_ = 0;
+    uint64_t total_ = 0;
+    unsigned filled_ = 0;
+};
+
+// Метка получателя members[0] для поддерева members (метки самих адресов в нее не входят).
+inline uint64_t relay_tag(const RelayKey &key, uint32_t id, unsigned fanout, std::string_view payload,
+                          const wire::RelayMember *members, size_t count) {
+    uint8_t head[7] = {static_cast<uint8_t>(id >> 24), static_cast<uint8_t>(id >> 16), static_cast<uint8_t>(id >> 8),
+                       static_cast<uint8_t>(id), static_cast<uint8_t>(fanout),
+                       static_cast<uint8_t>(payload.size() >> 8), static_cast<uint8_t>(payload.size())};
+    SipHash hash(key);
+    hash.update(head, sizeof(head)).update(payload.data(), payload.size());
+    for (size_t i = 0; i < count; ++i) {
+        hash.update(&members[i].addr, sizeof(members[i].addr)).update(&members[i].port, sizeof(members[i].port));
+    }
+    return hash.final();
+}
+
+inline void relay_store_tag(wire::RelayMember &member, uint64_t tag) {
+    for (int i = 0; i < 8; ++i) member.tag[i] = static_cast<uint8_t>(tag >> (8 * i));
+}
+
+// Сервер: метки всех узлов леса members, каждая - ключом своего получателя (key_of(member)).
+template<typename KeyOf>
+void relay_sign(uint32_t id, unsigned fanout, std::string_view payload, wire::RelayMember *members, size_t count,
+                size_t roots, const KeyOf &key_of) {
+    thread_local std::vector<wire::RelayMember> subtree;
+    for (size_t i = 0; i < count; ++i) {
+        relay_subtree(members, count, roots, fanout, i, subtree);
+        relay_store_tag(members[i], relay_tag(key_of(members[i]), id, fanout, payload, subtree.data(), subtree.size()));
+    }
+}
+
+inline std::string relay_frame(uint32_t id, unsigned fanout, std::string_view payload,
+                               const std::vector<wire::RelayMember> &members) {
+    wire::RelayBody body{htons(static_cast<uint16_t>(payload.size())), htons(static_cast<uint16_t>(members.size())),
+                         static_cast<uint8_t>(fanout), {}};
+    std::string frame = wire::frame(wire::OP_RELAY, id, 0, body);
+    frame.append(payload);
+    frame.append(reinterpret_cast<const char *>(members.data()), members.size() * sizeof(wire::RelayMember));
+    return frame;
+}
+
+struct RelayView {
+    unsigned fanout = 0;
+    std::string_view payload;
+    std::vector<wire::RelayMember> members;
+};
+
+// Разбор кадра OP_RELAY; false, если он обрезан или вложенный кадр сам не кадр v2.
+inline bool parse_relay(std::string_view data, RelayView &out) {
+    wire::RelayBody body;
+    if (!wire::body(data, body) || body.fanout < 2) return false;
+    size_t payload_size = ntohs(body.payload_size), members = ntohs(body.members);
+    size_t offset = sizeof(wire::Header) + sizeof(body);
+    if (members == 0 || data.size() < offset + payload_size + members * sizeof(wire::RelayMember)) return false;
+    out.fanout = body.fanout;
+    out.payload = data.substr(offset, payload_size);
+    out.members.resize(members);
+    memcpy(out.members.data(), data.data() + offset + payload_size, members * sizeof(wire::RelayMember));
+    return wire::is_frame(out.payload) && wire::header(out.payload).opcode != wire::OP_RELAY;
+}
+
+// Кадр подписан сервером для получателя с ключом key. Без ключа (до REGISTERED) - нет.
+inline bool relay_verify(const RelayKey &key, uint32_t id, const RelayView &view) {
+    if (key.empty()) return false;
+    uint64_t expected = relay_tag(key, id, view.fanout, view.payload, view.members.data(), view.members.size());
+    uint8_t diff = 0;
+    for (int i = 0; i < 8; ++i) diff |= view.members[0].tag[i] ^ static_cast<uint8_t>(expected >> (8 * i));
+    return diff == 0;
+}
+
+// Новизна подписанной рассылки для получателя. Метка не защищает от повтора перехваченного
+// кадра, поэтому получатель помнит идентификаторы рассылок.
+enum class RelayDelivery {
+    FIRST, // новая рассылка: подтвердить, переслать, исполнить
+    REPEAT, // уже принятая (потерялось подтверждение, и кадр прислал еще и узел выше): только подтвердить
+    STALE // старше окна RELAY_REPLAY_WINDOW или 0: отбросить без подтверждения
+};
+
+// Отправитель в дереве ретрансляции: сервер для корней леса или ретранслятор для своих детей.
+// Каждый получатель подтверждает кадр отправителю (OP_RELAY_ACK). Если подтверждения нет за
+// RELAY_ACK_TIMEOUT_US, отправитель считает ретранслятор мертвым и сам рассылает поддеревья
+// его детей, так что рассылка теряет только сам мертвый узел; его дети тоже отслеживаются.
+// Не потокобезопасен: вызывающий сериализует вызовы.
+class RelayNode {
+public:
+    using Send = std::function<void(const wire::RelayMember &to, const std::string &frame)>;
+
+    // Поддеревья всех roots корней леса members уходят своим корням.
+    void forward(uint32_t id, const std::shared_ptr<const std::string> &payload, unsigned fanout,
+                 const wire::RelayMember *members, size_t count, size_t roots, uint64_t now_us, const Send &send) {
+        for (size_t root = 0; root < std::min(roots, count); ++root) {
+            Pending pending{id, fanout, now_us + RELAY_ACK_TIMEOUT_US, payload, {}};
+            relay_subtree(members, count, roots, fanout, root, pending.subtree);
+            send(pending.subtree.front(), relay_frame(id, fanout, *payload, pending.subtree));
+            frames_++;
+            pending_.push_back(std::move(pending));
+        }
+    }
+
+    void ack(uint32_t id, const wire::RelayMember &from) {
+        for (size_t i = 0; i < pending_.size(); ++i) {
+            if (pending_[i].id == id && pending_[i].subtree.front() == from) {
+                pending_[i] = std::move(pending_.back());
+                pending_.pop_back();
+                return;
+            }
+        }
+    }
+
+    // Обход неподтвердивших получателей; dead получает их адреса. Возвращает их число.
+    size_t expire(uint64_t now_us, const Send &send, std::vector<wire::RelayMember> *dead = nullptr) {
+        std::vector<Pending> expired;
+        for (size_t i = 0; i < pending_.size();) {
+            if (pending_[i].deadline_us <= now_us) {
+                expired.push_back(std::move(pending_[i]));
+                pending_[i] = std::move(pending_.back());
+                pending_.pop_back();
+            } else {
+                ++i;
+            }
+        }
+        for (const Pending &pending: expired) {
+            if (dead) dead->push_back(pending.subtree.front());
+            // Без первого элемента поддерево - лес, корни которого - дети мертвого узла.
+            forward(pending.id, pending.payload, pending.fanout, pending.subtree.data() + 1,
+                    pending.subtree.size() - 1, pending.fanout, now_us, send);
+        }
+        fallbacks_ += expired.size();
+        return expired.size();
+    }
+
+    uint64_t next_deadline_us() const {
+        uint64_t next = UINT64_MAX;
+        for (const Pending &pending: pending_) next = std::min(next, pending.deadline_us);
+        return next;
+    }
+
+    // Идентификаторы рассылок сервера за один запуск только растут (ключ получателя от запуска
+    // к запуску меняется, и с новым ключом окно сбрасывается - reset_deliveries). Получатель
+    // помнит наибольший принятый идентификатор и битовую маску принятых в окне из
+    // RELAY_REPLAY_WINDOW идентификаторов ниже него, как окно защиты от повтора в IPsec: рассылки
+    // с переставленным порядком принимаются, а кадр старше окна отбрасывается.
+    RelayDelivery delivery(uint32_t id) {
+        if (id == 0) return RelayDelivery::STALE;
+        if (id > highest_) {
+            uint32_t shift = id - highest_;
+            accepted_ = shift >= RELAY_REPLAY_WINDOW ? 0 : accepted_ << shift;
+            accepted_ |= 1;
+            highest_ = id;
+            return RelayDelivery::FIRST;
+        }
+        uint32_t back = highest_ - id;
+        if (back >= RELAY_REPLAY_WINDOW) return RelayDelivery::STALE;
+        uint64_t bit = uint64_t{1} << back;
+        if (accepted_ & bit) return RelayDelivery::REPEAT;
+        accepted_ |= bit;
+        return RelayDelivery::FIRST;
+    }
+
+    void reset_deliveries() {
+        highest_ = 0;
+        accepted_ = 0;
+    }
+
+    uint64_t frames() const { return frames_; }
+    uint64_t fallbacks() const { return fallbacks_; }
+
+private:
+    struct Pending {
+        uint32_t id;
+        unsigned fanout;
+        uint64_t deadline_us;
+        std::shared_ptr<const std::string> payload;
+        std::vector<wire::RelayMember> subtree; // получатель - первый
+    };
+
+    std::vector<Pending> pending_;
+    uint32_t highest_ = 0; // наибольший принятый идентификатор рассылки (они начинаются с 1)
+    uint64_t accepted_ = 0; // бит i - принят идентификатор highest_ - i
+    uint64_t frames_ = 0;
+    uint64_t fallbacks_ = 0;
+};
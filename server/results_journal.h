@@ -0,0 +1,311 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+#include <cerrno>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+// Записи журнала результатов фиксированного размера.
+enum JournalType : uint8_t {
+    JOURNAL_ROUND = 1, // итог раунда
+    JOURNAL_CHOICE = 2, // выбор и исход одного участника раунда
+    JOURNAL_MATCH = 3 // итог матча
+};
+
+enum JournalOutcome : uint8_t { JOURNAL_WON = 1, JOURNAL_DRAW = 2, JOURNAL_LOST = 3 };
+
+struct JournalRecord {
+    uint8_t type; // JournalType
+    uint8_t kind; // ROUND, MATCH: wire::ResultKind; CHOICE: выбор (0..2) или 3 - без выбора
+    uint8_t outcome; // CHOICE: JournalOutcome
+    uint8_t reserved;
+    uint32_t round; // идентификатор раунда; для MATCH - последнего
+    uint32_t match; // номер матча турнира, 0 - турнир одним матчем
+    uint32_t value; // ROUND: длительность, мкс; CHOICE: время ответа, мкс (0 - нет); MATCH: сыграно раундов
+    uint32_t count; // ROUND, MATCH: участников
+    uint32_t time_s; // unix-время записи
+    uint64_t client; // CHOICE: pack_addr участника; MATCH: победителя (0 - нет или он на другом узле)
+};
+
+static_assert(sizeof(JournalRecord) == 32, "запись журнала - часть формата файла");
+
+// Заголовок сегмента - первая страница файла, записи идут следом.
+struct JournalSegmentHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t record_size;
+    uint64_t sequence;
+    uint64_t capacity; // записей
+    uint64_t committed; // записей, сброшенных на диск; читатели берут только их
+    uint32_t sealed; // 1 - сегмент закрыт, новых записей не будет
+    uint32_t reserved;
+};
+
+// Журнал результатов: сегменты journal-<номер>.rpsj в каталоге, каждый - файл фиксированного
+// размера, отображенный в память. append() только копирует записи в отображение под коротким
+// мьютексом и никогда не ждет диска. Фоновый поток раз в commit_interval сбрасывает накопленное
+// одним msync (групповая фиксация) и продвигает committed в заголовке, закрывает заполненные
+// сегменты и заранее создает следующий, так что смена сегмента в append() - обмен указателей.
+// Если запасной сегмент не успел появиться, записи отбрасываются и учитываются в dropped(),
+// пока поток фиксации на следующем проходе не создаст новый текущий сегмент.
+// Каждый запуск начинает новый сегмент; старые не дописываются.
+class ResultsJournal {
+public:
+    static constexpr char MAGIC[8] = {'R', 'P', 'S', 'J', 'R', 'N', '0', '1'};
+    static constexpr uint32_t VERSION = 1;
+    static constexpr size_t HEADER_SIZE = 4096;
+
+    ~ResultsJournal() { close(); }
+
+    bool open(const std::string &dir, uint64_t segment_records, std::chrono::milliseconds commit_interval) {
+        if (mkdir(dir.c_str(), 0755) < 0 && errno != EEXIST) return false;
+        dir_ = dir;
+        capacity_ = segment_records;
+        interval_ = commit_interval;
+        next_sequence_ = last_sequence(dir) + 1;
+        current_ = create_segment();
+        spare_ = create_segment();
+        if (!current_ || !spare_) {
+            discard(current_);
+            discard(spare_);
+            current_ = spare_ = nullptr;
+            return false;
+        }
+        running_ = true;
+        committer_ = std::thread([this] { run(); });
+        open_.store(true, std::memory_order_release);
+        return true;
+    }
+
+    bool is_open() const { return open_.load(std::memory_order_acquire); }
+
+    // Копирует записи в текущий сегмент; возвращает число принятых.
+    size_t append(const JournalRecord *records, size_t count) {
+        size_t accepted = 0;
+        bool rotated = false;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            while (accepted < count && current_) {
+                size_t room = static_cast<size_t>(capacity_ - current_->written);
+                size_t n = std::min(room, count - accepted);
+                memcpy(current_->records() + current_->written, records + accepted, n * sizeof(JournalRecord));
+                current_->written += n;
+                accepted += n;
+                if (current_->written == capacity_) {
+                    retired_.push_back(current_);
+                    current_ = spare_;
+                    spare_ = nullptr;
+                    rotated = true;
+                }
+            }
+        }
+        if (rotated) wake_.notify_one();
+        appended_.fetch_add(accepted, std::memory_order_relaxed);
+        if (accepted < count) dropped_.fetch_add(count - accepted, std::memory_order_relaxed);
+        return accepted;
+    }
+
+    // Фиксирует все записи и закрывает сегменты.
+    void close() {
+        if (!committer_.joinable()) return;
+        open_.store(false, std::memory_order_release);
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            running_ = false;
+        }
+        wake_.notify_one();
+        committer_.join();
+    }
+
+    uint64_t appended() const { return appended_.load(std::memory_order_relaxed); }
+    uint64_t dropped() const { return dropped_.load(std::memory_order_relaxed); }
+    uint64_t commits() const { return commits_.load(std::memory_order_relaxed); }
+    // Длительность последней групповой фиксации, нс.
+    uint64_t last_commit_ns() const { return last_commit_ns_.load(std::memory_order_relaxed); }
+
+    static std::string segment_path(const std::string &dir, uint64_t sequence) {
+        char name[32];
+        snprintf(name, sizeof(name), "journal-%08llu.rpsj", static_cast<unsigned long long>(sequence));
+        return dir + "/" + name;
+    }
+
+    // Номера сегментов в каталоге по возрастанию.
+    static std::vector<uint64_t> segments(const std::string &dir) {
+        std::vector<uint64_t> found;
+        if (DIR *d = opendir(dir.c_str())) {
+            while (dirent *entry = readdir(d)) {
+                unsigned long long sequence;
+                char suffix[8];
+                if (sscanf(entry->d_name, "journal-%llu.%7s", &sequence, suffix) == 2 && strcmp(suffix, "rpsj") == 0) {
+                    found.push_back(sequence);
+                }
+            }
+            closedir(d);
+        }
+        std::sort(found.begin(), found.end());
+        return found;
+    }
+
+    static bool valid(const JournalSegmentHeader &header) {
+        return memcmp(header.magic, MAGIC, sizeof(MAGIC)) == 0 && header.version == VERSION &&
+               header.record_size == sizeof(JournalRecord) && header.committed <= header.capacity;
+    }
+
+private:
+    struct Segment {
+        int fd;
+        char *base;
+        size_t size;
+        uint64_t written; // под mutex_
+        uint64_t synced; // только поток фиксации
+
+        JournalSegmentHeader *header() const { return reinterpret_cast<JournalSegmentHeader *>(base); }
+        JournalRecord *records() const { return reinterpret_cast<JournalRecord *>(base + HEADER_SIZE); }
+    };
+
+    static uint64_t last_sequence(const std::string &dir) {
+        std::vector<uint64_t> found = segments(dir);
+        return found.empty() ? 0 : found.back();
+    }
+
+    // Место под сегмент выделяется сразу (fallocate) и страницы отображаются заранее, чтобы
+    // запись в append() не упиралась в выделение блоков файловой системой.
+    Segment *create_segment() {
+        std::string path = segment_path(dir_, next_sequence_);
+        int fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC, 0644);
+        if (fd < 0) return nullptr;
+        size_t size = HEADER_SIZE + static_cast<size_t>(capacity_) * sizeof(JournalRecord);
+        if (posix_fallocate(fd, 0, static_cast<off_t>(size)) != 0 && ftruncate(fd, static_cast<off_t>(size)) < 0) {
+            ::close(fd);
+            unlink(path.c_str());
+            return nullptr;
+        }
+        void *map = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, 0);
+        if (map == MAP_FAILED) {
+            ::close(fd);
+            unlink(path.c_str());
+            return nullptr;
+        }
+        auto *segment = new Segment{fd, static_cast<char *>(map), size, 0, 0};
+        JournalSegmentHeader header{};
+        memcpy(header.magic, MAGIC, sizeof(MAGIC));
+        header.version = VERSION;
+        header.record_size = sizeof(JournalRecord);
+        header.sequence = next_sequence_++;
+        header.capacity = capacity_;
+        memcpy(segment->base, &header, sizeof(header));
+        msync(segment->base, HEADER_SIZE, MS_SYNC);
+        return segment;
+    }
+
+    // Сброс записей [synced, written) и продвижение committed: сначала данные, потом заголовок,
+    // так что committed никогда не указывает на несохраненные записи.
+    void commit(Segment *segment, uint64_t written, bool seal) {
+        if (written > segment->synced) {
+            size_t page = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+            size_t from = (HEADER_SIZE + segment->synced * sizeof(JournalRecord)) / page * page;
+            size_t to = HEADER_SIZE + written * sizeof(JournalRecord);
+            msync(segment->base + from, to - from, MS_SYNC);
+            segment->synced = written;
+        }
+        JournalSegmentHeader *header = segment->header();
+        if (header->committed == written && header->sealed == (seal ? 1u : 0u)) return;
+        header->committed = written;
+        header->sealed = seal ? 1 : 0;
+        msync(segment->base, HEADER_SIZE, MS_SYNC);
+    }
+
+    static void unmap(Segment *segment) {
+        munmap(segment->base, segment->size);
+        ::close(segment->fd);
+        delete segment;
+    }
+
+    // Неиспользованный сегмент удаляется вместе с файлом.
+    void discard(Segment *segment) {
+        if (!segment) return;
+        std::string path = segment_path(dir_, segment->header()->sequence);
+        unmap(segment);
+        unlink(path.c_str());
+    }
+
+    void run() {
+        std::unique_lock<std::mutex> lock(mutex_);
+        for (;;) {
+            wake_.wait_for(lock, interval_, [this] { return !running_ || !retired_.empty(); });
+            bool stopping = !running_;
+            Segment *current = current_;
+            uint64_t written = current ? current->written : 0;
+            std::vector<Segment *> retired;
+            retired.swap(retired_);
+            // Без текущего сегмента append() отбрасывает записи: создаем и его, и запасной.
+            int need = stopping ? 0 : (current_ ? 0 : 1) + (spare_ ? 0 : 1);
+            lock.unlock();
+
+            auto started = std::chrono::steady_clock::now();
+            for (Segment *segment: retired) {
+                commit(segment, segment->written, true);
+                unmap(segment);
+            }
+            if (current) commit(current, written, false);
+            last_commit_ns_.store(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                                      std::chrono::steady_clock::now() - started).count(), std::memory_order_relaxed);
+            commits_.fetch_add(1, std::memory_order_relaxed);
+            Segment *created[2] = {nullptr, nullptr};
+            for (int i = 0; i < need; ++i) created[i] = create_segment();
+
+            lock.lock();
+            for (Segment *segment: created) {
+                if (!segment) continue;
+                if (!current_) {
+                    current_ = segment;
+                } else if (!spare_) {
+                    spare_ = segment;
+                } else {
+                    discard(segment);
+                }
+            }
+            if (stopping) break;
+        }
+        // Остановка: append() больше не вызывается, дописываем и закрываем текущий сегмент.
+        if (current_) {
+            commit(current_, current_->written, true);
+            unmap(current_);
+        }
+        discard(spare_);
+        current_ = spare_ = nullptr;
+    }
+
+    std::string dir_;
+    uint64_t capacity_ = 0;
+    std::chrono::milliseconds interval_{50};
+    uint64_t next_sequence_ = 1; // только open() и поток фиксации
+
+    std::mutex mutex_;
+    std::condition_variable wake_;
+    Segment *current_ = nullptr;
+    Segment *spare_ = nullptr;
+    std::vector<Segment *> retired_;
+    bool running_ = false;
+    std::thread committer_;
+    std::atomic<bool> open_{false};
+
+    std::atomic<uint64_t> appended_{0};
+    std::atomic<uint64_t> dropped_{0};
+    std::atomic<uint64_t> commits_{0};
+    std::atomic<uint64_t> last_commit_ns_{0};
+};
@@ -0,0 +1,108 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#include <algorithm>
+
+// Состояние участника матча - один байт на слот: выбор раунда (0..2 в порядке ROCK, PAPER,
+// SCISSORS), SLOT_PENDING (в игре, выбор еще не сделан) или SLOT_OUT (выбыл).
+// Ядра ниже проходят по массиву слотов векторами по 16 байт (расширения GCC/Clang,
+// компилируются в SSE2/NEON) и не выделяют память.
+constexpr uint8_t SLOT_ROCK = 0;
+constexpr uint8_t SLOT_PAPER = 1;
+constexpr uint8_t SLOT_SCISSORS = 2;
+constexpr uint8_t SLOT_PENDING = 3;
+constexpr uint8_t SLOT_OUT = 4;
+
+constexpr unsigned slot_bit(uint8_t value) { return 1u << value; }
+
+struct ChoiceCounts {
+    size_t rock = 0;
+    size_t paper = 0;
+    size_t scissors = 0;
+    size_t pending = 0;
+};
+
+namespace tally_detail {
+    typedef uint8_t v16u8 __attribute__((vector_size(16)));
+
+    inline v16u8 load(const uint8_t *p) {
+        v16u8 v;
+        memcpy(&v, p, sizeof(v));
+        return v;
+    }
+
+    inline size_t hsum(v16u8 v) {
+        size_t sum = 0;
+        for (int i = 0; i < 16; ++i) sum += v[i];
+        return sum;
+    }
+
+    inline v16u8 splat(uint8_t value) {
+        v16u8 v;
+        for (int i = 0; i < 16; ++i) v[i] = value;
+        return v;
+    }
+}
+
+inline ChoiceCounts tally_choices(const uint8_t *slots, size_t n) {
+    using namespace tally_detail;
+    ChoiceCounts counts;
+    size_t i = 0;
+    const v16u8 rock = splat(SLOT_ROCK), paper = splat(SLOT_PAPER);
+    const v16u8 scissors = splat(SLOT_SCISSORS), pending = splat(SLOT_PENDING);
+    while (n - i >= 16) {
+        // Байтовые счетчики не переполняются за 255 итераций.
+        size_t block_end = i + std::min<size_t>((n - i) / 16, 255) * 16;
+        v16u8 acc_rock{}, acc_paper{}, acc_scissors{}, acc_pending{};
+        for (; i < block_end; i += 16) {
+            v16u8 v = load(slots + i);
+            acc_rock -= (v16u8) (v == rock);
+            acc_paper -= (v16u8) (v == paper);
+            acc_scissors -= (v16u8) (v == scissors);
+            acc_pending -= (v16u8) (v == pending);
+        }
+        counts.rock += hsum(acc_rock);
+        counts.paper += hsum(acc_paper);
+        counts.scissors += hsum(acc_scissors);
+        counts.pending += hsum(acc_pending);
+    }
+    for (; i < n; ++i) {
+        counts.rock += slots[i] == SLOT_ROCK;
+        counts.paper += slots[i] == SLOT_PAPER;
+        counts.scissors += slots[i] == SLOT_SCISSORS;
+        counts.pending += slots[i] == SLOT_PENDING;
+    }
+    return counts;
+}
+
+// Слоты, чье значение входит в keep_mask (набор slot_bit), переходят в SLOT_PENDING,
+// остальные - в SLOT_OUT. Возвращает число оставшихся в игре.
+inline size_t filter_slots(uint8_t *slots, size_t n, unsigned keep_mask) {
+    using namespace tally_detail;
+    size_t kept = 0;
+    size_t i = 0;
+    const v16u8 pending = splat(SLOT_PENDING), out = splat(SLOT_OUT);
+    while (n - i >= 16) {
+        size_t block_end = i + std::min<size_t>((n - i) / 16, 255) * 16;
+        v16u8 acc{};
+        for (; i < block_end; i += 16) {
+            v16u8 v = load(slots + i);
+            v16u8 keep{};
+            for (uint8_t value = 0; value <= SLOT_PENDING; ++value) {
+                if (keep_mask & slot_bit(value)) keep |= (v16u8) (v == splat(value));
+            }
+            v = (keep & pending) | (~keep & out);
+            memcpy(slots + i, &v, sizeof(v));
+            acc -= keep;
+        }
+        kept += hsum(acc);
+    }
+    for (; i < n; ++i) {
+        bool keep = slots[i] <= SLOT_PENDING && (keep_mask & slot_bit(slots[i]));
+        slots[i] = keep ? SLOT_PENDING : SLOT_OUT;
+        kept += keep;
+    }
+    return kept;
+}
@@ -14,564 +14,3080 @@
 #include <cstring>
 #include <iomanip>
 #include <atomic>
+#include <string_view>
+#include <chrono>
+#include <optional>
+#include <deque>
+#include <queue>
+#include <memory>
+#include <functional>
+#include <pthread.h>
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+#include <sys/eventfd.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <poll.h>
+#include <netinet/tcp.h>
+
+#include "flat_map.h"
+#include "timer_wheel.h"
+#include "round_tally.h"
+#include "protocol.h"
+#include "async_log.h"
+#include "metrics.h"
+#include "registry_file.h"
+#include "client_store.h"
+#include "results_journal.h"
+#include "relay_tree.h"
+#include "match.h"
 
 #define PORT 8080
 #define TIMEOUT 10
-#define GAME_TIMEOUT 15
+#define RECV_BATCH 64
+#define MAX_DATAGRAM 1024
+#define SEND_BATCH 1024
+#define LIVENESS_TICK_MS 50
+#define MAX_RECV_THREADS 64
+#define LOG_RATE_LIMIT 1000
+// Адаптивные сроки по измеренному RTT клиентов; TIMEOUT и GAME_TIMEOUT остаются верхними границами.
+#define RTT_K 4
+#define RTT_PROBE_MS 10000
+#define PING_INTERVAL_MS 3000
+// Интервал PING клиентов v2 назначает сервер по нагрузке (см. heartbeat_interval_ms).
+#define HEARTBEAT_BUDGET 10000
+#define HEARTBEAT_MAX_MS 9000
+#define HEARTBEAT_GRACE_MS 200
+#define JOURNAL_COMMIT_MS 50
+// Кластер: запас координатора сверх срока раунда на ответы шардов и переподключение шарда
+// к координатору (проверка команд ждущим матчем - CLUSTER_IDLE_MS в match.h).
+#define CLUSTER_REPLY_MS 5000
+#define CLUSTER_RECONNECT_MS 1000
+#define PROBE_WAIT_MS 600
+#define PROBE_ATTEMPTS 3
+// Управляющий сокет: страница LIST по умолчанию и максимум, записей за один захват мьютекса шарда.
+#define CONTROL_PAGE 100
+#define CONTROL_PAGE_MAX 1000
+#define CONTROL_SCAN_CHUNK 4096
+// Сколько ретранслятор без подтверждения рассылки получает следующие рассылки напрямую.
+#define RELAY_SUSPECT_MS 10000
+#define CONTROL_LINE_MAX 4096
+// Одновременных соединений управляющего сокета и сколько соединение может молчать.
+#define CONTROL_CONNECTIONS_MAX 16
+#define CONTROL_IDLE_MS 30000
+// Сколько непрочитанных ответов копится на соединение, прежде чем прием команд приостановится.
+#define CONTROL_OUTPUT_MAX 65536
+static_assert(HEARTBEAT_MAX_MS + HEARTBEAT_GRACE_MS + PROBE_WAIT_MS <= TIMEOUT * 1000,
+              "клиент, замолчавший при самом редком PING, должен выявляться не позже TIMEOUT");
+
+// Категории журнала. Сообщения о клиентах и пакетах пишутся на каждую датаграмму, поэтому
+// ограничены LOG_RATE_LIMIT записями в секунду на категорию.
+enum LogCategory : uint8_t { LOG_SERVER, LOG_CLIENTS, LOG_PACKETS, LOG_GAME, LOG_ADMIN };
+AsyncLog logger;
+
+// Метрики сервера (см. metrics.h и render_metrics). Длительности - в наносекундах.
+enum MetricCounter : size_t {
+    M_PACKETS_REGISTER, M_PACKETS_PING, M_PACKETS_CHOICE, M_PACKETS_MCAST_OK, M_PACKETS_INVALID,
+    M_RECV_CALLS, M_SENT, M_SEND_ERRORS, M_ROUNDS, M_TOURNAMENTS, M_CHOOSE_RETRANSMITS, M_STALE_CHOICES,
+    M_LIVENESS_PROBES, M_REDIRECTS, M_SENT_BYTES, M_RELAY_FRAMES, M_RELAY_FALLBACKS, M_COUNTER_COUNT
+};
+enum MetricHistogram : size_t {
+    H_RECV_BATCH_SIZE, H_RECV_BATCH_NS, H_BROADCAST_NS, H_CHOICE_RTT_NS, H_ROUND_NS, H_DETERMINE_NS,
+    H_TOURNAMENT_NS, H_PING_RTT_NS, H_ROUND_DEADLINE_NS, H_HISTOGRAM_COUNT
+};
+Metrics<M_COUNTER_COUNT, H_HISTOGRAM_COUNT> metrics;
+
+uint64_t elapsed_ns(std::chrono::steady_clock::time_point since) {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - since).count();
+}
+
+// Порядок блокировок: Match::step_mutex -> ClientShard::mutex -> Match::mutex -> мьютекс планировщика.
+// Мьютексы двух разных шардов одновременно не берутся; мьютекс ProfileStore берется последним.
+std::atomic<bool> game_running = false;
+
+struct Match;
+
+// Сглаженная оценка времени ответа по RFC 6298: srtt и rttvar с весами 1/8 и 1/4, микросекунды.
+struct RttEstimate {
+    uint32_t srtt_us = 0; // 0 - замеров еще не было
+    uint32_t rttvar_us = 0;
+
+    void add(uint32_t sample_us) {
+        if (!srtt_us) {
+            srtt_us = std::max<uint32_t>(sample_us, 1);
+            rttvar_us = sample_us / 2;
+            return;
+        }
+        uint32_t delta = sample_us > srtt_us ? sample_us - srtt_us : srtt_us - sample_us;
+        rttvar_us = rttvar_us - rttvar_us / 4 + delta / 4;
+        srtt_us = std::max<uint32_t>(srtt_us - srtt_us / 8 + sample_us / 8, 1);
+    }
+
+    // srtt + RTT_K * rttvar; 0 - оценки нет.
+    uint32_t bound_us() const { return srtt_us ? srtt_us + RTT_K * rttvar_us : 0; }
+};
+
+// Флаги клиента в горячем массиве ClientShard::flags.
+enum ClientFlag : uint8_t {
+    CLIENT_ACTIVE = 1,
+    CLIENT_MULTICAST = 2, // клиент подтвердил вступление в multicast-группу (MCAST:OK)
+    CLIENT_V2 = 4, // бинарный протокол wire::VERSION, иначе текстовый (выбирается при REGISTER)
+    CLIENT_RELAY = 8 // клиент v2 пересылает рассылки OP_RELAY (объявил при REGISTER)
+};
+
+uint8_t protocol_of(uint8_t flags) { return flags & CLIENT_V2 ? wire::VERSION : 1; }
+
+// Участие клиента в игре и оценки его времени ответа.
+struct ClientSession {
+    Match *match = nullptr; // матч текущего турнира, в котором участвует клиент
+    uint32_t match_slot = 0;
+    uint32_t heartbeat_ms = PING_INTERVAL_MS; // интервал PING, последний раз назначенный клиенту v2
+    RttEstimate rtt{}; // сетевой RTT по эхо PONG в кадрах PING
+    RttEstimate response{}; // от рассылки CHOOSE до выбора, для сроков раунда
+    uint32_t rtt_probe_ms = 0; // когда клиенту последний раз отправлен PONG (младшие биты steady_ms)
+    uint8_t probes = 0; // запросов PING клиенту v2 без ответа
+};
+
+// Поля клиента, которые нужны спискам, логам и файлу реестра, но не приему и рассылкам.
+struct ClientCold {
+    const char *name; // в profiles (ProfileStore::name)
+    const HardwareProfile *hardware;
+    int64_t inactive_since_ms; // точный момент перехода в неактивные (unix-время, мс), 0 - активен
+    uint32_t record; // слот в файле реестра
+    uint8_t renames = 0; // смен имени при повторных REGISTER (ProfileStore::MAX_RENAMES)
+};
+
+// Имена и описания оборудования всех клиентов.
+ProfileStore profiles;
+
+uint64_t steady_ms() {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+uint64_t steady_us() {
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// Дедлайн тишины клиента. Клиент v2 молчит не дольше назначенного heartbeat_ms (PING уходит,
+// только если он не отправлял ничего другого); после интервала, HEARTBEAT_GRACE_MS и границы
+// RTT сервер сам запрашивает PING (см. sweep_liveness) до PROBE_ATTEMPTS раз за PROBE_WAIT_MS,
+// так что потерянный PING не делает клиента неактивным. Дедлайн ограничен TIMEOUT минус
+// PROBE_WAIT_MS, и клиент v2 с любым RTT выявляется не позже TIMEOUT. Текстовый клиент
+// пингует сам - TIMEOUT.
+uint64_t liveness_timeout_ms(uint8_t flags, const ClientSession &session) {
+    if (!(flags & CLIENT_V2)) return TIMEOUT * 1000;
+    return std::min<uint64_t>(TIMEOUT * 1000 - PROBE_WAIT_MS,
+                              session.heartbeat_ms + HEARTBEAT_GRACE_MS + session.rtt.bound_us() / 1000);
+}
+
+int64_t wall_ms() {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+uint32_t unix_seconds() { return static_cast<uint32_t>(time(nullptr)); }
+
+// Реестр разбит на шарды по хешу адреса клиента, у каждого шарда свой мьютекс, так что
+// потоки приема блокируют друг друга только на клиентах одного шарда. Внутри шарда клиенты
+// хранятся структурой массивов по индексу клиента (клиенты не удаляются): горячие поля, которые
+// перебирают рассылки, сбор лобби и снимки, - упакованный адрес, last_seen и флаги - лежат
+// в плотных массивах по 13 байт на клиента; сессии (матч, оценки RTT) и холодные поля -
+// в своих массивах, а строки профилей - в общем ProfileStore. ids сопоставляет упакованный
+// адрес индексу, liveness - таймеры неактивности по индексу (каждый PING переносит дедлайн
+// клиента на liveness_timeout_ms вперед). Все поля защищены mutex.
+struct ShardSnapshot;
+
+struct ClientShard {
+    std::mutex mutex;
+    std::vector<uint64_t> keys; // pack_addr адреса клиента
+    std::vector<uint32_t> last_seen; // unix-время последнего сообщения, с
+    std::vector<uint8_t> flags; // ClientFlag
+    std::vector<ClientSession> sessions;
+    std::vector<ClientCold> cold;
+    FlatMap<uint32_t> ids;
+    TimerWheel liveness{LIVENESS_TICK_MS, steady_ms()};
+    // Растет при изменении состава, профилей, активности или multicast-флага клиентов
+    // (но не last_seen); снимок с устаревшей версией пересобирается.
+    uint64_t version = 0;
+    std::shared_ptr<const ShardSnapshot> snapshot;
+
+    uint32_t size() const { return static_cast<uint32_t>(keys.size()); }
+
+    void add(uint64_t key, uint32_t seen, uint8_t client_flags, const ClientSession &session, const ClientCold &info) {
+        keys.push_back(key);
+        last_seen.push_back(seen);
+        flags.push_back(client_flags);
+        sessions.push_back(session);
+        cold.push_back(info);
+    }
+
+    bool active(uint32_t index) const { return flags[index] & CLIENT_ACTIVE; }
+    std::string_view name(uint32_t index) const { return ProfileStore::name(cold[index].name); }
+    sockaddr_in addr(uint32_t index) const { return unpack_addr(keys[index]); }
+};
+
+// Поля клиента в снимке реестра или списке управляющего сокета.
+struct ClientView {
+    std::string_view name;
+    const HardwareProfile *hardware;
+    sockaddr_in addr;
+    time_t last_seen;
+    int64_t inactive_since_ms;
+    bool active;
+    bool multicast;
+    uint8_t protocol;
+};
+
+// Неизменяемый снимок шарда: копии его массивов, кроме сессий; индекс i - клиент i шарда.
+// Строки профилей не копируются: ProfileStore их не перемещает и не освобождает.
+struct ShardSnapshot {
+    uint64_t version;
+    std::vector<uint64_t> keys;
+    std::vector<uint32_t> last_seen;
+    std::vector<uint8_t> flags;
+    std::vector<ClientCold> cold;
+};
+
+// Registry - ClientShard (под его мьютексом) или ShardSnapshot.
+template<typename Registry>
+ClientView view_of(const Registry &registry, uint32_t index) {
+    const ClientCold &cold = registry.cold[index];
+    uint8_t flags = registry.flags[index];
+    return {ProfileStore::name(cold.name), cold.hardware, unpack_addr(registry.keys[index]), registry.last_seen[index],
+            cold.inactive_since_ms, (flags & CLIENT_ACTIVE) != 0, (flags & CLIENT_MULTICAST) != 0, protocol_of(flags)};
+}
+
+// Глобальный id клиента: номер шарда в старших битах, индекс внутри шарда - в младших.
+constexpr uint32_t SHARD_SHIFT = 24;
+constexpr uint32_t SHARD_INDEX_MASK = (1u << SHARD_SHIFT) - 1;
+
+std::vector<std::unique_ptr<ClientShard> > shards;
+std::atomic<size_t> registered_clients = 0;
+// Сокеты на config.port с SO_REUSEPORT, по одному на поток приема; рассылки идут через первый.
+std::vector<int> server_sockets;
+std::atomic<bool> server_running = true;
+// eventfd реактора (-1 в многопоточном режиме): будит цикл событий из обработчика сигнала.
+int reactor_wakeup_fd = -1;
+// Файл реестра для теплого перезапуска (--registry); не открыт - реестр только в памяти.
+RegistryFile registry_file;
+// Журнал раундов и матчей для офлайн-анализа (journal_query).
+ResultsJournal journal;
+
+static_assert(sizeof(PersistedClient::name) == wire::NAME_LEN,
+              "имя клиента любого протокола должно возвращаться из файла реестра целиком");
+
+// Сквозная запись клиента в файл реестра. Пишутся только изменения состояния (REGISTER,
+// смена активности, multicast), а не каждый PING. Вызывается под мьютексом шарда клиента.
+void persist_client(const ClientShard &shard, uint32_t index) {
+    const ClientCold &cold = shard.cold[index];
+    if (cold.record == RegistryFile::NONE) return;
+    PersistedClient record{};
+    record.key = shard.keys[index];
+    record.last_seen = shard.last_seen[index];
+    record.inactive_since_ms = cold.inactive_since_ms;
+    record.protocol = protocol_of(shard.flags[index]);
+    record.active = (shard.flags[index] & CLIENT_ACTIVE) != 0;
+    record.multicast = (shard.flags[index] & CLIENT_MULTICAST) != 0;
+    RegistryFile::set_text(record.name, sizeof(record.name), ProfileStore::name(cold.name));
+    RegistryFile::set_text(record.hardware, sizeof(record.hardware), cold.hardware->text);
+    registry_file.write(cold.record, record);
+}
+
+uint32_t make_client_id(uint32_t shard, uint32_t index) { return shard << SHARD_SHIFT | index; }
+
+ClientShard &shard_of(uint32_t id) { return *shards[id >> SHARD_SHIFT]; }
+
+// Вызывающий держит мьютекс шарда клиента.
+ClientSession &session_at(uint32_t id) { return shard_of(id).sessions[id & SHARD_INDEX_MASK]; }
+
+// Шард клиента зависит только от его адреса, а не от сокета, на который ядро доставило датаграмму.
+uint32_t shard_index(uint64_t key) {
+    return static_cast<uint32_t>(((key * 0x9E3779B97F4A7C15ULL) >> 32) % shards.size());
+}
+
+// Снимок реестра в духе RCU для читателей - рассылок, админских списков, сбора лобби и
+// логов матчей. Под мьютексом шарда только копируются плотные массивы (строки профилей
+// не копируются), а обход, форматирование и системные вызовы идут уже без блокировок,
+// не задерживая PING. Неизменившийся шард отдает кэшированный снимок вообще без
+// копирования; fresh = true пересобирает снимки, чтобы увидеть актуальные last_seen.
+// Старые снимки освобождаются, когда их отпустит последний читатель.
+class RegistrySnapshot {
+public:
+    static RegistrySnapshot take(bool fresh = false) {
+        RegistrySnapshot view;
+        view.shards_.reserve(shards.size());
+        for (auto &shard_ptr: shards) {
+            ClientShard &shard = *shard_ptr;
+            std::lock_guard<std::mutex> lock(shard.mutex);
+            if (fresh || !shard.snapshot || shard.snapshot->version != shard.version) {
+                shard.snapshot = std::make_shared<const ShardSnapshot>(ShardSnapshot{
+                    shard.version, shard.keys, shard.last_seen, shard.flags, shard.cold
+                });
+            }
+            view.shards_.push_back(shard.snapshot);
+        }
+        return view;
+    }
+
+    // Клиент по глобальному id; nullopt, если он зарегистрировался позже снимка.
+    std::optional<ClientView> find(uint32_t id) const {
+        const ShardSnapshot &shard = *shards_[id >> SHARD_SHIFT];
+        uint32_t index = id & SHARD_INDEX_MASK;
+        if (index >= shard.keys.size()) return std::nullopt;
+        return view_of(shard, index);
+    }
+
+    // visit(id, client) для всех клиентов; возвращает их число.
+    template<typename F>
+    size_t for_each(F &&visit) const {
+        size_t count = 0;
+        for (uint32_t shard = 0; shard < shards_.size(); ++shard) {
+            const ShardSnapshot &snapshot = *shards_[shard];
+            uint32_t size = static_cast<uint32_t>(snapshot.keys.size());
+            for (uint32_t index = 0; index < size; ++index) visit(make_client_id(shard, index), view_of(snapshot, index));
+            count += size;
+        }
+        return count;
+    }
+
+    const HardwareProfile *hardware(uint32_t id) const {
+        return shards_[id >> SHARD_SHIFT]->cold[id & SHARD_INDEX_MASK].hardware;
+    }
+
+    // visit(id, key, flags) только по горячим массивам - для рассылок и сбора лобби.
+    template<typename F>
+    void for_each_hot(F &&visit) const {
+        for (uint32_t shard = 0; shard < shards_.size(); ++shard) {
+            const ShardSnapshot &snapshot = *shards_[shard];
+            for (uint32_t index = 0; index < snapshot.keys.size(); ++index) {
+                visit(make_client_id(shard, index), snapshot.keys[index], snapshot.flags[index]);
+            }
+        }
+    }
+
+private:
+    std::vector<std::shared_ptr<const ShardSnapshot> > shards_;
+};
+
+enum class Engine { THREADS, REACTOR };
+
+struct ServerConfig {
+    Engine engine = Engine::THREADS;
+    unsigned recv_batch = RECV_BATCH;
+    unsigned recv_threads = 1;
+    bool pin_cpus = false;
+    size_t match_size = 0;
+    unsigned match_workers = std::max(1u, std::thread::hardware_concurrency());
+    bool multicast = false;
+    sockaddr_in multicast_group{};
+    in_addr multicast_if{htonl(INADDR_ANY)};
+    LogLevel log_level = LogLevel::INFO;
+    uint16_t metrics_port = 0; // 0 - без точки сбора метрик
+    std::string registry_path; // пусто - без файла реестра
+    uint32_t registry_capacity = 1u << 20;
+    uint32_t heartbeat_budget = HEARTBEAT_BUDGET; // PING в секунду, на которые рассчитан интервал
+    std::string control_path; // пусто - без управляющего сокета
+    std::string journal_dir; // пусто - без журнала результатов
+    uint64_t journal_segment = 1u << 20; // записей в сегменте журнала
+    uint16_t port = PORT;
+    unsigned relay_fanout = 0; // детей у ретранслятора; 0 - рассылки без дерева ретрансляции
+    // Кластер: UDP-адреса всех узлов по порядку, номер этого узла и адрес координатора (TCP).
+    // Пустой список - одиночный сервер.
+    std::vector<sockaddr_in> cluster_nodes;
+    unsigned cluster_index = 0;
+    sockaddr_in coordinator{};
+    uint16_t coordinate_port = 0; // TCP-порт координатора, если он работает в этом процессе; 0 - нет
+
+    bool clustered() const { return !cluster_nodes.empty(); }
+};
+
+ServerConfig config;
+
+// Интервал PING клиентов v2 по нагрузке: весь реестр укладывается в config.heartbeat_budget
+// PING в секунду, но не чаще PING_INTERVAL_MS и не реже HEARTBEAT_MAX_MS.
+uint32_t heartbeat_interval_ms() {
+    uint64_t interval = registered_clients.load(std::memory_order_relaxed) * 1000 / config.heartbeat_budget;
+    return static_cast<uint32_t>(std::clamp<uint64_t>(interval, PING_INTERVAL_MS, HEARTBEAT_MAX_MS));
+}
+
+std::string pong_frame(uint32_t heartbeat, uint8_t flags);
+
+// Кольцо заранее выделенных буферов и адресов для recvmmsg: за один системный вызов
+// забираем до recv_batch датаграмм, между пакетами память не выделяется.
+struct RecvRing {
+    std::vector<char> storage;
+    std::vector<sockaddr_in> addrs;
+    std::vector<iovec> iovs;
+    std::vector<mmsghdr> msgs;
+
+    explicit RecvRing(unsigned batch)
+        : storage(static_cast<size_t>(batch) * MAX_DATAGRAM), addrs(batch), iovs(batch), msgs(batch) {
+        for (unsigned i = 0; i < batch; ++i) {
+            iovs[i].iov_base = storage.data() + static_cast<size_t>(i) * MAX_DATAGRAM;
+            iovs[i].iov_len = MAX_DATAGRAM;
+            memset(&msgs[i], 0, sizeof(mmsghdr));
+            msgs[i].msg_hdr.msg_iov = &iovs[i];
+            msgs[i].msg_hdr.msg_iovlen = 1;
+            msgs[i].msg_hdr.msg_name = &addrs[i];
+        }
+    }
+
+    int receive(int fd, int flags = MSG_WAITFORONE) {
+        for (auto &m: msgs) {
+            m.msg_hdr.msg_namelen = sizeof(sockaddr_in);
+            m.msg_len = 0;
+        }
+        return recvmmsg(fd, msgs.data(), static_cast<unsigned>(msgs.size()), flags, nullptr);
+    }
+
+    std::string_view data(int i) const {
+        return {static_cast<const char *>(iovs[i].iov_base), msgs[i].msg_len};
+    }
+};
+
+void handle_signal(int sig) {
+    std::cout << "\n[Server] Получен сигнал " << sig << ", инициируем завершение работы сервера..." << std::endl;
+    server_running = false;
+    for (int fd: server_sockets) shutdown(fd, SHUT_RDWR);
+    if (reactor_wakeup_fd >= 0) {
+        uint64_t one = 1;
+        [[maybe_unused]] ssize_t written = write(reactor_wakeup_fd, &one, sizeof(one));
+    }
+}
+
+void expire_participant(Match *match, uint32_t slot);
+size_t send_batch(const std::vector<sockaddr_in> &destinations, const std::string &message);
+
+// Прокрутка колес таймеров неактивности всех шардов до текущего момента. Замолчавшему
+// клиенту v2 сначала уходят запросы PING (PONG с PONG_REPLY_NOW), неактивным он становится,
+// только если не ответил ни на один.
+void sweep_liveness() {
+    thread_local std::vector<sockaddr_in> probes;
+    probes.clear();
+    uint32_t heartbeat = heartbeat_interval_ms();
+    for (auto &shard_ptr: shards) {
+        ClientShard &shard = *shard_ptr;
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        uint64_t now = steady_ms();
+        int64_t wall_now = wall_ms();
+        shard.liveness.advance(now, [&](uint32_t index, uint64_t deadline_ms) {
+            ClientSession &session = shard.sessions[index];
+            if (shard.flags[index] & CLIENT_V2 && session.probes < PROBE_ATTEMPTS) {
+                session.probes++;
+                session.heartbeat_ms = heartbeat;
+                // Без границы RTT: она уже вошла в дедлайн тишины, а ответ на любой из запросов
+                // засчитывается, так что последний запрос истекает не позже TIMEOUT.
+                shard.liveness.schedule(index, now + PROBE_WAIT_MS / PROBE_ATTEMPTS);
+                probes.push_back(shard.addr(index));
+                return;
+            }
+            session.probes = 0;
+            shard.flags[index] &= ~CLIENT_ACTIVE;
+            shard.cold[index].inactive_since_ms = wall_now - static_cast<int64_t>(now - deadline_ms);
+            shard.version++;
+            persist_client(shard, index);
+            logger.info(LOG_CLIENTS, "[Update Thread] Клиент {} ({}) стал НЕАКТИВНЫМ (таймаут).", shard.name(index),
+                        shard.addr(index));
+
+            // Участник, выбывший до своего ответа, больше не ожидается в текущем раунде.
+            if (session.match) expire_participant(session.match, session.match_slot);
+        });
+    }
+    if (!probes.empty()) {
+        metrics.add(M_LIVENESS_PROBES, probes.size());
+        send_batch(probes, pong_frame(heartbeat, wire::PONG_REPLY_NOW));
+    }
+}
+
+void update_clients() {
+    logger.info(LOG_SERVER, "[Update Thread] Поток проверки активности запущен (шаг колеса таймеров {} мс).",
+                LIVENESS_TICK_MS);
+    while (server_running) {
+        usleep(LIVENESS_TICK_MS * 1000);
+        if (!server_running) break;
+        sweep_liveness();
+    }
+    // std::cout << "[Update Thread] Поток проверки активности завершен." << std::endl;
+}
+
+GameChoice string_to_choice(std::string_view s) {
+    if (s == "ROCK") return ROCK;
+    if (s == "PAPER") return PAPER;
+    if (s == "SCISSORS") return SCISSORS;
+    return INVALID;
+}
+
+// Номер последовательности исходящих кадров v2.
+std::atomic<uint32_t> wire_seq = 0;
+
+Notice make_notice(wire::ResultKind kind, std::string text, uint32_t match = 0, uint32_t value = 0,
+                   std::string_view name = {}) {
+    wire::ResultBody body{};
+    body.kind = kind;
+    body.match = htonl(match);
+    body.value = htonl(value);
+    wire::set_name(body.name, name);
+    return {std::move(text), wire::frame(wire::OP_RESULT, 0, wire_seq++, body)};
+}
+
+// Рассылка одного сообщения по списку адресов пакетами sendmmsg: все заголовки
+// ссылаются на один iovec с телом сообщения. Возвращает число отправленных датаграмм.
+size_t send_batch(const std::vector<sockaddr_in> &destinations, const std::string &message) {
+    thread_local std::vector<mmsghdr> msgs(SEND_BATCH);
+    iovec iov{const_cast<char *>(message.data()), message.size()};
+    size_t sent_count = 0;
+    size_t next = 0;
+    while (next < destinations.size()) {
+        unsigned chunk = static_cast<unsigned>(std::min<size_t>(SEND_BATCH, destinations.size() - next));
+        for (unsigned i = 0; i < chunk; ++i) {
+            msghdr &hdr = msgs[i].msg_hdr;
+            memset(&hdr, 0, sizeof(hdr));
+            hdr.msg_name = const_cast<sockaddr_in *>(&destinations[next + i]);
+            hdr.msg_namelen = sizeof(sockaddr_in);
+            hdr.msg_iov = &iov;
+            hdr.msg_iovlen = 1;
+        }
+        int sent = sendmmsg(server_sockets.front(), msgs.data(), chunk, 0);
+        if (sent < 0) {
+            if (errno == EINTR) continue;
+            logger.error(LOG_PACKETS, "[Send Batch] Ошибка отправки клиенту {} (errno: {})", destinations[next], errno);
+            metrics.add(M_SEND_ERRORS);
+            next++;
+            continue;
+        }
+        sent_count += sent;
+        next += sent;
+    }
+    metrics.add(M_SENT, sent_count);
+    metrics.add(M_SENT_BYTES, sent_count * message.size());
+    return sent_count;
+}
+
+// Рассылка по дереву ретрансляторов (--relay-fanout K). Сервер отправляет кадр OP_RELAY только
+// корням леса - по одному кадру на RELAY_MAX_MEMBERS получателей, - остальные получают его от
+// клиентов-ретрансляторов. Внутренние узлы дерева - начало массива получателей, поэтому туда
+// ставятся клиенты с наибольшими CPU и RAM из REGISTER; слабые остаются листьями.
+// Корни, не подтвердившие кадр за RELAY_ACK_TIMEOUT_US, обходит поток ретрансляции (их дети
+// получают кадр напрямую), а сами они до RELAY_SUSPECT_MS получают рассылки без дерева:
+// за это время проверка активности либо исключит их, либо они продолжат слать PING.
+// Ключ меток ретранслятора выводится из случайного секрета запуска и адреса клиента, так что
+// ключи не хранятся в реестре, а повторный REGISTER получает тот же ключ.
+class RelayFanout {
+public:
+    RelayFanout() {
+        std::random_device random;
+        secret_.k0 = uint64_t{random()} << 32 | random();
+        secret_.k1 = uint64_t{random()} << 32 | random();
+    }
+
+    // Ключ клиента с адресом key (pack_addr) для REGISTERED и меток рассылок.
+    RelayKey key_of(uint64_t key) const {
+        uint8_t bytes[9];
+        memcpy(bytes, &key, sizeof(key));
+        bytes[8] = 0;
+        RelayKey out;
+        out.k0 = SipHash(secret_).update(bytes, sizeof(bytes)).final();
+        bytes[8] = 1;
+        out.k1 = SipHash(secret_).update(bytes, sizeof(bytes)).final();
+        return out;
+    }
+
+    // Рассылка кадра payload получателям members (вес, адрес). В direct добавляются те, кому
+    // вызывающий отправит кадр сам: подозреваемые и все, если получателей не больше K.
+    // Возвращает число корней леса.
+    size_t broadcast(const std::string &payload, std::vector<std::pair<uint64_t, wire::RelayMember> > &members,
+                     std::vector<sockaddr_in> &direct) {
+        auto shared = std::make_shared<const std::string>(payload);
+        thread_local std::vector<wire::RelayMember> order;
+        size_t roots = 0;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (!suspects_.empty()) filter_suspects(members, direct);
+            if (members.size() <= config.relay_fanout) {
+                for (const auto &member: members) direct.push_back(relay_addr(member.second));
+                return 0;
+            }
+            roots = relay_roots(members.size(), config.relay_fanout);
+            // Узлы с детьми - первые (n - roots) / k (с округлением вверх) элементов кучи.
+            size_t inner = (members.size() - roots + config.relay_fanout - 1) / config.relay_fanout;
+            std::nth_element(members.begin(), members.begin() + inner, members.end(), [](const auto &a, const auto &b) {
+                return a.first > b.first;
+            });
+            order.clear();
+            for (const auto &member: members) order.push_back(member.second);
+            uint32_t id = next_id_++;
+            relay_sign(id, config.relay_fanout, payload, order.data(), order.size(), roots,
+                       [this](const wire::RelayMember &member) { return key_of(pack_addr(relay_addr(member))); });
+            node_.forward(id, shared, config.relay_fanout, order.data(), order.size(), roots, steady_us(), send_frame);
+        }
+        wake_.notify_one();
+        return roots;
+    }
+
+    void ack(uint32_t id, const sockaddr_in &from) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        node_.ack(id, relay_member(from));
+    }
+
+    void run() {
+        std::unique_lock<std::mutex> lock(mutex_);
+        std::vector<wire::RelayMember> dead;
+        while (server_running) {
+            uint64_t now = steady_us();
+            uint64_t next = std::min(node_.next_deadline_us(), now + 100000);
+            if (next > now) wake_.wait_for(lock, std::chrono::microseconds(next - now));
+            dead.clear();
+            size_t expired = node_.expire(steady_us(), send_frame, &dead);
+            if (!expired) continue;
+            metrics.add(M_RELAY_FALLBACKS, expired);
+            uint64_t until = steady_ms() + RELAY_SUSPECT_MS;
+            for (const auto &member: dead) suspects_[pack_addr(relay_addr(member))] = until;
+            logger.warn(LOG_PACKETS, "[Relay] Ретрансляторы без подтверждения: {}, первый {}; рассылка идет их детям.",
+                        expired, relay_addr(dead.front()));
+        }
+    }
+
+    void wake() { wake_.notify_all(); }
+
+private:
+    static void send_frame(const wire::RelayMember &to, const std::string &frame) {
+        sockaddr_in addr = relay_addr(to);
+        if (sendto(server_sockets.front(), frame.data(), frame.size(), 0, (sockaddr *) &addr, sizeof(addr)) < 0) {
+            metrics.add(M_SEND_ERRORS);
+            return;
+        }
+        metrics.add(M_SENT);
+        metrics.add(M_SENT_BYTES, frame.size());
+        metrics.add(M_RELAY_FRAMES);
+    }
+
+    // Под mutex_. Истекшие записи удаляются по ходу.
+    void filter_suspects(std::vector<std::pair<uint64_t, wire::RelayMember> > &members,
+                         std::vector<sockaddr_in> &direct) {
+        uint64_t now = steady_ms();
+        size_t kept = 0;
+        for (auto &member: members) {
+            sockaddr_in addr = relay_addr(member.second);
+            uint64_t key = pack_addr(addr);
+            uint64_t *until = suspects_.find(key);
+            if (until && *until <= now) {
+                suspects_.erase(key);
+                until = nullptr;
+            }
+            if (until) direct.push_back(addr);
+            else members[kept++] = member;
+        }
+        members.resize(kept);
+    }
+
+    RelayKey secret_;
+    std::mutex mutex_;
+    std::condition_variable wake_;
+    RelayNode node_;
+    uint32_t next_id_ = 1;
+    FlatMap<uint64_t> suspects_; // pack_addr -> steady_ms, до которого рассылка идет напрямую
+};
+
+RelayFanout relay_fanout;
+
+// Вес клиента при выборе ретрансляторов: сначала число ядер, потом память.
+uint64_t relay_weight(const HardwareProfile *hardware) {
+    return hardware ? uint64_t{hardware->cpus} << 32 | hardware->ram_mb : 0;
+}
+
+// Адреса берутся из снимка реестра, так что REGISTER и PING не ждут ни сбора адресов,
+// ни самой рассылки.
+// В режиме multicast сообщение уходит одной датаграммой в группу, а по unicast -
+// только тем активным клиентам, которые не подтвердили вступление в группу.
+void send_to_all_active(const Notice &notice) {
+    auto started = std::chrono::steady_clock::now();
+    logger.info(LOG_GAME, "[Send All Active] Отправка сообщения всем активным: \"{}\"", notice.text);
+    if (config.multicast) {
+        if (sendto(server_sockets.front(), notice.text.c_str(), notice.text.size(), 0,
+                   (sockaddr *) &config.multicast_group, sizeof(config.multicast_group)) < 0) {
+            logger.error(LOG_GAME, "[Send All Active] Ошибка отправки в multicast-группу (errno: {})", errno);
+        }
+    }
+    thread_local std::vector<sockaddr_in> text_destinations, wire_destinations;
+    thread_local std::vector<std::pair<uint64_t, wire::RelayMember> > relay_members;
+    text_destinations.clear();
+    wire_destinations.clear();
+    relay_members.clear();
+    RegistrySnapshot snapshot = RegistrySnapshot::take();
+    snapshot.for_each_hot([&snapshot](uint32_t id, uint64_t key, uint8_t flags) {
+        if (!(flags & CLIENT_ACTIVE) || (config.multicast && flags & CLIENT_MULTICAST)) return;
+        if (config.relay_fanout && flags & CLIENT_RELAY) {
+            relay_members.emplace_back(relay_weight(snapshot.hardware(id)), relay_member(unpack_addr(key)));
+            return;
+        }
+        (flags & CLIENT_V2 ? wire_destinations : text_destinations).push_back(unpack_addr(key));
+    });
+    if (!relay_members.empty()) relay_fanout.broadcast(notice.frame, relay_members, wire_destinations);
+    [[maybe_unused]] size_t sent_count = send_batch(text_destinations, notice.text) +
+                                         send_batch(wire_destinations, notice.frame);
+    metrics.record(H_BROADCAST_NS, elapsed_ns(started));
+    // std::cout << "[Send All Active] Сообщение отправлено " << sent_count << " активным клиентам." << std::endl;
+}
+
+void send_to_participants(const Notice &notice, const std::vector<uint32_t> &participants) {
+    // std::cout << "[Send Participants] Отправка сообщения активным участникам раунда: \"" << message << "\"" << std::endl;
+    thread_local std::vector<sockaddr_in> text_destinations, wire_destinations;
+    text_destinations.clear();
+    wire_destinations.clear();
+    RegistrySnapshot snapshot = RegistrySnapshot::take();
+    for (uint32_t id: participants) {
+        std::optional<ClientView> client = snapshot.find(id);
+        if (!client || !client->active) continue;
+        (client->protocol == wire::VERSION ? wire_destinations : text_destinations).push_back(client->addr);
+    }
+    [[maybe_unused]] size_t sent_count = send_batch(text_destinations, notice.text) +
+                                         send_batch(wire_destinations, notice.frame);
+    // std::cout << "[Send Participants] Сообщение отправлено " << sent_count << " активным участникам раунда." << std::endl;
+}
+
+void cluster_send(const std::string &line);
+
+// Окружение матчей сервера: реальные часы, UDP-сокеты, реестр, журнал результатов и метрики.
+class ServerMatchHost final : public MatchHost {
+public:
+    ServerMatchHost() {
+        log = &logger;
+        log_category = LOG_GAME;
+    }
+
+    SteadyTime now() const override { return std::chrono::steady_clock::now(); }
+    uint32_t unix_seconds() const override { return ::unix_seconds(); }
+    bool running() const override { return server_running; }
+    uint32_t next_round_id() override { return round_ids_++; }
+
+    void send_choose(uint32_t round, const std::vector<sockaddr_in> &text,
+                     const std::vector<sockaddr_in> &wire) override {
+        send_batch(text, "CHOOSE");
+        send_batch(wire, wire::frame(wire::OP_CHOOSE, round, wire_seq++));
+    }
+
+    Notice notice(wire::ResultKind kind, std::string text, uint32_t match, uint32_t value,
+                  std::string_view name) override {
+        return make_notice(kind, std::move(text), match, value, name);
+    }
+
+    void broadcast(const Notice &notice, const std::vector<uint32_t> *members) override {
+        if (members) {
+            send_to_participants(notice, *members);
+        } else {
+            send_to_all_active(notice);
+        }
+    }
+
+    // Только шард участника и под его мьютексом: строки ProfileStore не перемещаются, а
+    // клиенты не удаляются, так что снимок всего реестра ради одного имени не нужен.
+    std::string client_name(uint32_t id) const override {
+        ClientShard &shard = shard_of(id);
+        uint32_t index = id & SHARD_INDEX_MASK;
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        return index < shard.size() ? std::string(shard.name(index)) : std::string();
+    }
+
+    bool journaling() const override { return ::journal.is_open(); }
+    void journal(const JournalRecord *records, size_t count) override { ::journal.append(records, count); }
+    void cluster_send(const std::string &line) override { ::cluster_send(line); }
+
+    void record(MatchStat stat, uint64_t value) override {
+        switch (stat) {
+            case STAT_CHOICE_RTT_NS: metrics.record(H_CHOICE_RTT_NS, value);
+                break;
+            case STAT_CHOOSE_RETRANSMITS: metrics.add(M_CHOOSE_RETRANSMITS, value);
+                break;
+            case STAT_ROUND_DEADLINE_NS: metrics.record(H_ROUND_DEADLINE_NS, value);
+                break;
+            case STAT_ROUNDS: metrics.add(M_ROUNDS, value);
+                break;
+            case STAT_DETERMINE_NS: metrics.record(H_DETERMINE_NS, value);
+                break;
+            case STAT_ROUND_NS: metrics.record(H_ROUND_NS, value);
+                break;
+        }
+    }
+
+private:
+    // Идентификатор раунда, уникальный среди всех матчей и турниров процесса: по нему кадры v2
+    // с выбором сопоставляются с раундом, а запоздавшие отбрасываются.
+    std::atomic<uint32_t> round_ids_{1};
+};
+
+ServerMatchHost match_host;
+
+// Пул потоков, продвигающих матчи турнира. Матч попадает в очередь готовых либо по своему
+// таймеру (дедлайн раунда, пауза), либо досрочно через wake(), когда пришел последний выбор.
+class MatchScheduler {
+public:
+    // Выполнить все матчи на workers потоках; возвращает управление, когда все матчи завершены.
+    void run(std::vector<std::unique_ptr<Match> > &matches, unsigned workers) {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            ready_.clear();
+            timers_ = {};
+            for (auto &match: matches) {
+                match->queued = true;
+                ready_.push_back(match.get());
+            }
+            unfinished_ = matches.size();
+            running_ = true;
+        }
+        std::vector<std::thread> pool;
+        for (unsigned i = 0; i < workers; ++i) pool.emplace_back(&MatchScheduler::worker, this);
+        for (auto &thread: pool) thread.join();
+        std::lock_guard<std::mutex> lock(mutex_);
+        running_ = false;
+        ready_.clear();
+        timers_ = {};
+    }
+
+    void wake(Match *match) {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (!running_ || match->queued || match->retired) return;
+            match->queued = true;
+            ready_.push_back(match);
+        }
+        cv_.notify_one();
+    }
+
+    // Разбудить потоки при остановке сервера.
+    void stop() { cv_.notify_all(); }
+
+private:
+    using Timer = std::pair<SteadyTime, Match *>;
+
+    void worker() {
+        std::unique_lock<std::mutex> lock(mutex_);
+        while (unfinished_ > 0) {
+            if (!ready_.empty()) {
+                Match *match = ready_.front();
+                ready_.pop_front();
+                match->queued = false;
+                lock.unlock();
+                std::optional<SteadyTime> next = match->step(std::chrono::steady_clock::now());
+                lock.lock();
+                if (!next) {
+                    if (!match->retired) {
+                        match->retired = true;
+                        if (--unfinished_ == 0) cv_.notify_all();
+                    }
+                } else if (*next != match->timer_at) {
+                    match->timer_at = *next;
+                    timers_.push({*next, match});
+                    cv_.notify_one();
+                }
+                continue;
+            }
+            auto now = std::chrono::steady_clock::now();
+            if (!server_running) {
+                // Матчи сами завершаются на ближайшем шаге после остановки сервера.
+                while (!timers_.empty()) {
+                    wake_locked(timers_.top().second);
+                    timers_.pop();
+                }
+                if (ready_.empty()) cv_.wait_for(lock, std::chrono::milliseconds(100));
+                continue;
+            }
+            if (!timers_.empty() && timers_.top().first <= now) {
+                auto [at, match] = timers_.top();
+                timers_.pop();
+                // Устаревшие записи (матч уже перепланирован) пропускаем.
+                if (at == match->timer_at) wake_locked(match);
+                continue;
+            }
+            if (timers_.empty()) {
+                cv_.wait(lock);
+            } else {
+                cv_.wait_until(lock, timers_.top().first);
+            }
+        }
+    }
+
+    void wake_locked(Match *match) {
+        if (match->queued || match->retired) return;
+        match->queued = true;
+        ready_.push_back(match);
+    }
+
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    std::deque<Match *> ready_;
+    std::priority_queue<Timer, std::vector<Timer>, std::greater<> > timers_;
+    size_t unfinished_ = 0;
+    bool running_ = false;
+};
+
+MatchScheduler scheduler;
+
+// Поток турнира многопоточного режима. Он не отсоединяется: при остановке main дожидается
+// его (join), прежде чем закрыть сокеты, файл реестра, журнал и логгер, которыми пользуется
+// завершающийся турнир.
+class GameThread {
+public:
+    // false, если поток предыдущего турнира еще работает. wait = true - дождаться его: узел
+    // кластера начинает турнир, когда предыдущий матч уже завершен и поток вот-вот выйдет.
+    bool start(std::function<void()> body, bool wait = false) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (busy_ && !wait) return false;
+        if (thread_.joinable()) thread_.join();
+        busy_ = true;
+        thread_ = std::thread([this, body = std::move(body)] {
+            body();
+            busy_ = false;
+        });
+        return true;
+    }
+
+    void join() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (thread_.joinable()) thread_.join();
+    }
+
+private:
+    std::mutex mutex_;
+    std::thread thread_;
+    std::atomic<bool> busy_ = false;
+};
+
+GameThread game_thread;
+
+class Reactor;
+void reactor_wake(Match *match);
+
+// Матчи продвигает либо пул MatchScheduler, либо цикл событий реактора.
+void wake_match(Match *match) {
+    if (config.engine == Engine::REACTOR) {
+        reactor_wake(match);
+    } else {
+        scheduler.wake(match);
+    }
+}
+
+void expire_participant(Match *match, uint32_t slot) {
+    if (match->participant_lost(slot)) wake_match(match);
+}
+
+void print_admin_menu() {
+    std::cout <<
+            "\n[Admin] Команды: \n 1:Железо \n 2:Имена(все) \n 3:Игра \n 4:Откл(активных) \n 5:Статус(все) \n 6:Активные \n 7:Выход \n 8:Метрики > "
+            << std::flush;
+}
+
+std::unique_ptr<Match> make_match(uint32_t number, bool whole_lobby, std::vector<uint32_t> ids,
+                                  const RegistrySnapshot &snapshot) {
+    auto match = std::make_unique<Match>();
+    match->host = &match_host;
+    match->number = number;
+    match->whole_lobby = whole_lobby;
+    std::vector<sockaddr_in> addrs;
+    std::vector<uint8_t> protocols;
+    addrs.reserve(ids.size());
+    protocols.reserve(ids.size());
+    for (uint32_t id: ids) {
+        std::optional<ClientView> client = snapshot.find(id);
+        addrs.push_back(client->addr);
+        protocols.push_back(client->protocol);
+    }
+    match->assign(std::move(ids), std::move(addrs), std::move(protocols));
+    // Выборы начинают доходить до матча только после того, как его слоты готовы.
+    for (uint32_t slot = 0; slot < match->members.size(); ++slot) {
+        std::lock_guard<std::mutex> lock(shard_of(match->members[slot]).mutex);
+        ClientSession &session = session_at(match->members[slot]);
+        session.match = match.get();
+        session.match_slot = slot;
+        match->response_bound_us[slot] = session.response.bound_us();
+    }
+    return match;
+}
+
+std::vector<uint32_t> active_lobby(const RegistrySnapshot &snapshot) {
+    std::vector<uint32_t> lobby;
+    snapshot.for_each_hot([&](uint32_t id, uint64_t, uint8_t flags) {
+        if (flags & CLIENT_ACTIVE) lobby.push_back(id);
+    });
+    return lobby;
+}
+
+// Турнир: активные клиенты делятся на независимые матчи по config.match_size участников
+// (0 - один матч со всеми). Возвращает пустой список, если игру начать нельзя.
+std::vector<std::unique_ptr<Match> > prepare_tournament() {
+    std::vector<std::unique_ptr<Match> > matches;
+    if (!server_running) return matches;
+    logger.info(LOG_GAME, "[Game Manager] Попытка начать игру...");
+
+    if (game_running.exchange(true)) {
+        logger.info(LOG_GAME, "[Game Manager] Игра уже активна.");
+        return matches;
+    }
+
+    RegistrySnapshot snapshot = RegistrySnapshot::take();
+    std::vector<uint32_t> lobby = active_lobby(snapshot);
+
+    if (lobby.size() < 2) {
+        logger.info(LOG_GAME, "[Game Manager] Для игры нужно минимум 2 активных участника! Сейчас: {}", lobby.size());
+        game_running = false;
+        return matches;
+    }
+
+    logger.info(LOG_GAME, "[Game Manager] Игра начинается! Активных участников: {}", lobby.size());
+    send_to_all_active(make_notice(wire::RESULT_GAME_START, "ИГРА НАЧИНАЕТСЯ! Участников: " +
+                                                            std::to_string(lobby.size()), 0,
+                                   static_cast<uint32_t>(lobby.size())));
+
+    size_t match_size = config.match_size >= 2 && config.match_size < lobby.size() ? config.match_size : lobby.size();
+    if (match_size < lobby.size()) {
+        std::shuffle(lobby.begin(), lobby.end(), std::mt19937(std::random_device{}()));
+    }
+    for (size_t begin = 0; begin < lobby.size(); begin += match_size) {
+        size_t end = std::min(lobby.size(), begin + match_size);
+        // Одиночный остаток доигрывает в последнем матче.
+        if (lobby.size() - end == 1) end = lobby.size();
+        matches.push_back(make_match(static_cast<uint32_t>(matches.size() + 1), match_size == lobby.size(),
+                                     std::vector<uint32_t>(lobby.begin() + begin, lobby.begin() + end), snapshot));
+        if (end == lobby.size()) break;
+    }
+    if (matches.size() > 1) {
+        logger.info(LOG_GAME, "[Game Manager] Матчей: {} по ~{} участников.", matches.size(), match_size);
+    }
+    return matches;
+}
+
+// Матч шарда кластера: все активные клиенты узла, даже если их меньше двух, - раунды ведет
+// координатор по сумме всех шардов. Пустой список, если на узле уже идет игра.
+std::vector<std::unique_ptr<Match> > prepare_cluster_match() {
+    std::vector<std::unique_ptr<Match> > matches;
+    if (!server_running || game_running.exchange(true)) return matches;
+    RegistrySnapshot snapshot = RegistrySnapshot::take();
+    std::vector<uint32_t> lobby = active_lobby(snapshot);
+    logger.info(LOG_GAME, "[Cluster] Турнир кластера, участников на узле: {}", lobby.size());
+    matches.push_back(make_match(0, true, std::move(lobby), snapshot));
+    matches.back()->clustered = true;
+    return matches;
+}
+
+void cluster_match_finished();
+
+// Итоги турнира после завершения всех матчей.
+void finish_tournament(std::vector<std::unique_ptr<Match> > &matches, std::chrono::duration<double> elapsed) {
+    if (config.clustered()) cluster_match_finished();
+    metrics.add(M_TOURNAMENTS);
+    metrics.record(H_TOURNAMENT_NS, std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count());
+    for (auto &match: matches) {
+        for (uint32_t id: match->members) {
+            std::lock_guard<std::mutex> lock(shard_of(id).mutex);
+            session_at(id).match = nullptr;
+        }
+    }
+
+    if (!server_running) {
+        logger.info(LOG_GAME, "[Game Manager] Игра прервана из-за остановки сервера.");
+        send_to_all_active(make_notice(wire::RESULT_ABORTED, "ИГРА ПРЕРВАНА ИЗ-ЗА ОСТАНОВКИ СЕРВЕРА!"));
+    } else if (matches.size() > 1) {
+        size_t total_rounds = 0, winners = 0;
+        for (const auto &match: matches) {
+            total_rounds += match->rounds;
+            winners += match->has_winner ? 1 : 0;
+        }
+        logger.info(LOG_GAME, "[Game Manager] Турнир завершен: матчей {}, с победителем {}, раундов {}, за {} с ({} матчей/с).",
+                    matches.size(), winners, total_rounds, elapsed.count(),
+                    matches.size() / std::max(elapsed.count(), 1e-9));
+    }
+
+    game_running = false;
+}
+
+// Многопоточный режим: матчи идут параллельно на config.match_workers потоках пула.
+void start_game() {
+    auto matches = prepare_tournament();
+    if (matches.empty()) return;
+    unsigned workers = std::max(1u, std::min<unsigned>(config.match_workers, matches.size()));
+    if (matches.size() > 1) logger.info(LOG_GAME, "[Game Manager] Потоков матчей: {}", workers);
+
+    auto started = std::chrono::steady_clock::now();
+    scheduler.run(matches, workers);
+    finish_tournament(matches, std::chrono::steady_clock::now() - started);
+    logger.info(LOG_GAME, "[Game Manager] Поток игры завершен.");
+    print_admin_menu();
+}
+
+void handle_datagram(int fd, std::string_view msg, const sockaddr_in &client_addr);
 
-enum GameChoice { ROCK, PAPER, SCISSORS, INVALID };
+// Обработка пачки из recvmmsg; размер пачки и время ее обработки попадают в метрики.
+void handle_batch(int fd, RecvRing &ring, int received) {
+    auto started = std::chrono::steady_clock::now();
+    for (int i = 0; i < received; ++i) {
+        if (ring.msgs[i].msg_len > 0) handle_datagram(fd, ring.data(i), ring.addrs[i]);
+    }
+    metrics.add(M_RECV_CALLS);
+    metrics.record(H_RECV_BATCH_SIZE, received);
+    metrics.record(H_RECV_BATCH_NS, elapsed_ns(started));
+}
+
+// Однопоточный движок: один цикл epoll обслуживает серверный сокет, таймер неактивности
+// клиентов (timerfd с шагом LIVENESS_TICK_MS), дедлайны раундов и паузы матчей (timerfd,
+// взведенный на ближайший таймер кучи) и почтовый ящик команд из потока администратора
+// (eventfd). Клиентов и матчи меняет только поток реактора, поэтому очередь готовых матчей
+// и куча таймеров обходятся без блокировок. Мьютексы шардов и матчей при этом остаются под
+// конкуренцией: шарды читают под мьютексом потоки админки и метрик (RegistrySnapshot::take),
+// управляющего сокета (scan_registry для LIST и COUNT), мьютекс матча берет связь с
+// координатором кластера, а мьютекс RelayFanout - поток ретрансляции. Чтения держат мьютекс
+// шарда лишь на копирование, так что реактор ждет их недолго, но и не бесплатно.
+class Reactor {
+public:
+    bool open(int socket_fd) {
+        socket_fd_ = socket_fd;
+        epoll_fd_ = epoll_create1(EPOLL_CLOEXEC);
+        liveness_fd_ = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+        match_timer_fd_ = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+        wakeup_fd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if (epoll_fd_ < 0 || liveness_fd_ < 0 || match_timer_fd_ < 0 || wakeup_fd_ < 0) {
+            perror("[Reactor] Ошибка создания epoll/timerfd/eventfd");
+            return false;
+        }
+        itimerspec tick{};
+        tick.it_interval.tv_nsec = LIVENESS_TICK_MS * 1000000L;
+        tick.it_value = tick.it_interval;
+        timerfd_settime(liveness_fd_, 0, &tick, nullptr);
+        for (int fd: {socket_fd_, liveness_fd_, match_timer_fd_, wakeup_fd_}) {
+            epoll_event ev{};
+            ev.events = EPOLLIN;
+            ev.data.fd = fd;
+            if (epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, fd, &ev) < 0) {
+                perror("[Reactor] Ошибка epoll_ctl");
+                return false;
+            }
+        }
+        reactor_wakeup_fd = wakeup_fd_;
+        return true;
+    }
+
+    void close_fds() {
+        reactor_wakeup_fd = -1;
+        for (int fd: {epoll_fd_, liveness_fd_, match_timer_fd_, wakeup_fd_}) {
+            if (fd >= 0) close(fd);
+        }
+    }
+
+    // Выполнить задачу в потоке реактора (вызывается из других потоков).
+    void post(std::function<void()> task) {
+        {
+            std::lock_guard<std::mutex> lock(mailbox_mutex_);
+            mailbox_.push_back(std::move(task));
+        }
+        uint64_t one = 1;
+        [[maybe_unused]] ssize_t written = write(wakeup_fd_, &one, sizeof(one));
+    }
+
+    // Только из потока реактора.
+    void wake(Match *match) {
+        if (match->queued || match->retired) return;
+        match->queued = true;
+        ready_.push_back(match);
+    }
+
+    void start_tournament() { start_matches(prepare_tournament()); }
+
+    void start_matches(std::vector<std::unique_ptr<Match> > matches) {
+        matches_ = std::move(matches);
+        if (matches_.empty()) return;
+        started_ = std::chrono::steady_clock::now();
+        unfinished_ = matches_.size();
+        for (auto &match: matches_) wake(match.get());
+    }
+
+    void run() {
+        RecvRing ring(config.recv_batch);
+        epoll_event events[8];
+        while (server_running || unfinished_ > 0) {
+            run_ready();
+            int n = epoll_wait(epoll_fd_, events, 8, ready_.empty() ? -1 : 0);
+            if (n < 0) {
+                if (errno == EINTR) continue;
+                logger.error(LOG_SERVER, "[Reactor] Ошибка epoll_wait (errno: {})", errno);
+                break;
+            }
+            for (int i = 0; i < n; ++i) {
+                int fd = events[i].data.fd;
+                if (fd == socket_fd_) {
+                    receive(ring);
+                } else if (fd == liveness_fd_) {
+                    drain(fd);
+                    sweep_liveness();
+                } else if (fd == match_timer_fd_) {
+                    drain(fd);
+                    fire_timers();
+                } else if (fd == wakeup_fd_) {
+                    drain(fd);
+                    run_mailbox();
+                }
+            }
+            if (!server_running) {
+                // Матчи сами завершаются на ближайшем шаге после остановки сервера.
+                while (!timers_.empty()) {
+                    wake(timers_.top().second);
+                    timers_.pop();
+                }
+            }
+        }
+    }
+
+private:
+    using Timer = std::pair<SteadyTime, Match *>;
+
+    static void drain(int fd) {
+        uint64_t value;
+        [[maybe_unused]] ssize_t got = read(fd, &value, sizeof(value));
+    }
+
+    // Уровневый epoll: за одно событие забираем ограниченное число пакетов, остальное - на следующей итерации.
+    void receive(RecvRing &ring) {
+        for (int batch = 0; batch < 4 && server_running; ++batch) {
+            int received = ring.receive(socket_fd_, MSG_DONTWAIT);
+            if (received <= 0) {
+                if (received < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+                    logger.error(LOG_PACKETS, "[Reactor] Ошибка приема recvmmsg (errno: {})", errno);
+                }
+                return;
+            }
+            handle_batch(socket_fd_, ring, received);
+            if (static_cast<size_t>(received) < ring.msgs.size()) return;
+        }
+    }
+
+    void run_ready() {
+        while (!ready_.empty()) {
+            Match *match = ready_.front();
+            ready_.pop_front();
+            match->queued = false;
+            std::optional<SteadyTime> next = match->step(std::chrono::steady_clock::now());
+            if (!next) {
+                match->retired = true;
+                if (--unfinished_ == 0) {
+                    finish_tournament(matches_, std::chrono::steady_clock::now() - started_);
+                    matches_.clear();
+                    ready_.clear();
+                    timers_ = {};
+                    print_admin_menu();
+                    return;
+                }
+            } else if (*next != match->timer_at) {
+                match->timer_at = *next;
+                timers_.push({*next, match});
+                if (timers_.top().second == match) arm_match_timer();
+            }
+        }
+    }
+
+    void fire_timers() {
+        auto now = std::chrono::steady_clock::now();
+        while (!timers_.empty() && timers_.top().first <= now) {
+            auto [at, match] = timers_.top();
+            timers_.pop();
+            // Устаревшие записи (матч уже перепланирован) пропускаем.
+            if (at == match->timer_at) wake(match);
+        }
+        arm_match_timer();
+    }
+
+    // steady_clock в Linux - это CLOCK_MONOTONIC, поэтому дедлайн задается абсолютным временем.
+    void arm_match_timer() {
+        itimerspec spec{};
+        if (!timers_.empty()) {
+            auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                timers_.top().first.time_since_epoch()).count();
+            spec.it_value.tv_sec = std::max<int64_t>(ns, 1) / 1000000000;
+            spec.it_value.tv_nsec = std::max<int64_t>(ns, 1) % 1000000000;
+        }
+        timerfd_settime(match_timer_fd_, TFD_TIMER_ABSTIME, &spec, nullptr);
+    }
+
+    void run_mailbox() {
+        std::vector<std::function<void()> > tasks; {
+            std::lock_guard<std::mutex> lock(mailbox_mutex_);
+            tasks.swap(mailbox_);
+        }
+        for (auto &task: tasks) task();
+    }
+
+    int socket_fd_ = -1;
+    int epoll_fd_ = -1;
+    int liveness_fd_ = -1;
+    int match_timer_fd_ = -1;
+    int wakeup_fd_ = -1;
+    std::mutex mailbox_mutex_;
+    std::vector<std::function<void()> > mailbox_;
+    std::deque<Match *> ready_;
+    std::priority_queue<Timer, std::vector<Timer>, std::greater<> > timers_;
+    std::vector<std::unique_ptr<Match> > matches_;
+    SteadyTime started_{};
+    size_t unfinished_ = 0;
+};
+
+Reactor reactor;
+
+void reactor_wake(Match *match) { reactor.wake(match); }
+
+void append_metric(std::string &out, const char *name, const char *type, const char *help) {
+    out += "# HELP ";
+    out += name;
+    out += ' ';
+    out += help;
+    out += "\n# TYPE ";
+    out += name;
+    out += ' ';
+    out += type;
+    out += '\n';
+}
+
+void append_sample(std::string &out, const char *name, const char *labels, double value) {
+    char line[192];
+    snprintf(line, sizeof(line), "%s%s %.9g\n", name, labels, value);
+    out += line;
+}
+
+// Гистограмма выводится как summary: квантили по корзинам, сумма и число наблюдений.
+// scale переводит единицы гистограммы в единицы метрики (наносекунды в секунды).
+void append_summary(std::string &out, const char *name, const char *help, MetricHistogram id, double scale) {
+    append_metric(out, name, "summary", help);
+    auto histogram = metrics.histogram(id);
+    for (const char *q: {"0.5", "0.9", "0.99", "0.999"}) {
+        std::string labels = std::string("{quantile=\"") + q + "\"}";
+        append_sample(out, name, labels.c_str(), histogram.quantile(atof(q)) * scale);
+    }
+    append_sample(out, (std::string(name) + "_sum").c_str(), "", histogram.sum * scale);
+    append_sample(out, (std::string(name) + "_count").c_str(), "", histogram.count);
+}
+
+// Метрики сервера в текстовом формате Prometheus. Счетчики и гистограммы суммируются по
+// блокам потоков без блокировок, размеры реестра берутся из кэшированного снимка.
+std::string render_metrics() {
+    std::string out;
+    size_t registered = 0, active = 0;
+    RegistrySnapshot::take().for_each_hot([&](uint32_t, uint64_t, uint8_t flags) {
+        registered++;
+        active += flags & CLIENT_ACTIVE;
+    });
+    append_metric(out, "rps_clients_registered", "gauge", "Зарегистрированные клиенты.");
+    append_sample(out, "rps_clients_registered", "", registered);
+    append_metric(out, "rps_clients_active", "gauge", "Активные клиенты.");
+    append_sample(out, "rps_clients_active", "", active);
+    append_metric(out, "rps_heartbeat_interval_ms", "gauge", "Интервал PING, назначаемый клиентам v2.");
+    append_sample(out, "rps_heartbeat_interval_ms", "", heartbeat_interval_ms());
+    append_metric(out, "rps_game_running", "gauge", "1, пока идет игра.");
+    append_sample(out, "rps_game_running", "", game_running ? 1 : 0);
+
+    append_metric(out, "rps_packets_total", "counter", "Принятые датаграммы по типу.");
+    append_sample(out, "rps_packets_total", "{type=\"register\"}", metrics.counter(M_PACKETS_REGISTER));
+    append_sample(out, "rps_packets_total", "{type=\"ping\"}", metrics.counter(M_PACKETS_PING));
+    append_sample(out, "rps_packets_total", "{type=\"choice\"}", metrics.counter(M_PACKETS_CHOICE));
+    append_sample(out, "rps_packets_total", "{type=\"mcast_ok\"}", metrics.counter(M_PACKETS_MCAST_OK));
+    append_sample(out, "rps_packets_total", "{type=\"invalid\"}", metrics.counter(M_PACKETS_INVALID));
+    append_metric(out, "rps_recv_calls_total", "counter", "Вызовы recvmmsg, вернувшие датаграммы.");
+    append_sample(out, "rps_recv_calls_total", "", metrics.counter(M_RECV_CALLS));
+    append_metric(out, "rps_sent_datagrams_total", "counter", "Отправленные sendmmsg датаграммы.");
+    append_sample(out, "rps_sent_datagrams_total", "", metrics.counter(M_SENT));
+    append_metric(out, "rps_sent_bytes_total", "counter", "Байты отправленных клиентам датаграмм.");
+    append_sample(out, "rps_sent_bytes_total", "", metrics.counter(M_SENT_BYTES));
+    append_metric(out, "rps_send_errors_total", "counter", "Ошибки sendmmsg.");
+    append_sample(out, "rps_send_errors_total", "", metrics.counter(M_SEND_ERRORS));
+    append_metric(out, "rps_rounds_total", "counter", "Сыгранные раунды.");
+    append_sample(out, "rps_rounds_total", "", metrics.counter(M_ROUNDS));
+    append_metric(out, "rps_tournaments_total", "counter", "Завершенные турниры.");
+    append_sample(out, "rps_tournaments_total", "", metrics.counter(M_TOURNAMENTS));
+    append_metric(out, "rps_choose_retransmits_total", "counter", "Повторно отправленные CHOOSE.");
+    append_sample(out, "rps_choose_retransmits_total", "", metrics.counter(M_CHOOSE_RETRANSMITS));
+    append_metric(out, "rps_liveness_probes_total", "counter", "Запросы PING замолчавшим клиентам v2.");
+    append_sample(out, "rps_liveness_probes_total", "", metrics.counter(M_LIVENESS_PROBES));
+    append_metric(out, "rps_stale_choices_total", "counter", "Отклоненные выборы к чужому раунду или вне сбора.");
+    append_sample(out, "rps_stale_choices_total", "", metrics.counter(M_STALE_CHOICES));
+    if (config.relay_fanout) {
+        append_metric(out, "rps_relay_frames_total", "counter", "Кадры OP_RELAY корням дерева ретрансляции.");
+        append_sample(out, "rps_relay_frames_total", "", metrics.counter(M_RELAY_FRAMES));
+        append_metric(out, "rps_relay_fallbacks_total", "counter",
+                      "Корни, не подтвердившие рассылку: ее получили их дети напрямую.");
+        append_sample(out, "rps_relay_fallbacks_total", "", metrics.counter(M_RELAY_FALLBACKS));
+    }
+    if (config.clustered()) {
+        append_metric(out, "rps_redirects_total", "counter", "REGISTER, перенаправленные на другой узел кластера.");
+        append_sample(out, "rps_redirects_total", "", metrics.counter(M_REDIRECTS));
+    }
+
+    if (journal.is_open()) {
+        append_metric(out, "rps_journal_records_total", "counter", "Записи, принятые журналом результатов.");
+        append_sample(out, "rps_journal_records_total", "", journal.appended());
+        append_metric(out, "rps_journal_dropped_total", "counter", "Записи, отброшенные журналом: не готов новый сегмент.");
+        append_sample(out, "rps_journal_dropped_total", "", journal.dropped());
+        append_metric(out, "rps_journal_commits_total", "counter", "Групповые фиксации журнала (msync).");
+        append_sample(out, "rps_journal_commits_total", "", journal.commits());
+        append_metric(out, "rps_journal_last_commit_seconds", "gauge", "Длительность последней групповой фиксации.");
+        append_sample(out, "rps_journal_last_commit_seconds", "", journal.last_commit_ns() * 1e-9);
+    }
+
+    append_summary(out, "rps_recv_batch_size", "Датаграмм за один recvmmsg.", H_RECV_BATCH_SIZE, 1);
+    append_summary(out, "rps_recv_batch_seconds", "Обработка пачки датаграмм.", H_RECV_BATCH_NS, 1e-9);
+    append_summary(out, "rps_broadcast_seconds", "Рассылка всем активным (send_to_all_active).", H_BROADCAST_NS, 1e-9);
+    append_summary(out, "rps_choice_rtt_seconds", "От рассылки CHOOSE до выбора участника.", H_CHOICE_RTT_NS, 1e-9);
+    append_summary(out, "rps_ping_rtt_seconds", "RTT клиентов по эхо PONG в кадрах PING.", H_PING_RTT_NS, 1e-9);
+    append_summary(out, "rps_round_deadline_seconds", "Срок раунда по времени ответа участников.",
+                   H_ROUND_DEADLINE_NS, 1e-9);
+    append_summary(out, "rps_round_seconds", "Раунд от рассылки CHOOSE до рассылки результата.", H_ROUND_NS, 1e-9);
+    append_summary(out, "rps_determine_winner_seconds", "Подсчет раунда с рассылкой результата.", H_DETERMINE_NS,
+                   1e-9);
+    append_summary(out, "rps_tournament_seconds", "Турнир от старта до итогов.", H_TOURNAMENT_NS, 1e-9);
+    return out;
+}
+
+// Обход всех клиентов для админских команд по свежему снимку реестра: форматирование
+// вывода идет без блокировок. Возвращает число просмотренных клиентов.
+template<typename F>
+size_t for_each_client(F &&visit) {
+    return RegistrySnapshot::take(true).for_each([&](uint32_t, const ClientView &client) { visit(client); });
+}
+
+bool coordinator_start();
+
+// Запуск турнира из админки или управляющего сокета; false, если игра уже идет. В кластере
+// турнир запускает только координатор, у остальных узлов запрос отклоняется.
+bool request_tournament() {
+    if (config.coordinate_port) return coordinator_start();
+    if (config.clustered() || game_running) return false;
+    if (config.engine == Engine::REACTOR) {
+        reactor.post([] { reactor.start_tournament(); });
+        return true;
+    }
+    return game_thread.start(start_game);
+}
+
+// Строка команды со stdin. Ждем ввода через poll с таймаутом, а не в блокирующем чтении,
+// чтобы поток заметил остановку сервера, инициированную не из админки (сигнал, SHUTDOWN
+// управляющего сокета). false - EOF, ошибка чтения или остановка сервера.
+bool read_admin_line(std::string &pending, std::string &line) {
+    for (;;) {
+        size_t newline = pending.find('\n');
+        if (newline != std::string::npos) {
+            line.assign(pending, 0, newline);
+            pending.erase(0, newline + 1);
+            return true;
+        }
+        if (!server_running) return false;
+        pollfd in{STDIN_FILENO, POLLIN, 0};
+        int ready = poll(&in, 1, 200);
+        if (ready < 0 && errno != EINTR) return false;
+        if (ready <= 0) continue;
+        char buffer[512];
+        ssize_t n = read(STDIN_FILENO, buffer, sizeof(buffer));
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return false;
+        pending.append(buffer, static_cast<size_t>(n));
+    }
+}
+
+void handle_commands() {
+    logger.info(LOG_ADMIN, "[Admin Thread] Поток обработки команд запущен. Введите команду.");
+    std::string cmd, pending;
+    while (server_running) {
+        print_admin_menu();
+
+        if (!read_admin_line(pending, cmd)) {
+            if (server_running) {
+                logger.warn(LOG_ADMIN, "[Admin Thread] Ошибка чтения команды из stdin (EOF или ошибка). Завершение потока.");
+            }
+            break;
+        }
+        if (!server_running) break;
+
+        cmd.erase(0, cmd.find_first_not_of(" \t\n\r"));
+        cmd.erase(cmd.find_last_not_of(" \t\n\r") + 1);
+
+        if (cmd == "1") {
+            std::cout << "\n[Admin] Информация об оборудовании клиентов:\n";
+            size_t total = for_each_client([](const ClientView &client) {
+                std::cout << "  " << client.name << " (" << format_addr(client.addr) << ", " << (
+                    client.active ? "Активен" : "Неактивен") << "): " << client.hardware->text << std::endl;
+            });
+            if (total == 0) std::cout << "  <Нет зарегистрированных клиентов>\n";
+        } else if (cmd == "2") {
+            std::cout << "\n[Admin] Имена клиентов (статус):\n";
+            size_t total = for_each_client([](const ClientView &client) {
+                std::cout << "  " << client.name << (client.active ? " (активен)" : " (неактивен)") << std::endl;
+            });
+            if (total == 0) std::cout << "  <Нет зарегистрированных клиентов>\n";
+        } else if (cmd == "3") {
+            if (!request_tournament()) {
+                std::cout << (config.clustered() && !config.coordinate_port
+                                  ? "[Admin] Турнир запускает координатор кластера."
+                                  : "[Admin] Игра уже идет.") << std::endl;
+            } else if (config.coordinate_port) {
+                std::cout << "[Admin] Запуск турнира кластера..." << std::endl;
+            } else if (config.engine == Engine::REACTOR) {
+                std::cout << "[Admin] Запуск игры в цикле событий реактора..." << std::endl;
+            } else {
+                std::cout << "[Admin] Запуск игры в отдельном потоке..." << std::endl;
+            }
+        } else if (cmd == "4") {
+            std::cout << "[Admin] Отправка команды SHUTDOWN всем АКТИВНЫМ клиентам..." << std::endl;
+            send_to_all_active({"SHUTDOWN", wire::frame(wire::OP_SHUTDOWN, 0, wire_seq++)});
+        } else if (cmd == "5") {
+            std::cout << "\n[Admin] Список зарегистрированных клиентов и их статус:\n";
+            std::cout << "--------------------------------\n";
+            size_t total = for_each_client([](const ClientView &client) {
+                std::cout << "  Адрес: " << format_addr(client.addr) << "\n  Имя: " << client.name
+                        << "\n  Железо: " << client.hardware->text
+                        << "\n  Статус: " << (client.active ? "Активен" : "Неактивен")
+                        << "\n  Посл. сообщ.: " << std::put_time(std::localtime(&client.last_seen),
+                                                                 "%Y-%m-%d %H:%M:%S");
+                if (!client.active && client.inactive_since_ms > 0) {
+                    time_t inactive_since = client.inactive_since_ms / 1000;
+                    std::cout << "\n  Неактивен с: " << std::put_time(std::localtime(&inactive_since),
+                                                                     "%Y-%m-%d %H:%M:%S")
+                            << "." << std::setw(3) << std::setfill('0') << client.inactive_since_ms % 1000
+                            << std::setfill(' ');
+                }
+                std::cout << "\n--------------------------------\n";
+            });
+            if (total == 0) std::cout << "  <Нет зарегистрированных клиентов>\n";
+        } else if (cmd == "6") {
+            std::cout << "\n[Admin] Список АКТИВНЫХ клиентов:\n";
+            int active_count = 0;
+            for_each_client([&](const ClientView &client) {
+                if (client.active) {
+                    std::cout << "  - " << client.name << " (" << format_addr(client.addr) << ")" << std::endl;
+                    active_count++;
+                }
+            });
+            if (active_count == 0) {
+                std::cout << "  <Нет активных клиентов>\n";
+            } else {
+                std::cout << "  Всего активных: " << active_count << std::endl;
+            }
+        } else if (cmd == "7") {
+            std::cout << "[Admin] Команда на выход, инициируем остановку сервера..." << std::endl;
+            handle_signal(0);
+        } else if (cmd == "8") {
+            std::cout << "\n[Admin] Метрики сервера:\n" << render_metrics() << std::flush;
+        } else {
+            std::cout << "[Admin] Неизвестная команда." << std::endl;
+        }
+    }
+    logger.info(LOG_ADMIN, "[Admin Thread] Поток обработки команд завершен.");
+}
+
+
+// Ответ на REGISTER в протоколе клиента: в режиме multicast сообщаем клиенту адрес группы,
+// ретранслятору - ключ проверки кадров OP_RELAY.
+void send_register_reply(int fd, const sockaddr_in &client_addr, uint8_t protocol, uint32_t heartbeat,
+                         bool relay = false) {
+    std::string reply;
+    if (protocol == wire::VERSION) {
+        wire::RegisteredBody body{};
+        body.heartbeat_ms = htonl(heartbeat);
+        if (relay && config.relay_fanout) relay_fanout.key_of(pack_addr(client_addr)).to_bytes(body.relay_key);
+        if (config.multicast) {
+            body.flags = wire::REGISTERED_MULTICAST;
+            body.multicast_port = config.multicast_group.sin_port;
+            body.multicast_group = config.multicast_group.sin_addr.s_addr;
+        }
+        reply = wire::frame(wire::OP_REGISTERED, 0, wire_seq++, body);
+    } else {
+        reply = "REGISTERED";
+        if (config.multicast) {
+            reply += ":MCAST:" + format_addr(config.multicast_group);
+        }
+    }
+    if (sendto(fd, reply.data(), reply.size(), 0, (sockaddr *) &client_addr, sizeof(client_addr)) < 0) {
+        logger.error(LOG_PACKETS, "[Server Main] Ошибка отправки REGISTERED клиенту {} (errno: {})", client_addr, errno);
+    }
+}
+
+// Узел кластера, владеющий клиентом, - по хешу его адреса. Адрес клиента одинаков для всех
+// узлов, поэтому клиент после перенаправления регистрируется у владельца с первой попытки.
+unsigned cluster_owner(uint64_t key) {
+    return static_cast<unsigned>(((key * 0xC2B2AE3D27D4EB4FULL) >> 32) % config.cluster_nodes.size());
+}
+
+void send_redirect(int fd, const sockaddr_in &client_addr, uint8_t protocol, const sockaddr_in &owner) {
+    std::string reply;
+    if (protocol == wire::VERSION) {
+        wire::RedirectBody body{owner.sin_addr.s_addr, owner.sin_port, 0};
+        reply = wire::frame(wire::OP_REDIRECT, 0, wire_seq++, body);
+    } else {
+        reply = "REDIRECT:" + format_addr(owner);
+    }
+    if (sendto(fd, reply.data(), reply.size(), 0, (sockaddr *) &client_addr, sizeof(client_addr)) < 0) {
+        logger.error(LOG_PACKETS, "[Server Main] Ошибка отправки REDIRECT клиенту {} (errno: {})", client_addr, errno);
+    }
+}
+
+// Действия над реестром ниже не зависят от версии протокола; их вызывают разборщики
+// текстовых сообщений и кадров v2. Блокируется только шард отправителя.
+void register_client(int fd, ClientShard &shard, uint64_t key, const sockaddr_in &client_addr,
+                     std::string_view name, const HardwareProfile *hardware, uint8_t protocol, bool relay = false) {
+    metrics.add(M_PACKETS_REGISTER);
+    if (config.clustered()) {
+        unsigned owner = cluster_owner(key);
+        if (owner != config.cluster_index) {
+            metrics.add(M_REDIRECTS);
+            send_redirect(fd, client_addr, protocol, config.cluster_nodes[owner]);
+            logger.debug(LOG_CLIENTS, "[Cluster] Клиент {} ({}) перенаправлен на узел {}.", name, client_addr, owner);
+            return;
+        }
+    }
+    uint8_t flags = CLIENT_ACTIVE | (protocol == wire::VERSION ? CLIENT_V2 : 0) | (relay ? CLIENT_RELAY : 0);
+    uint32_t heartbeat = protocol == wire::VERSION ? heartbeat_interval_ms() : PING_INTERVAL_MS; {
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        shard.version++;
+        auto [index, is_new] = shard.ids.try_emplace(key, shard.size());
+        if (is_new) {
+            registered_clients++;
+            ClientSession session;
+            session.heartbeat_ms = heartbeat;
+            uint32_t record = registry_file.is_open() ? registry_file.allocate() : RegistryFile::NONE;
+            shard.add(key, unix_seconds(), flags, session, {profiles.intern_name(name), hardware, 0, record});
+            shard.liveness.schedule(*index, steady_ms() + liveness_timeout_ms(flags, session));
+            persist_client(shard, *index);
+            logger.info(LOG_CLIENTS, "[Server Main] Зарегистрирован НОВЫЙ клиент: {} ({}, протокол v{})", name,
+                        client_addr, protocol);
+        } else {
+            // Повторная регистрация обновляет профиль и протокол; матч и оценки RTT сохраняются.
+            ClientSession &session = shard.sessions[*index];
+            ClientCold &cold = shard.cold[*index];
+            session.heartbeat_ms = heartbeat;
+            session.probes = 0;
+            cold.name = profiles.intern_name(name, cold.name, cold.renames);
+            if (ProfileStore::name(cold.name) != name.substr(0, ProfileStore::MAX_NAME)) {
+                logger.warn(LOG_CLIENTS, "[Server Main] Клиент {} ({}) слишком часто меняет имя; остается прежнее.",
+                            ProfileStore::name(cold.name), client_addr);
+            }
+            cold.hardware = hardware;
+            cold.inactive_since_ms = 0;
+            shard.flags[*index] = flags;
+            shard.last_seen[*index] = unix_seconds();
+            shard.liveness.schedule(*index, steady_ms() + liveness_timeout_ms(flags, session));
+            persist_client(shard, *index);
+            logger.info(LOG_CLIENTS, "[Server Main] Обновлен клиент: {} ({})", name, client_addr);
+        }
+    }
+    send_register_reply(fd, client_addr, protocol, heartbeat, relay);
+}
+
+// PONG с меткой времени сервера (клиент вернет ее в следующем PING вместе со временем удержания)
+// и текущим интервалом PING.
+std::string pong_frame(uint32_t heartbeat, uint8_t flags) {
+    wire::PongBody body{htonl(static_cast<uint32_t>(steady_us())), htonl(heartbeat), flags, {}};
+    return wire::frame(wire::OP_PONG, 0, wire_seq++, body);
+}
+
+// Любая корректная датаграмма известного клиента - признак жизни: переносит его дедлайн
+// неактивности и возвращает неактивного клиента в реестр активных. what - что пришло, для лога.
+// Вызывается под мьютексом шарда клиента; холодные поля меняются, только если клиент был неактивен.
+void mark_alive(ClientShard &shard, uint32_t index, uint64_t now_ms, const char *what) {
+    ClientSession &session = shard.sessions[index];
+    shard.last_seen[index] = unix_seconds();
+    session.probes = 0;
+    shard.liveness.schedule(index, now_ms + liveness_timeout_ms(shard.flags[index], session));
+    if (!shard.active(index)) {
+        shard.version++;
+        shard.flags[index] |= CLIENT_ACTIVE;
+        shard.cold[index].inactive_since_ms = 0;
+        persist_client(shard, index);
+        logger.info(LOG_CLIENTS, "[Server Main] Клиент {} ({}) снова активен (получен {}).", shard.name(index),
+                    shard.addr(index), what);
+    }
+}
+
+// ping - тело кадра PING v2 (nullptr для текстового PING). Эхо метки из PONG дает замер RTT;
+// клиенту v2 раз в RTT_PROBE_MS, а также при смене интервала PING отвечаем новым PONG.
+void touch_client(int fd, ClientShard &shard, uint64_t key, const sockaddr_in &client_addr,
+                  const wire::PingBody *ping) {
+    metrics.add(M_PACKETS_PING);
+    std::unique_lock<std::mutex> lock(shard.mutex);
+    const uint32_t *index = shard.ids.find(key);
+    if (!index) {
+        lock.unlock();
+        logger.info(LOG_PACKETS, "[Server Main] Получен PING от НЕИЗВЕСТНОГО клиента {}. Игнорируется.", client_addr);
+        return;
+    }
+    ClientSession &session = shard.sessions[*index];
+    uint64_t now_ms = steady_ms();
+    if (ping && ping->echo_us) {
+        // Метки - младшие 32 бита steady_us() сервера, разность по модулю 2^32.
+        uint32_t sample_us = static_cast<uint32_t>(steady_us()) - ntohl(ping->echo_us) - ntohl(ping->held_us);
+        if (sample_us <= TIMEOUT * 1'000'000u) {
+            session.rtt.add(sample_us);
+            metrics.record(H_PING_RTT_NS, uint64_t{sample_us} * 1000);
+        }
+    }
+    uint32_t heartbeat = heartbeat_interval_ms();
+    uint32_t now_low = static_cast<uint32_t>(now_ms);
+    bool probe = ping && (now_low - session.rtt_probe_ms >= RTT_PROBE_MS || session.heartbeat_ms != heartbeat);
+    if (probe) {
+        session.rtt_probe_ms = now_low;
+        session.heartbeat_ms = heartbeat;
+    }
+    mark_alive(shard, *index, now_ms, "PING");
+    lock.unlock();
+    if (probe) {
+        std::string pong = pong_frame(heartbeat, 0);
+        if (sendto(fd, pong.data(), pong.size(), 0, (sockaddr *) &client_addr, sizeof(client_addr)) < 0) {
+            logger.error(LOG_PACKETS, "[Server Main] Ошибка отправки PONG клиенту {} (errno: {})", client_addr, errno);
+        }
+    }
+}
+
+// round - идентификатор раунда из кадра v2 (0 - текстовый выбор).
+void record_client_choice(ClientShard &shard, uint64_t key, const sockaddr_in &client_addr, GameChoice choice,
+                          uint32_t round) {
+    metrics.add(M_PACKETS_CHOICE);
+    if (!game_running || choice == INVALID) return;
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    const uint32_t *index = shard.ids.find(key);
+    if (!index) return;
+    mark_alive(shard, *index, steady_ms(), "выбор");
+    ClientSession &session = shard.sessions[*index];
+    if (!session.match) return;
+    uint32_t response_us;
+    Match::ChoiceOutcome outcome = session.match->record_choice(session.match_slot, choice, round, response_us);
+    if (response_us) {
+        session.response.add(response_us);
+        session.match->update_response_bound(session.match_slot, session.response.bound_us());
+    }
+    switch (outcome) {
+        case Match::ChoiceOutcome::STALE:
+            metrics.add(M_STALE_CHOICES);
+            logger.info(LOG_PACKETS, "[Server Main] Отклонен запоздавший выбор игрока {} ({}), раунд {}.",
+                        shard.name(*index), client_addr, round);
+            return;
+        case Match::ChoiceOutcome::REJECTED:
+            return;
+        case Match::ChoiceOutcome::ROUND_COMPLETE:
+            wake_match(session.match);
+            break;
+        case Match::ChoiceOutcome::RECORDED:
+            break;
+    }
+    logger.info(LOG_PACKETS, "[Server Main] Активный игрок {} ({}) выбрал: {}", shard.name(*index), client_addr,
+                choice_name(choice));
+}
+
+void confirm_multicast(ClientShard &shard, uint64_t key, const sockaddr_in &client_addr) {
+    metrics.add(M_PACKETS_MCAST_OK);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    if (const uint32_t *index = shard.ids.find(key)) {
+        mark_alive(shard, *index, steady_ms(), "MCAST:OK");
+        shard.flags[*index] |= CLIENT_MULTICAST;
+        shard.version++;
+        persist_client(shard, *index);
+        logger.info(LOG_CLIENTS, "[Server Main] Клиент {} ({}) принимает рассылки через multicast.",
+                    shard.name(*index), client_addr);
+    }
+}
+
+// Кадр протокола v2: заголовок и тело читаются прямо из буфера приема.
+void handle_frame(int fd, ClientShard &shard, uint64_t key, std::string_view msg, const sockaddr_in &client_addr) {
+    wire::Header header = wire::header(msg);
+    switch (header.opcode) {
+        case wire::OP_REGISTER: {
+            wire::RegisterBody body;
+            if (!wire::body(msg, body)) break;
+            register_client(fd, shard, key, client_addr, wire::get_name(body.name),
+                            profiles.intern_hardware(ntohs(body.cpus), ntohl(body.ram_mb)), wire::VERSION,
+                            ntohs(body.flags) & wire::REGISTER_RELAY);
+            return;
+        }
+        case wire::OP_PING: {
+            // PING без тела (клиенты до появления PONG) - тоже признак жизни, просто без замера RTT.
+            wire::PingBody body{};
+            wire::body(msg, body);
+            touch_client(fd, shard, key, client_addr, &body);
+            return;
+        }
+        case wire::OP_CHOICE: {
+            wire::ChoiceBody body;
+            if (!wire::body(msg, body)) break;
+            record_client_choice(shard, key, client_addr,
+                                 body.choice <= SCISSORS ? static_cast<GameChoice>(body.choice) : INVALID, header.round);
+            return;
+        }
+        case wire::OP_MCAST_OK:
+            confirm_multicast(shard, key, client_addr);
+            return;
+        case wire::OP_RELAY_ACK: {
+            if (!config.relay_fanout) break;
+            {
+                std::lock_guard<std::mutex> lock(shard.mutex);
+                if (const uint32_t *index = shard.ids.find(key)) mark_alive(shard, *index, steady_ms(), "RELAY_ACK");
+            }
+            relay_fanout.ack(header.round, client_addr);
+            return;
+        }
+        default:
+            break;
+    }
+    metrics.add(M_PACKETS_INVALID);
+    logger.warn(LOG_PACKETS, "[Server Main] Некорректный кадр v2 (код {}, {} байт) от {}", header.opcode, msg.size(),
+                client_addr);
+}
+
+// Обработка одной датаграммы потоком приема; fd - сокет, на который она пришла (через него же ответ).
+void handle_datagram(int fd, std::string_view msg, const sockaddr_in &client_addr) {
+    uint64_t key = pack_addr(client_addr);
+    ClientShard &shard = *shards[shard_index(key)];
+
+    if (wire::is_frame(msg)) {
+        handle_frame(fd, shard, key, msg, client_addr);
+    } else if (msg.substr(0, 9) == "REGISTER:") {
+        size_t first_colon = 9;
+        size_t second_colon = msg.find(':', first_colon);
+        if (second_colon != std::string::npos) {
+            // Имя ограничено, как в v2: длиннее оно не поместилось бы ни в запись файла реестра,
+            // ни в RESULT с именем победителя и вернулось бы обрезанным после перезапуска.
+            register_client(fd, shard, key, client_addr,
+                            wire::clip_name(msg.substr(first_colon, second_colon - first_colon)),
+                            profiles.intern_hardware(msg.substr(second_colon + 1)), 1);
+        } else {
+            metrics.add(M_PACKETS_INVALID);
+            logger.warn(LOG_PACKETS, "[Server Main] Неверный формат REGISTER от {}: {}", client_addr, msg);
+        }
+    } else if (msg == "PING") {
+        touch_client(fd, shard, key, client_addr, nullptr);
+    } else if (msg == "ROCK" || msg == "PAPER" || msg == "SCISSORS") {
+        record_client_choice(shard, key, client_addr, string_to_choice(msg), 0);
+    } else if (msg == "MCAST:OK") {
+        confirm_multicast(shard, key, client_addr);
+    } else {
+        metrics.add(M_PACKETS_INVALID);
+        logger.info(LOG_PACKETS, "[Server Main] Получено неизвестное сообщение от {}: {}", client_addr, msg);
+    }
+}
+
+
+bool parse_ipv4_endpoint(const std::string &text, sockaddr_in &out) {
+    size_t colon = text.find(':');
+    if (colon == std::string::npos) return false;
+    int port = atoi(text.c_str() + colon + 1);
+    if (port <= 0 || port > 65535) return false;
+    memset(&out, 0, sizeof(out));
+    out.sin_family = AF_INET;
+    out.sin_port = htons(port);
+    return inet_pton(AF_INET, text.substr(0, colon).c_str(), &out.sin_addr) > 0;
+}
+
+bool parse_args(int argc, char *argv[]) {
+    for (int i = 1; i < argc; ++i) {
+        std::string_view arg = argv[i];
+        if (arg == "--recv-batch" && i + 1 < argc) {
+            int value = atoi(argv[++i]);
+            if (value < 1 || value > 1024) {
+                std::cerr << "[Server Main] --recv-batch должен быть в диапазоне 1..1024" << std::endl;
+                return false;
+            }
+            config.recv_batch = static_cast<unsigned>(value);
+        } else if (arg == "--recv-threads" && i + 1 < argc) {
+            int value = atoi(argv[++i]);
+            if (value < 1 || value > MAX_RECV_THREADS) {
+                std::cerr << "[Server Main] --recv-threads должен быть в диапазоне 1.." << MAX_RECV_THREADS << std::endl;
+                return false;
+            }
+            config.recv_threads = static_cast<unsigned>(value);
+        } else if (arg == "--engine" && i + 1 < argc) {
+            std::string_view engine = argv[++i];
+            if (engine == "threads") {
+                config.engine = Engine::THREADS;
+            } else if (engine == "reactor") {
+                config.engine = Engine::REACTOR;
+            } else {
+                std::cerr << "[Server Main] --engine ожидает threads или reactor" << std::endl;
+                return false;
+            }
+        } else if (arg == "--pin-cpus") {
+            config.pin_cpus = true;
+        } else if (arg == "--match-size" && i + 1 < argc) {
+            config.match_size = static_cast<size_t>(std::max(0, atoi(argv[++i])));
+        } else if (arg == "--match-workers" && i + 1 < argc) {
+            int value = atoi(argv[++i]);
+            if (value < 1) {
+                std::cerr << "[Server Main] --match-workers должен быть положительным" << std::endl;
+                return false;
+            }
+            config.match_workers = static_cast<unsigned>(value);
+        } else if (arg == "--multicast" && i + 1 < argc) {
+            if (!parse_ipv4_endpoint(argv[++i], config.multicast_group) ||
+                !IN_MULTICAST(ntohl(config.multicast_group.sin_addr.s_addr))) {
+                std::cerr << "[Server Main] --multicast ожидает адрес группы вида 239.255.0.1:9090" << std::endl;
+                return false;
+            }
+            config.multicast = true;
+        } else if (arg == "--multicast-if" && i + 1 < argc) {
+            if (inet_pton(AF_INET, argv[++i], &config.multicast_if) <= 0) {
+                std::cerr << "[Server Main] --multicast-if ожидает IPv4-адрес интерфейса" << std::endl;
+                return false;
+            }
+        } else if (arg == "--metrics-port" && i + 1 < argc) {
+            int port = atoi(argv[++i]);
+            if (port <= 0 || port > 65535 || port == config.port) {
+                std::cerr << "[Server Main] --metrics-port должен быть в диапазоне 1..65535 и отличаться от "
+                        << config.port << std::endl;
+                return false;
+            }
+            config.metrics_port = static_cast<uint16_t>(port);
+        } else if (arg == "--registry" && i + 1 < argc) {
+            config.registry_path = argv[++i];
+        } else if (arg == "--registry-capacity" && i + 1 < argc) {
+            long capacity = atol(argv[++i]);
+            if (capacity < 1 || capacity > (1L << 26)) {
+                std::cerr << "[Server Main] --registry-capacity должен быть в диапазоне 1.." << (1L << 26) << std::endl;
+                return false;
+            }
+            config.registry_capacity = static_cast<uint32_t>(capacity);
+        } else if (arg == "--heartbeat-budget" && i + 1 < argc) {
+            long budget = atol(argv[++i]);
+            if (budget < 1 || budget > 100'000'000) {
+                std::cerr << "[Server Main] --heartbeat-budget должен быть в диапазоне 1..100000000" << std::endl;
+                return false;
+            }
+            config.heartbeat_budget = static_cast<uint32_t>(budget);
+        } else if (arg == "--control-socket" && i + 1 < argc) {
+            config.control_path = argv[++i];
+            if (config.control_path.empty() || config.control_path.size() >= sizeof(sockaddr_un::sun_path)) {
+                std::cerr << "[Server Main] --control-socket ожидает путь короче " << sizeof(sockaddr_un::sun_path)
+                        << " байт" << std::endl;
+                return false;
+            }
+        } else if (arg == "--port" && i + 1 < argc) {
+            int port = atoi(argv[++i]);
+            if (port <= 0 || port > 65535) {
+                std::cerr << "[Server Main] --port должен быть в диапазоне 1..65535" << std::endl;
+                return false;
+            }
+            config.port = static_cast<uint16_t>(port);
+        } else if (arg == "--cluster-nodes" && i + 1 < argc) {
+            std::string list = argv[++i];
+            config.cluster_nodes.clear();
+            for (size_t begin = 0; begin <= list.size();) {
+                size_t comma = std::min(list.find(',', begin), list.size());
+                sockaddr_in node{};
+                if (!parse_ipv4_endpoint(list.substr(begin, comma - begin), node)) {
+                    std::cerr << "[Server Main] --cluster-nodes ожидает список IP:PORT через запятую" << std::endl;
+                    return false;
+                }
+                config.cluster_nodes.push_back(node);
+                begin = comma + 1;
+            }
+        } else if (arg == "--cluster-index" && i + 1 < argc) {
+            config.cluster_index = static_cast<unsigned>(std::max(0, atoi(argv[++i])));
+        } else if (arg == "--coordinator" && i + 1 < argc) {
+            if (!parse_ipv4_endpoint(argv[++i], config.coordinator)) {
+                std::cerr << "[Server Main] --coordinator ожидает адрес вида 127.0.0.1:9000" << std::endl;
+                return false;
+            }
+        } else if (arg == "--coordinate" && i + 1 < argc) {
+            int port = atoi(argv[++i]);
+            if (port <= 0 || port > 65535) {
+                std::cerr << "[Server Main] --coordinate должен быть в диапазоне 1..65535" << std::endl;
+                return false;
+            }
+            config.coordinate_port = static_cast<uint16_t>(port);
+        } else if (arg == "--relay-fanout" && i + 1 < argc) {
+            int fanout = atoi(argv[++i]);
+            if (fanout < 2 || fanout > 64) {
+                std::cerr << "[Server Main] --relay-fanout должен быть в диапазоне 2..64" << std::endl;
+                return false;
+            }
+            config.relay_fanout = static_cast<unsigned>(fanout);
+        } else if (arg == "--journal" && i + 1 < argc) {
+            config.journal_dir = argv[++i];
+        } else if (arg == "--journal-segment" && i + 1 < argc) {
+            long records = atol(argv[++i]);
+            if (records < 1024 || records > (1L << 26)) {
+                std::cerr << "[Server Main] --journal-segment должен быть в диапазоне 1024.." << (1L << 26) << std::endl;
+                return false;
+            }
+            config.journal_segment = static_cast<uint64_t>(records);
+        } else if (arg == "--log-level" && i + 1 < argc) {
+            std::string level = argv[++i];
+            if (level == "debug") config.log_level = LogLevel::DEBUG;
+            else if (level == "info") config.log_level = LogLevel::INFO;
+            else if (level == "warn") config.log_level = LogLevel::WARN;
+            else if (level == "error") config.log_level = LogLevel::ERROR;
+            else {
+                std::cerr << "[Server Main] --log-level ожидает debug, info, warn или error" << std::endl;
+                return false;
+            }
+        } else {
+            std::cerr << "[Server Main] Неизвестный аргумент: " << arg << "\n"
+                    << "Использование: " << argv[0]
+                    << " [--engine threads|reactor] [--recv-batch N] [--recv-threads N] [--pin-cpus] [--match-size N] [--match-workers N] [--multicast GROUP:PORT]"
+                    << " [--multicast-if IP] [--log-level debug|info|warn|error] [--metrics-port PORT]"
+                    << " [--registry FILE] [--registry-capacity N] [--heartbeat-budget PPS] [--control-socket PATH]"
+                    << " [--journal DIR] [--journal-segment N] [--port PORT] [--cluster-nodes IP:PORT,...]"
+                    << " [--cluster-index N] [--coordinator IP:PORT] [--coordinate PORT]"
+                    << " [--relay-fanout K]" << std::endl;
+            return false;
+        }
+    }
+    if (config.engine == Engine::REACTOR && config.recv_threads > 1) {
+        std::cerr << "[Server Main] Реактор однопоточный, --recv-threads с --engine reactor не поддерживается" << std::endl;
+        return false;
+    }
+    if (config.coordinate_port && !config.coordinator.sin_port) {
+        config.coordinator.sin_family = AF_INET;
+        config.coordinator.sin_port = htons(config.coordinate_port);
+        config.coordinator.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    }
+    if (config.clustered() != (config.coordinator.sin_port != 0) ||
+        config.cluster_index >= std::max<size_t>(config.cluster_nodes.size(), 1)) {
+        std::cerr << "[Server Main] Кластеру нужны --cluster-nodes, --cluster-index в пределах списка и --coordinator"
+                " (или --coordinate)" << std::endl;
+        return false;
+    }
+    if (config.clustered() && config.match_size) {
+        std::cerr << "[Server Main] В кластере турнир идет одним матчем, --match-size не поддерживается" << std::endl;
+        return false;
+    }
+    return true;
+}
 
-std::unordered_map<std::string, GameChoice> current_choices;
-std::mutex clients_mutex, game_mutex;
-bool game_running = false;
+// Серверный сокет на config.port. SO_REUSEPORT позволяет привязать к порту несколько сокетов,
+// ядро распределяет между ними входящие датаграммы по хешу адресов.
+int open_server_socket() {
+    int fd = socket(AF_INET, SOCK_DGRAM, 0);
+    if (fd < 0) {
+        perror("[Server Main] Ошибка создания серверного сокета");
+        return -1;
+    }
 
-struct ClientInfo {
-    std::string name;
-    std::string hardware;
-    time_t last_seen;
-    bool active;
-};
+    sockaddr_in server_addr{};
+    memset(&server_addr, 0, sizeof(server_addr));
+    server_addr.sin_family = AF_INET;
+    server_addr.sin_port = htons(config.port);
+    server_addr.sin_addr.s_addr = htonl(INADDR_ANY);
 
-std::unordered_map<std::string, ClientInfo> clients;
-int server_socket;
-std::atomic<bool> server_running = true;
+    int reuse = 1;
+    if (setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse)) < 0) {
+        perror("[Server Main] setsockopt(SO_REUSEADDR) failed");
+    }
+    if (config.recv_threads > 1 && setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &reuse, sizeof(reuse)) < 0) {
+        perror("[Server Main] setsockopt(SO_REUSEPORT) failed");
+        close(fd);
+        return -1;
+    }
 
-void handle_signal(int sig) {
-    std::cout << "\n[Server] Получен сигнал " << sig << ", инициируем завершение работы сервера..." << std::endl;
-    server_running = false;
-    shutdown(server_socket, SHUT_RDWR);
+    if (bind(fd, (sockaddr *) &server_addr, sizeof(server_addr)) < 0) {
+        perror("[Server Main] Ошибка привязки серверного сокета");
+        close(fd);
+        return -1;
+    }
+    return fd;
 }
 
-void update_clients() {
-    std::cout << "[Update Thread] Поток проверки активности запущен (проверки каждые ~3 сек)." << std::endl;
+// Точка сбора метрик: любая датаграмма на 127.0.0.1:metrics_port получает в ответ метрики
+// в текстовом формате Prometheus (например, echo | nc -u -w1 127.0.0.1 9100).
+void serve_metrics() {
+    int fd = socket(AF_INET, SOCK_DGRAM, 0);
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = htons(config.metrics_port);
+    timeval timeout{0, 200000}; // чтобы заметить остановку сервера
+    if (fd < 0 || setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout)) < 0 ||
+        bind(fd, (sockaddr *) &addr, sizeof(addr)) < 0) {
+        logger.error(LOG_SERVER, "[Metrics] Не удалось открыть 127.0.0.1:{} (errno: {})", config.metrics_port, errno);
+        if (fd >= 0) close(fd);
+        return;
+    }
+    logger.info(LOG_SERVER, "[Metrics] Метрики в формате Prometheus: udp://127.0.0.1:{}", config.metrics_port);
+    char request[64];
     while (server_running) {
-        for (int i = 0; i < 30 && server_running; ++i) {
-            usleep(100000);
-        }
-        if (!server_running) break; {
-            std::lock_guard<std::mutex> lock(clients_mutex);
-            time_t now = time(nullptr);
-            // std::cout << "[Update Thread] Проверка активности клиентов..." << std::endl;
-            int became_inactive_count = 0;
-            for (auto &[addr, client]: clients) {
-                bool was_active = client.active;
-                client.active = (now - client.last_seen) <= TIMEOUT;
-                if (was_active && !client.active) {
-                    std::cout << "[Update Thread] Клиент " << client.name << " (" << addr <<
-                            ") стал НЕАКТИВНЫМ (таймаут)." << std::endl;
-                    became_inactive_count++;
+        sockaddr_in from{};
+        socklen_t from_len = sizeof(from);
+        if (recvfrom(fd, request, sizeof(request), 0, (sockaddr *) &from, &from_len) < 0) continue;
+        std::string text = render_metrics();
+        if (sendto(fd, text.data(), text.size(), 0, (sockaddr *) &from, from_len) < 0) {
+            logger.warn(LOG_SERVER, "[Metrics] Ошибка отправки метрик {} (errno: {})", from, errno);
+        }
+    }
+    close(fd);
+}
+
+// Фильтр команд LIST и COUNT управляющего сокета.
+struct ControlFilter {
+    enum Status { ALL, ACTIVE, INACTIVE } status = ALL;
+    std::string prefix; // начало имени клиента
+
+    bool matches_name(const ClientShard &shard, uint32_t index) const {
+        return shard.name(index).substr(0, prefix.size()) == prefix;
+    }
+
+    bool matches(const ClientShard &shard, uint32_t index) const {
+        return (status == ALL || shard.active(index) == (status == ACTIVE)) && matches_name(shard, index);
+    }
+};
+
+// Обход реестра по возрастанию глобального id, начиная с cursor. Мьютекс шарда берется не
+// более чем на CONTROL_SCAN_CHUNK записей, так что прием ждет не дольше одной порции, сколько
+// бы клиентов ни было в реестре. visit(id, shard, index) вызывается под мьютексом и только копирует
+// нужное; false - остановиться после этого клиента. Возвращает id, с которого продолжать, или
+// nullopt, если реестр пройден до конца. Клиенты не удаляются и не меняют id, поэтому обход по
+// курсору не пропускает и не повторяет клиентов, даже если между порциями появляются новые.
+template<typename F>
+std::optional<uint32_t> scan_registry(uint32_t cursor, F &&visit) {
+    for (uint32_t shard_no = cursor >> SHARD_SHIFT; shard_no < shards.size(); ++shard_no) {
+        ClientShard &shard = *shards[shard_no];
+        uint32_t index = shard_no == cursor >> SHARD_SHIFT ? cursor & SHARD_INDEX_MASK : 0;
+        for (;;) {
+            std::lock_guard<std::mutex> lock(shard.mutex);
+            uint32_t end = std::min(shard.size(), index + CONTROL_SCAN_CHUNK);
+            if (index >= end) break;
+            for (; index < end; ++index) {
+                if (!visit(make_client_id(shard_no, index), shard, index)) {
+                    return make_client_id(shard_no, index + 1);
                 }
             }
-            // std::cout << "[Update Thread] Проверка завершена." << std::endl;
         }
     }
-    // std::cout << "[Update Thread] Поток проверки активности завершен." << std::endl;
+    return std::nullopt;
 }
 
-GameChoice string_to_choice(const std::string &s) {
-    if (s == "ROCK") return ROCK;
-    if (s == "PAPER") return PAPER;
-    if (s == "SCISSORS") return SCISSORS;
-    return INVALID;
+// Поле строки ответа: табуляция и переводы строк в именах заменяются пробелами.
+void append_control_field(std::string &out, std::string_view text) {
+    out += '\t';
+    for (char c: text) out += c == '\t' || c == '\n' || c == '\r' ? ' ' : c;
 }
 
-std::string choice_to_string(GameChoice c) {
-    switch (c) {
-        case ROCK: return "Камень";
-        case PAPER: return "Бумага";
-        case SCISSORS: return "Ножницы";
-        default: return "Неизвестно";
+bool parse_control_number(std::string_view text, uint32_t &out) {
+    if (text.empty() || text.size() > 10) return false;
+    uint64_t value = 0;
+    for (char c: text) {
+        if (c < '0' || c > '9') return false;
+        value = value * 10 + static_cast<uint64_t>(c - '0');
     }
+    if (value > UINT32_MAX) return false;
+    out = static_cast<uint32_t>(value);
+    return true;
 }
 
-void send_to_all_active(const std::string &message) {
-    std::cout << "[Send All Active] Отправка сообщения всем активным: \"" << message << "\"" << std::endl;
-    std::lock_guard<std::mutex> lock(clients_mutex);
-    int sent_count = 0;
-    for (const auto &[addr, client]: clients) {
-        if (!client.active) continue;
-
-        size_t colon = addr.find(':');
-        if (colon == std::string::npos) { continue; }
-        std::string ip = addr.substr(0, colon);
-        int port = 0;
-        try { port = std::stoi(addr.substr(colon + 1)); } catch (...) { continue; }
-
-        sockaddr_in client_addr{};
-        memset(&client_addr, 0, sizeof(client_addr));
-        client_addr.sin_family = AF_INET;
-        client_addr.sin_port = htons(port);
-        if (inet_pton(AF_INET, ip.c_str(), &client_addr.sin_addr) <= 0) { continue; }
-
-        ssize_t bytes_sent = sendto(server_socket, message.c_str(), message.size(), 0,
-                                    (sockaddr *) &client_addr, sizeof(client_addr));
-        if (bytes_sent < 0) {
-            std::cerr << "[Send All Active] Ошибка отправки клиенту " << addr << " (errno: " << errno << ")" <<
-                    std::endl;
+// Ответ на одну команду управляющего сокета (см. README). Аргументы - слова key=value.
+// shutdown_requested выставляется командой SHUTDOWN: остановка начинается после отправки ответа.
+std::string control_command(std::string_view line, bool &shutdown_requested) {
+    std::vector<std::string_view> words;
+    for (size_t pos = 0; pos < line.size();) {
+        size_t start = line.find_first_not_of(" \t", pos);
+        if (start == std::string_view::npos) break;
+        size_t end = std::min(line.find_first_of(" \t", start), line.size());
+        words.push_back(line.substr(start, end - start));
+        pos = end;
+    }
+    if (words.empty()) return "ERR\tпустая команда\n";
+    std::string_view command = words[0];
+
+    ControlFilter filter;
+    uint32_t limit = CONTROL_PAGE, cursor = 0;
+    for (size_t i = 1; i < words.size(); ++i) {
+        size_t eq = words[i].find('=');
+        std::string_view key = words[i].substr(0, eq);
+        std::string_view value = eq == std::string_view::npos ? std::string_view{} : words[i].substr(eq + 1);
+        bool listing = command == "LIST" || command == "COUNT";
+        if (listing && key == "status" && value == "active") filter.status = ControlFilter::ACTIVE;
+        else if (listing && key == "status" && value == "inactive") filter.status = ControlFilter::INACTIVE;
+        else if (listing && key == "status" && value == "all") filter.status = ControlFilter::ALL;
+        else if (listing && key == "prefix" && eq != std::string_view::npos) filter.prefix = value;
+        else if (command == "LIST" && key == "limit" && parse_control_number(value, limit) && limit >= 1 &&
+                 limit <= CONTROL_PAGE_MAX) {
+        } else if (command == "LIST" && key == "cursor" && parse_control_number(value, cursor)) {
         } else {
-            sent_count++;
+            return "ERR\tнедопустимый аргумент " + std::string(words[i]) + "\n";
         }
     }
-    // std::cout << "[Send All Active] Сообщение отправлено " << sent_count << " активным клиентам." << std::endl;
-}
 
-void send_to_participants(const std::string &message, const std::vector<std::string> &participants) {
-    // std::cout << "[Send Participants] Отправка сообщения активным участникам раунда: \"" << message << "\"" << std::endl;
-    std::lock_guard<std::mutex> lock(clients_mutex);
-    int sent_count = 0;
-    for (const auto &addr: participants) {
-        if (!clients.count(addr) || !clients[addr].active) {
-            continue;
+    if (command == "LIST") {
+        // Под мьютексом шарда только копируем записи страницы, форматируем уже без блокировок.
+        std::vector<std::pair<uint32_t, ClientView> > page;
+        page.reserve(limit);
+        std::optional<uint32_t> next = scan_registry(cursor, [&](uint32_t id, const ClientShard &shard, uint32_t index) {
+            if (filter.matches(shard, index)) page.emplace_back(id, view_of(shard, index));
+            return page.size() < limit;
+        });
+        std::string out;
+        for (const auto &[id, client]: page) {
+            out += "CLIENT\t" + std::to_string(id);
+            append_control_field(out, format_addr(client.addr));
+            append_control_field(out, client.active ? "active" : "inactive");
+            append_control_field(out, std::to_string(client.last_seen));
+            append_control_field(out, std::to_string(client.inactive_since_ms));
+            append_control_field(out, std::to_string(client.protocol));
+            append_control_field(out, client.name);
+            append_control_field(out, client.hardware->text);
+            out += '\n';
+        }
+        out += next ? "NEXT\t" + std::to_string(*next) + "\n" : "END\n";
+        return out;
+    }
+    if (command == "COUNT") {
+        uint64_t matched = 0, active = 0, inactive = 0;
+        scan_registry(0, [&](uint32_t, const ClientShard &shard, uint32_t index) {
+            if (filter.matches_name(shard, index)) (shard.active(index) ? active : inactive)++;
+            if (filter.matches(shard, index)) matched++;
+            return true;
+        });
+        return "COUNT\t" + std::to_string(matched) + "\t" + std::to_string(active) + "\t" + std::to_string(inactive) +
+               "\n";
+    }
+    if (command == "START") {
+        if (!request_tournament()) {
+            return config.clustered() && !config.coordinate_port ? "ERR\tтурнир запускает координатор кластера\n"
+                                                                 : "ERR\tигра уже идет\n";
         }
+        logger.info(LOG_ADMIN, "[Control] Запуск игры по команде управляющего сокета.");
+        return "OK\n";
+    }
+    if (command == "SHUTDOWN") {
+        logger.info(LOG_ADMIN, "[Control] Остановка сервера по команде управляющего сокета.");
+        shutdown_requested = true;
+        return "OK\n";
+    }
+    return "ERR\tнеизвестная команда " + std::string(command) + "\n";
+}
 
-        size_t colon = addr.find(':');
-        if (colon == std::string::npos) { continue; }
-        std::string ip = addr.substr(0, colon);
-        int port = 0;
-        try { port = std::stoi(addr.substr(colon + 1)); } catch (...) { continue; }
+bool send_control_reply(int fd, const std::string &reply) {
+    for (size_t sent = 0; sent < reply.size();) {
+        ssize_t n = send(fd, reply.data() + sent, reply.size() - sent, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return false;
+        sent += static_cast<size_t>(n);
+    }
+    return true;
+}
 
-        sockaddr_in client_addr{};
-        memset(&client_addr, 0, sizeof(client_addr));
-        client_addr.sin_family = AF_INET;
-        client_addr.sin_port = htons(port);
-        if (inet_pton(AF_INET, ip.c_str(), &client_addr.sin_addr) <= 0) { continue; }
+// Одно соединение управляющего сокета: команды по строкам, ответ на каждую целиком. Сокет
+// неблокирующий: ответы копятся в output и уходят по мере того, как клиент их читает.
+struct ControlConnection {
+    int fd;
+    std::string pending; // принятые байты после последней полной строки
+    std::string output; // ответы, которые сокет еще не принял
+    uint64_t last_active_ms;
+    bool closing = false; // закрыть, когда уйдет output
+};
 
-        ssize_t bytes_sent = sendto(server_socket, message.c_str(), message.size(), 0,
-                                    (sockaddr *) &client_addr, sizeof(client_addr));
-        if (bytes_sent < 0) {
-            // std::cerr << "[Send Participants] Ошибка отправки клиенту " << addr << " (errno: " << errno << ")" << std::endl;
-        } else {
-            sent_count++;
-        }
+// Отправляет из output, сколько примет сокет. false - соединение закрыть.
+bool flush_control_output(ControlConnection &connection) {
+    size_t sent = 0;
+    while (sent < connection.output.size()) {
+        ssize_t n = send(connection.fd, connection.output.data() + sent, connection.output.size() - sent,
+                         MSG_DONTWAIT | MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0 && errno == EAGAIN) break;
+        if (n <= 0) return false;
+        sent += static_cast<size_t>(n);
+        connection.last_active_ms = steady_ms();
     }
-    // std::cout << "[Send Participants] Сообщение отправлено " << sent_count << " активным участникам раунда." << std::endl;
+    connection.output.erase(0, sent);
+    return true;
 }
 
+// Читает команды, выполняет полные строки и отправляет ответы, сколько примет сокет. Пока
+// непрочитанных ответов больше CONTROL_OUTPUT_MAX, новые команды не читаются и не
+// выполняются: клиент, который не читает ответы, не раздувает память сервера и не задерживает
+// остальные соединения. false - соединение закрыть.
+bool serve_control_connection(ControlConnection &connection, short revents) {
+    bool reading = !connection.closing && connection.output.size() < CONTROL_OUTPUT_MAX;
+    if (reading && (revents & (POLLIN | POLLERR | POLLHUP))) {
+        char buffer[1024];
+        ssize_t n = recv(connection.fd, buffer, sizeof(buffer), MSG_DONTWAIT);
+        if (n == 0 || (n < 0 && errno != EINTR && errno != EAGAIN)) return false;
+        if (n > 0) {
+            connection.pending.append(buffer, static_cast<size_t>(n));
+            connection.last_active_ms = steady_ms();
+        }
+    } else if (revents & (POLLERR | POLLHUP)) {
+        return false;
+    }
 
-void determine_winner(std::vector<std::string> &participants) {
-    std::cout << "[Game Logic] Определение победителя раунда..." << std::endl;
-    std::unordered_map<GameChoice, std::vector<std::string> > choice_map;
-    std::string choices_log = "Выборы раунда (от активных): ";
-    std::vector<std::string> actual_participants_this_round; {
-        std::lock_guard<std::mutex> game_lock(game_mutex);
-        std::lock_guard<std::mutex> client_lock(clients_mutex);
-        for (const auto &addr: participants) {
-            if (!clients.count(addr) || !clients[addr].active) {
-                continue;
-            }
-            if (current_choices.count(addr)) {
-                GameChoice choice = current_choices[addr];
-                if (choice != INVALID) {
-                    choice_map[choice].push_back(addr);
-                    choices_log += clients[addr].name + "->" + choice_to_string(choice) + "; ";
-                    actual_participants_this_round.push_back(addr);
-                } else {
-                    std::cout << "[Game Logic] Активный участник " << clients[addr].name << " (" << addr <<
-                            ") сделал невалидный выбор." << std::endl;
-                }
-            } else {
-                std::cout << "[Game Logic] Активный участник " << clients[addr].name << " (" << addr <<
-                        ") не сделал выбор." << std::endl;
-            }
+    bool shutdown_requested = false;
+    for (;;) {
+        size_t newline;
+        while (!connection.closing && !shutdown_requested && connection.output.size() < CONTROL_OUTPUT_MAX &&
+               (newline = connection.pending.find('\n')) != std::string::npos) {
+            std::string_view line(connection.pending.data(), newline);
+            if (!line.empty() && line.back() == '\r') line.remove_suffix(1);
+            connection.output += control_command(line, shutdown_requested);
+            connection.pending.erase(0, newline + 1);
+        }
+        if (!connection.closing && connection.pending.size() > CONTROL_LINE_MAX &&
+            connection.pending.find('\n') == std::string::npos) {
+            connection.output += "ERR\tслишком длинная строка\n";
+            connection.pending.clear();
+            connection.closing = true;
+        }
+        if (!flush_control_output(connection)) return false;
+        // Сокет принял ответы, и в output снова есть место: уже принятые строки выполняются сразу,
+        // новых данных для POLLIN может и не быть.
+        if (shutdown_requested || connection.closing || connection.output.size() >= CONTROL_OUTPUT_MAX ||
+            connection.pending.find('\n') == std::string::npos) {
+            break;
         }
     }
-    std::cout << "[Game Logic] " << choices_log << std::endl;
+    if (shutdown_requested) {
+        handle_signal(0); // остановка - после ответа OK
+        return false;
+    }
+    return !(connection.closing && connection.output.empty());
+}
 
-    if (actual_participants_this_round.empty()) {
-        std::cout << "[Game Logic] Никто из активных участников раунда не сделал валидный выбор." << std::endl;
-        send_to_all_active("НИКТО НЕ СДЕЛАЛ ВЫБОР! Ничья. Новый раунд...");
-        participants.clear();
+// Управляющий сокет: локальный Unix-сокет (права 0600) с машиночитаемыми командами для
+// скриптов и оркестрации. Один poll обслуживает до CONTROL_CONNECTIONS_MAX соединений, так что
+// открытое, но молчащее или не читающее ответы соединение не задерживает команды других;
+// соединение без команд и без чтения ответов дольше CONTROL_IDLE_MS закрывается.
+void serve_control() {
+    const char *path = config.control_path.c_str();
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    sockaddr_un addr{};
+    addr.sun_family = AF_UNIX;
+    memcpy(addr.sun_path, path, config.control_path.size());
+    struct stat existing{};
+    if (lstat(path, &existing) == 0 && S_ISSOCK(existing.st_mode)) unlink(path); // сокет прошлого запуска
+    // Файл сокета сразу создается с правами 0600: chmod после bind оставлял окно, в которое
+    // мог подключиться любой пользователь. umask общий для процесса: файл, созданный другим
+    // потоком в это мгновение, получит права не шире 0600.
+    mode_t mask = umask(0177);
+    bool bound = fd >= 0 && bind(fd, (sockaddr *) &addr, sizeof(addr)) == 0;
+    umask(mask);
+    if (!bound || listen(fd, 8) < 0) {
+        logger.error(LOG_SERVER, "[Control] Не удалось открыть управляющий сокет {} (errno: {})", config.control_path,
+                     errno);
+        if (fd >= 0) close(fd);
         return;
     }
-
-    bool rock = choice_map.count(ROCK);
-    bool paper = choice_map.count(PAPER);
-    bool scissors = choice_map.count(SCISSORS);
-    int valid_choices_type_count = (rock ? 1 : 0) + (paper ? 1 : 0) + (scissors ? 1 : 0);
-
-    std::vector<std::string> winners;
-    std::string round_result_msg;
-
-    if (valid_choices_type_count == 3 || valid_choices_type_count == 1) {
-        round_result_msg = "НИЧЬЯ! Новый раунд...";
-        participants = actual_participants_this_round;
-    } else if (valid_choices_type_count == 2) {
-        if (rock && scissors) {
-            winners = choice_map[ROCK];
-            round_result_msg = "Камень бьет ножницы!";
-        } else if (paper && rock) {
-            winners = choice_map[PAPER];
-            round_result_msg = "Бумага покрывает камень!";
-        } else if (scissors && paper) {
-            winners = choice_map[SCISSORS];
-            round_result_msg = "Ножницы режут бумагу!";
-        } else {
-            round_result_msg = "НИЧЬЯ (неожиданно)! Новый раунд...";
-            participants = actual_participants_this_round;
+    logger.info(LOG_SERVER, "[Control] Управляющий сокет: {}", config.control_path);
+    std::vector<ControlConnection> connections;
+    std::vector<pollfd> fds;
+    while (server_running) {
+        fds.assign(1, pollfd{fd, POLLIN, 0});
+        for (const ControlConnection &connection: connections) {
+            short events = !connection.closing && connection.output.size() < CONTROL_OUTPUT_MAX ? POLLIN : 0;
+            if (!connection.output.empty()) events |= POLLOUT;
+            fds.push_back({connection.fd, events, 0});
         }
-        participants = winners;
-    } else {
-        round_result_msg = "НИЧЬЯ (ошибка логики)! Новый раунд...";
-        participants = actual_participants_this_round;
+        if (poll(fds.data(), fds.size(), 200) < 0 && errno != EINTR) break; // 200 мс - чтобы заметить остановку
+        uint64_t now = steady_ms();
+        for (size_t i = 0; i < connections.size(); ++i) {
+            ControlConnection &connection = connections[i];
+            bool keep = now - connection.last_active_ms < CONTROL_IDLE_MS;
+            if (keep && fds[i + 1].revents) keep = serve_control_connection(connection, fds[i + 1].revents);
+            if (!keep) {
+                close(connection.fd);
+                connection.fd = -1;
+            }
+        }
+        connections.erase(std::remove_if(connections.begin(), connections.end(),
+                                         [](const ControlConnection &connection) { return connection.fd < 0; }),
+                          connections.end());
+        if (!(fds[0].revents & POLLIN)) continue;
+        int accepted = accept4(fd, nullptr, nullptr, SOCK_CLOEXEC | SOCK_NONBLOCK);
+        if (accepted < 0) continue;
+        if (connections.size() >= CONTROL_CONNECTIONS_MAX) {
+            send_control_reply(accepted, "ERR\tслишком много соединений\n"); // в пустой буфер сокета
+            close(accepted);
+            continue;
+        }
+        connections.push_back({accepted, {}, {}, now});
     }
-
-    std::cout << "[Game Logic] Результат раунда: " << round_result_msg << ". Следующий раунд с " << participants.size()
-            << " участниками." << std::endl;
-    send_to_all_active(round_result_msg);
+    for (const ControlConnection &connection: connections) close(connection.fd);
+    close(fd);
+    unlink(path);
 }
 
-
-void game_round(std::vector<std::string> &participants) {
-    if (!server_running) return;
-    std::cout << "[Game Round] Начало раунда для " << participants.size() << " участников." << std::endl; {
-        std::lock_guard<std::mutex> lock(game_mutex);
-        current_choices.clear();
+// Поля строки команды кластера, разделенные табуляцией.
+std::vector<std::string_view> split_fields(std::string_view line) {
+    std::vector<std::string_view> fields;
+    for (size_t begin = 0;;) {
+        size_t tab = line.find('\t', begin);
+        fields.push_back(line.substr(begin, tab == std::string_view::npos ? std::string_view::npos : tab - begin));
+        if (tab == std::string_view::npos) return fields;
+        begin = tab + 1;
     }
+}
 
-    send_to_participants("CHOOSE", participants);
-
-    std::cout << "[Game Round] Ожидание выборов " << GAME_TIMEOUT << " секунд..." << std::endl;
-    auto start_time = std::chrono::steady_clock::now();
-
-    size_t expected_choices_count = 0; {
-        std::lock_guard<std::mutex> lock(clients_mutex);
-        for (const auto &p_addr: participants) {
-            if (clients.count(p_addr) && clients[p_addr].active) {
-                expected_choices_count++;
+// Связь шарда с координатором кластера: TCP-соединение со строковыми командами, как у
+// управляющего сокета. Поток связи переподключается к координатору, принимает команды и
+// передает их матчу шарда; ответы (COUNTS, KEPT) отправляют потоки матчей через send().
+// Порядок блокировок: match_mutex_, затем мьютекс матча и планировщика.
+class ClusterLink {
+public:
+    void run() {
+        while (server_running) {
+            int fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+            if (fd < 0 || connect(fd, (sockaddr *) &config.coordinator, sizeof(config.coordinator)) < 0) {
+                if (fd >= 0) close(fd);
+                for (int waited = 0; waited < CLUSTER_RECONNECT_MS && server_running; waited += 100) {
+                    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+                }
+                continue;
+            }
+            int one = 1;
+            setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+            {
+                std::lock_guard<std::mutex> lock(send_mutex_);
+                fd_ = fd;
             }
+            logger.info(LOG_SERVER, "[Cluster] Узел {} подключен к координатору {}.", config.cluster_index,
+                        config.coordinator);
+            send("HELLO\t" + std::to_string(config.cluster_index) + "\n");
+            serve(fd);
+            {
+                std::lock_guard<std::mutex> lock(send_mutex_);
+                fd_ = -1;
+            }
+            close(fd);
+            if (server_running) logger.warn(LOG_SERVER, "[Cluster] Связь с координатором потеряна.");
+            // Без координатора турнир не закончить: матч шарда завершается сам.
+            finish_match({wire::RESULT_ABORTED, {}, {}, true});
         }
     }
-    std::cout << "[Game Round] Ожидается выборов от " << expected_choices_count << " активных участников." << std::endl;
 
+    // Строка координатору; без соединения теряется - координатор исключит шард по таймауту.
+    void send(const std::string &line) {
+        std::lock_guard<std::mutex> lock(send_mutex_);
+        if (fd_ >= 0 && !send_control_reply(fd_, line)) shutdown(fd_, SHUT_RDWR);
+    }
 
-    while (std::chrono::steady_clock::now() - start_time < std::chrono::seconds(GAME_TIMEOUT)) {
-        if (!server_running) return;
+    void match_finished() {
+        std::lock_guard<std::mutex> lock(match_mutex_);
+        match_ = nullptr;
+    }
 
-        size_t current_choice_count = 0; {
-            std::lock_guard<std::mutex> game_lock(game_mutex);
-            std::lock_guard<std::mutex> client_lock(clients_mutex);
-            for (const auto &p_addr: participants) {
-                if (clients.count(p_addr) && clients[p_addr].active &&
-                    current_choices.count(p_addr) && current_choices[p_addr] != INVALID) {
-                    current_choice_count++;
-                }
+private:
+    void serve(int fd) {
+        std::string pending;
+        char buffer[4096];
+        while (server_running) {
+            for (size_t newline; (newline = pending.find('\n')) != std::string::npos;) {
+                handle(std::string_view(pending.data(), newline));
+                pending.erase(0, newline + 1);
             }
+            pollfd in{fd, POLLIN, 0};
+            int ready = poll(&in, 1, 200);
+            if (ready < 0 && errno != EINTR) return;
+            if (ready <= 0) continue;
+            ssize_t n = recv(fd, buffer, sizeof(buffer), 0);
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) return;
+            pending.append(buffer, static_cast<size_t>(n));
         }
+    }
 
-
-        if (expected_choices_count > 0 && current_choice_count >= expected_choices_count) {
-            // std::cout << "[Game Round] Все " << expected_choices_count << " ожидаемых участников сделали выбор." << std::endl;
-            break;
+    void handle(std::string_view line) {
+        std::vector<std::string_view> fields = split_fields(line);
+        std::string_view command = fields[0];
+        uint32_t number = 0;
+        if (command == "BEGIN" && fields.size() == 2 && parse_control_number(fields[1], number)) {
+            begin(fields[1]);
+        } else if (command == "START" && fields.size() == 2 && parse_control_number(fields[1], number)) {
+            logger.info(LOG_GAME, "[Cluster] Игра начинается! Участников в кластере: {}", number);
+            send_to_all_active(make_notice(wire::RESULT_GAME_START, "ИГРА НАЧИНАЕТСЯ! Участников: " +
+                                                                    std::to_string(number), 0, number));
+        } else if (command == "ROUND" && fields.size() == 2 && parse_control_number(fields[1], number)) {
+            with_match([&](Match &match) { match.remote_round(number); });
+        } else if (command == "VERDICT" && fields.size() == 5 && parse_control_number(fields[1], number)) {
+            uint32_t keep = 0, result = 0, remaining = 0;
+            if (!parse_control_number(fields[2], keep) || !parse_control_number(fields[3], result) ||
+                !parse_control_number(fields[4], remaining)) {
+                return;
+            }
+            RoundVerdict verdict{keep, static_cast<wire::ResultKind>(result)};
+            with_match([&](Match &match) { match.remote_verdict(number, verdict, remaining); });
+        } else if (command == "FINISH" && fields.size() >= 2 && parse_control_number(fields[1], number)) {
+            finish_match({static_cast<wire::ResultKind>(number), std::string(fields.size() > 2 ? fields[2] : ""),
+                          std::string(fields.size() > 3 ? fields[3] : ""), true});
+        } else if (command == "CANCEL") {
+            finish_match({wire::RESULT_NO_WINNER, {}, {}, false});
+        } else {
+            logger.warn(LOG_SERVER, "[Cluster] Неизвестная команда координатора: {}", line);
         }
-        usleep(100000);
     }
 
-    if (std::chrono::steady_clock::now() - start_time >= std::chrono::seconds(GAME_TIMEOUT)) {
-        std::cout << "[Game Round] Время ожидания выборов (" << GAME_TIMEOUT << "с) истекло." << std::endl;
+    // Новый турнир: матч из всех активных клиентов узла; координатор узнает их число из READY.
+    void begin(std::string_view tournament) {
+        auto matches = prepare_cluster_match();
+        if (matches.empty()) {
+            send("BUSY\t" + std::string(tournament) + "\n");
+            return;
+        }
+        size_t participants = matches.front()->members.size();
+        {
+            std::lock_guard<std::mutex> lock(match_mutex_);
+            match_ = matches.front().get();
+        }
+        if (config.engine == Engine::REACTOR) {
+            auto holder = std::make_shared<std::vector<std::unique_ptr<Match> > >(std::move(matches));
+            reactor.post([holder] { reactor.start_matches(std::move(*holder)); });
+        } else {
+            auto holder = std::make_shared<std::vector<std::unique_ptr<Match> > >(std::move(matches));
+            game_thread.start([holder] {
+                auto started = std::chrono::steady_clock::now();
+                scheduler.run(*holder, 1);
+                finish_tournament(*holder, std::chrono::steady_clock::now() - started);
+            }, true);
+        }
+        send("READY\t" + std::string(tournament) + "\t" + std::to_string(participants) + "\n");
     }
 
-    determine_winner(participants);
-}
-
-void start_game() {
-    if (!server_running) return;
-    std::cout << "[Game Manager] Попытка начать игру..." << std::endl;
+    void finish_match(ClusterFinish finish) {
+        with_match([&](Match &match) { match.remote_finish(std::move(finish)); });
+    }
 
-    if (game_running) {
-        std::cout << "[Game Manager] Игра уже активна." << std::endl;
-        return;
+    // Команда матчу шарда и его пробуждение. В реакторе матч будит поток реактора, поэтому
+    // указатель проверяется еще раз уже там: матч мог завершиться до выполнения задачи.
+    template<typename F>
+    void with_match(F &&command) {
+        std::lock_guard<std::mutex> lock(match_mutex_);
+        if (!match_) return;
+        command(*match_);
+        if (config.engine == Engine::REACTOR) {
+            reactor.post([this] {
+                std::lock_guard<std::mutex> inner(match_mutex_);
+                if (match_) reactor.wake(match_);
+            });
+        } else {
+            scheduler.wake(match_);
+        }
     }
 
-    std::vector<std::string> participants;
-    int active_clients_count = 0; {
-        std::lock_guard<std::mutex> lock(clients_mutex);
-        for (const auto &[addr, client]: clients) {
-            if (client.active) {
-                participants.push_back(addr);
-                active_clients_count++;
+    std::mutex send_mutex_;
+    int fd_ = -1;
+    std::mutex match_mutex_;
+    Match *match_ = nullptr;
+};
+
+ClusterLink cluster_link;
+
+void cluster_send(const std::string &line) { cluster_link.send(line); }
+
+void cluster_match_finished() { cluster_link.match_finished(); }
+
+// Координатор кластера: ведет турнир по всем шардам. Шарды подключаются по TCP и получают
+// команды строками. На раунд с каждым шардом - четыре коротких сообщения (ROUND, COUNTS,
+// VERDICT, KEPT), так что трафик между узлами растет с числом шардов, а не клиентов.
+// Шард, не ответивший за CLUSTER_REPLY_MS сверх срока раунда или потерявший связь,
+// выбывает из турнира вместе со своими участниками. Все состояние - в одном потоке.
+class Coordinator {
+public:
+    bool request_start() { return !active_.exchange(true); }
+
+    bool active() const { return active_; }
+
+    void run() {
+        int listener = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        sockaddr_in addr{};
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons(config.coordinate_port);
+        addr.sin_addr.s_addr = htonl(INADDR_ANY);
+        int one = 1;
+        if (listener >= 0) setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+        if (listener < 0 || bind(listener, (sockaddr *) &addr, sizeof(addr)) < 0 || listen(listener, 64) < 0) {
+            logger.error(LOG_SERVER, "[Coordinator] Не удалось открыть TCP-порт {} (errno: {})", config.coordinate_port,
+                         errno);
+            if (listener >= 0) close(listener);
+            return;
+        }
+        logger.info(LOG_SERVER, "[Coordinator] Координатор кластера на TCP-порту {}, узлов: {}.",
+                    config.coordinate_port, config.cluster_nodes.size());
+        std::vector<pollfd> fds;
+        while (server_running) {
+            fds.assign(1, pollfd{listener, POLLIN, 0});
+            for (const Shard &shard: shards_) fds.push_back({shard.fd, POLLIN, 0});
+            int ready = poll(fds.data(), fds.size(), 100);
+            if (ready < 0 && errno != EINTR) break;
+            if (ready > 0) {
+                for (size_t i = 1; i < fds.size(); ++i) {
+                    if (fds[i].revents & (POLLIN | POLLERR | POLLHUP)) receive(fds[i].fd);
+                }
+                if (fds[0].revents & POLLIN) accept_shard(listener);
+                shards_.erase(std::remove_if(shards_.begin(), shards_.end(), [](const Shard &shard) {
+                    return shard.fd < 0;
+                }), shards_.end());
             }
+            tick();
         }
+        if (phase_ != Phase::IDLE) end(wire::RESULT_ABORTED, "остановка координатора");
+        for (Shard &shard: shards_) close(shard.fd);
+        close(listener);
     }
 
-    if (active_clients_count < 2) {
-        std::cout << "[Game Manager] Для игры нужно минимум 2 активных участника! Сейчас: "
-                << active_clients_count << "\n";
-        return;
+private:
+    enum class Phase { IDLE, READY, COUNTS, KEPT, PAUSE };
+
+    struct Shard {
+        int fd = -1;
+        int index = -1; // номер узла из HELLO
+        std::string pending;
+        bool playing = false; // участвует в текущем турнире
+        bool replied = false; // ответил в текущей фазе
+        size_t participants = 0;
+        ChoiceCounts counts;
+        std::string winner, winner_addr;
+    };
+
+    void accept_shard(int listener) {
+        int fd = accept4(listener, nullptr, nullptr, SOCK_CLOEXEC);
+        if (fd < 0) return;
+        int one = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        timeval timeout{1, 0}; // шард, который не читает команды, не держит координатор
+        setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+        Shard shard;
+        shard.fd = fd;
+        shards_.push_back(std::move(shard));
     }
 
-    std::cout << "[Game Manager] Игра начинается! Активных участников: " << active_clients_count << std::endl;
-    send_to_all_active("ИГРА НАЧИНАЕТСЯ! Участников: " + std::to_string(participants.size()));
-    game_running = true;
-
-    while (participants.size() > 1 && server_running && game_running) {
-        {
-            std::lock_guard<std::mutex> lock(clients_mutex);
-            participants.erase(std::remove_if(participants.begin(), participants.end(),
-                                              [&](const std::string &addr) {
-                                                  return !clients.count(addr) || !clients[addr].active;
-                                              }),
-                               participants.end());
-        }
-        if (participants.size() < 2) {
-            std::cout << "[Game Manager] Недостаточно активных участников (" << participants.size() <<
-                    ") для продолжения игры." << std::endl;
-            if (!participants.empty()) {
-                break;
-            } else {
-                send_to_all_active("Все участники выбыли или стали неактивны!");
-                game_running = false;
-                std::cout << "[Game Manager] Поток игры завершен (нет активных)." << std::endl;
-                std::cout <<
-                        "\n[Admin] Команды: \n 1:Железо \n 2:Имена(все) \n 3:Игра \n 4:Откл(активных) \n 5:Статус(все) \n 6:Активные \n 7:Выход > "
-                        << std::flush;
-                return;
-            }
+    void receive(int fd) {
+        auto it = std::find_if(shards_.begin(), shards_.end(), [&](const Shard &shard) { return shard.fd == fd; });
+        if (it == shards_.end()) return;
+        char buffer[4096];
+        ssize_t n = recv(fd, buffer, sizeof(buffer), MSG_DONTWAIT);
+        if (n < 0 && (errno == EINTR || errno == EAGAIN)) return;
+        if (n <= 0 || it->pending.size() > CONTROL_LINE_MAX) {
+            drop(*it, "соединение закрыто");
+            return;
+        }
+        received_bytes_ += static_cast<size_t>(n);
+        it->pending.append(buffer, static_cast<size_t>(n));
+        for (size_t newline; it->fd >= 0 && (newline = it->pending.find('\n')) != std::string::npos;) {
+            std::string line = it->pending.substr(0, newline);
+            it->pending.erase(0, newline + 1);
+            received_messages_++;
+            handle(*it, split_fields(line));
         }
+    }
 
-        game_round(participants);
-        if (!server_running || !game_running) break;
-        if (participants.size() > 1) {
-            std::cout << "[Game Manager] Пауза 1 секунду перед следующим раундом..." << std::endl;
-            sleep(1);
+    void handle(Shard &shard, const std::vector<std::string_view> &fields) {
+        uint32_t values[5] = {};
+        size_t numbers = 0;
+        for (size_t i = 1; i < fields.size() && numbers < 5 && parse_control_number(fields[i], values[numbers]); ++i) {
+            numbers++;
+        }
+        std::string_view command = fields[0];
+        if (command == "HELLO" && numbers == 1) {
+            // Переподключившийся узел заменяет прежнее соединение.
+            for (Shard &other: shards_) {
+                if (&other != &shard && other.fd >= 0 && other.index == static_cast<int>(values[0])) {
+                    drop(other, "узел переподключился");
+                }
+            }
+            shard.index = static_cast<int>(values[0]);
+            logger.info(LOG_SERVER, "[Coordinator] Подключен узел {}, всего узлов: {}.", shard.index, shards_.size());
+        } else if (command == "READY" && numbers == 2 && phase_ == Phase::READY && values[0] == tournament_) {
+            shard.participants = values[1];
+            shard.replied = true;
+        } else if (command == "BUSY" && numbers == 1 && phase_ == Phase::READY && values[0] == tournament_) {
+            logger.warn(LOG_GAME, "[Coordinator] На узле {} уже идет игра, он не участвует в турнире.", shard.index);
+            shard.playing = false;
+        } else if (command == "COUNTS" && numbers == 5 && phase_ == Phase::COUNTS && values[0] == round_) {
+            shard.counts = ChoiceCounts{values[1], values[2], values[3], values[4]};
+            shard.replied = true;
+        } else if (command == "KEPT" && numbers >= 2 && phase_ == Phase::KEPT && values[0] == round_) {
+            shard.participants = values[1];
+            if (fields.size() >= 5) {
+                shard.winner = std::string(fields[3]);
+                shard.winner_addr = std::string(fields[4]);
+            }
+            shard.replied = true;
         }
     }
 
-    if (!server_running) {
-        std::cout << "[Game Manager] Игра прервана из-за остановки сервера." << std::endl;
-        send_to_all_active("ИГРА ПРЕРВАНА ИЗ-ЗА ОСТАНОВКИ СЕРВЕРА!");
-    } else if (!participants.empty()) {
-        std::string winner_name = "Неизвестный"; {
-            std::lock_guard<std::mutex> lock(clients_mutex);
-            if (clients.count(participants[0])) { winner_name = clients[participants[0]].name; }
-        }
-        std::string final_msg = "ИГРА ОКОНЧЕНА! ПОБЕДИТЕЛЬ: " + winner_name + " (" + participants[0] + ")!!!";
-        std::cout << "[Game Manager] " << final_msg << std::endl;
-        send_to_all_active(final_msg);
-    } else {
-        std::string final_msg = "ИГРА ОКОНЧЕНА! Победителя нет.";
-        std::cout << "[Game Manager] " << final_msg << std::endl;
-        send_to_all_active(final_msg);
+    void drop(Shard &shard, const char *reason) {
+        if (shard.fd < 0) return;
+        logger.warn(LOG_SERVER, "[Coordinator] Узел {} отключен: {}.", shard.index, reason);
+        close(shard.fd);
+        shard.fd = -1;
+        shard.playing = false;
     }
 
-    game_running = false;
-    std::cout << "[Game Manager] Поток игры завершен." << std::endl;
-    std::cout <<
-            "\n[Admin] Команды: \n 1:Железо \n 2:Имена(все) \n 3:Игра \n 4:Откл(активных) \n 5:Статус(все) \n 6:Активные \n 7:Выход > "
-            << std::flush;
-}
+    void send(Shard &shard, const std::string &line) {
+        if (shard.fd < 0) return;
+        if (!send_control_reply(shard.fd, line)) {
+            drop(shard, "ошибка отправки");
+            return;
+        }
+        sent_messages_++;
+        sent_bytes_ += line.size();
+    }
 
-void handle_commands() {
-    std::cout << "[Admin Thread] Поток обработки команд запущен. Введите команду." << std::endl;
-    std::string cmd;
-    while (server_running) {
-        std::cout <<
-                "\n[Admin] Команды: \n 1:Железо \n 2:Имена(все) \n 3:Игра \n 4:Откл(активных) \n 5:Статус(все) \n 6:Активные \n 7:Выход > "
-                << std::flush;
+    void broadcast(const std::string &line) {
+        for (Shard &shard: shards_) {
+            if (shard.playing) send(shard, line);
+        }
+    }
 
-        if (!std::getline(std::cin, cmd)) {
-            if (server_running) {
-                std::cerr << "[Admin Thread] Ошибка чтения команды из stdin (EOF или ошибка). Завершение потока." <<
-                        std::endl;
+    // Переход к следующей фазе, когда ответили все шарды турнира или истек срок.
+    // Не ответившие к сроку шарды выбывают из турнира.
+    void tick() {
+        auto now = std::chrono::steady_clock::now();
+        if (phase_ == Phase::IDLE) {
+            if (active_) begin(now);
+            return;
+        }
+        bool all = phase_ != Phase::PAUSE;
+        for (const Shard &shard: shards_) {
+            if (shard.playing && !shard.replied) all = false;
+        }
+        if (!all && now < deadline_) return;
+        for (Shard &shard: shards_) {
+            if (shard.playing && !shard.replied && phase_ != Phase::PAUSE) {
+                logger.warn(LOG_GAME, "[Coordinator] Узел {} не ответил вовремя и выбывает из турнира.", shard.index);
+                shard.playing = false;
             }
-            break;
         }
-        if (!server_running) break;
-
-        cmd.erase(0, cmd.find_first_not_of(" \t\n\r"));
-        cmd.erase(cmd.find_last_not_of(" \t\n\r") + 1);
-
-        if (cmd == "1") {
-            std::lock_guard<std::mutex> lock(clients_mutex);
-            std::cout << "\n[Admin] Информация об оборудовании клиентов:\n";
-            if (clients.empty()) { std::cout << "  <Нет зарегистрированных клиентов>\n"; } else {
-                for (const auto &[addr, client]: clients) {
-                    std::cout << "  " << client.name << " (" << addr << ", " << (
-                        client.active ? "Активен" : "Неактивен") << "): " << client.hardware << std::endl;
+        switch (phase_) {
+            case Phase::READY: {
+                size_t total = participants();
+                if (total < 2) {
+                    logger.info(LOG_GAME, "[Coordinator] Для игры нужно минимум 2 активных участника! Сейчас: {}",
+                                total);
+                    broadcast("CANCEL\n");
+                    end(wire::RESULT_NO_WINNER, nullptr);
+                    return;
                 }
+                logger.info(LOG_GAME, "[Coordinator] Игра начинается! Участников в кластере: {}, узлов: {}", total,
+                            playing());
+                broadcast("START\t" + std::to_string(total) + "\n");
+                next_round(now);
+                break;
             }
-        } else if (cmd == "2") {
-            std::lock_guard<std::mutex> lock(clients_mutex);
-            std::cout << "\n[Admin] Имена клиентов (статус):\n";
-            if (clients.empty()) { std::cout << "  <Нет зарегистрированных клиентов>\n"; } else {
-                for (const auto &[addr, client]: clients) {
-                    std::cout << "  " << client.name << (client.active ? " (активен)" : " (неактивен)") << std::endl;
+            case Phase::COUNTS: {
+                ChoiceCounts total;
+                for (const Shard &shard: shards_) {
+                    if (!shard.playing) continue;
+                    total.rock += shard.counts.rock;
+                    total.paper += shard.counts.paper;
+                    total.scissors += shard.counts.scissors;
+                    total.pending += shard.counts.pending;
                 }
+                RoundVerdict verdict = decide_round(total);
+                size_t remaining = kept_count(total, verdict.keep);
+                const char *message = round_message(verdict.result);
+                logger.info(LOG_GAME, "[Coordinator] Раунд {}: Камень {}, Бумага {}, Ножницы {}, без выбора {} -> {}",
+                            round_, total.rock, total.paper, total.scissors, total.pending,
+                            message ? message : "никто не сделал выбор");
+                broadcast("VERDICT\t" + std::to_string(round_) + "\t" + std::to_string(verdict.keep) + "\t" +
+                          std::to_string(verdict.result) + "\t" + std::to_string(remaining) + "\n");
+                enter(Phase::KEPT, now + std::chrono::milliseconds(CLUSTER_REPLY_MS));
+                break;
             }
-        } else if (cmd == "3") {
-            if (game_running) { std::cout << "[Admin] Игра уже идет." << std::endl; } else {
-                std::cout << "[Admin] Запуск игры в отдельном потоке..." << std::endl;
-                std::thread(start_game).detach();
-            }
-        } else if (cmd == "4") {
-            std::cout << "[Admin] Отправка команды SHUTDOWN всем АКТИВНЫМ клиентам..." << std::endl;
-            send_to_all_active("SHUTDOWN");
-        } else if (cmd == "5") {
-            std::lock_guard<std::mutex> lock(clients_mutex);
-            std::cout << "\n[Admin] Список зарегистрированных клиентов и их статус:\n";
-            std::cout << "--------------------------------\n";
-            if (clients.empty()) { std::cout << "  <Нет зарегистрированных клиентов>\n"; } else {
-                for (const auto &[addr, client]: clients) {
-                    std::cout << "  Адрес: " << addr << "\n  Имя: " << client.name
-                            << "\n  Железо: " << client.hardware
-                            << "\n  Статус: " << (client.active ? "Активен" : "Неактивен")
-                            << "\n  Посл. сообщ.: " << std::put_time(std::localtime(&client.last_seen),
-                                                                     "%Y-%m-%d %H:%M:%S")
-                            << "\n--------------------------------\n";
+            case Phase::KEPT: {
+                size_t total = participants();
+                if (total >= 2) {
+                    phase_ = Phase::PAUSE;
+                    deadline_ = now + std::chrono::seconds(1);
+                    break;
                 }
-            }
-        } else if (cmd == "6") {
-            std::lock_guard<std::mutex> lock(clients_mutex);
-            std::cout << "\n[Admin] Список АКТИВНЫХ клиентов:\n";
-            int active_count = 0;
-            for (const auto &[addr, client]: clients) {
-                if (client.active) {
-                    std::cout << "  - " << client.name << " (" << addr << ")" << std::endl;
-                    active_count++;
+                if (total == 1) {
+                    auto winner = std::find_if(shards_.begin(), shards_.end(), [](const Shard &shard) {
+                        return shard.playing && shard.participants == 1;
+                    });
+                    logger.info(LOG_GAME, "[Coordinator] ИГРА ОКОНЧЕНА! ПОБЕДИТЕЛЬ: {} ({}) на узле {}!!!",
+                                winner->winner, winner->winner_addr, winner->index);
+                    broadcast("FINISH\t" + std::to_string(wire::RESULT_WINNER) + "\t" + winner->winner + "\t" +
+                              winner->winner_addr + "\n");
+                    end(wire::RESULT_WINNER, nullptr);
+                } else {
+                    broadcast("FINISH\t" + std::to_string(wire::RESULT_ALL_OUT) + "\n");
+                    end(wire::RESULT_ALL_OUT, nullptr);
                 }
+                break;
             }
-            if (active_count == 0) {
-                std::cout << "  <Нет активных клиентов>\n";
-            } else {
-                std::cout << "  Всего активных: " << active_count << std::endl;
-            }
-        } else if (cmd == "7") {
-            std::cout << "[Admin] Команда на выход, инициируем остановку сервера..." << std::endl;
-            handle_signal(0);
-        } else {
-            std::cout << "[Admin] Неизвестная команда." << std::endl;
+            case Phase::PAUSE:
+                next_round(now);
+                break;
+            case Phase::IDLE:
+                break;
         }
     }
-    std::cout << "[Admin Thread] Поток обработки команд завершен." << std::endl;
-}
 
+    void begin(SteadyTime now) {
+        tournament_++;
+        round_ = 0;
+        started_ = now;
+        sent_messages_ = received_messages_ = sent_bytes_ = received_bytes_ = 0;
+        for (Shard &shard: shards_) {
+            shard.playing = shard.index >= 0;
+            shard.participants = 0;
+        }
+        if (playing() == 0) {
+            logger.info(LOG_GAME, "[Coordinator] Нет подключенных узлов, игра не начата.");
+            active_ = false;
+            return;
+        }
+        logger.info(LOG_GAME, "[Coordinator] Турнир {} на {} узлах из {}.", tournament_, playing(),
+                    config.cluster_nodes.size());
+        broadcast("BEGIN\t" + std::to_string(tournament_) + "\n");
+        enter(Phase::READY, now + std::chrono::milliseconds(CLUSTER_REPLY_MS));
+    }
 
-int main() {
-    std::cout << "[Server Main] Запуск сервера на порту " << PORT << "..." << std::endl;
-    signal(SIGINT, handle_signal);
-    signal(SIGTERM, handle_signal);
-
-    server_socket = socket(AF_INET, SOCK_DGRAM, 0);
-    if (server_socket < 0) {
-        perror("[Server Main] Ошибка создания серверного сокета");
-        return 1;
+    void next_round(SteadyTime now) {
+        round_++;
+        for (Shard &shard: shards_) shard.counts = {};
+        broadcast("ROUND\t" + std::to_string(round_) + "\n");
+        enter(Phase::COUNTS, now + std::chrono::seconds(GAME_TIMEOUT) + std::chrono::milliseconds(CLUSTER_REPLY_MS));
     }
-    std::cout << "[Server Main] Серверный сокет создан." << std::endl;
 
-    sockaddr_in server_addr{};
-    memset(&server_addr, 0, sizeof(server_addr));
-    server_addr.sin_family = AF_INET;
-    server_addr.sin_port = htons(PORT);
-    server_addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    void enter(Phase phase, SteadyTime deadline) {
+        phase_ = phase;
+        deadline_ = deadline;
+        for (Shard &shard: shards_) shard.replied = false;
+    }
 
-    int reuse = 1;
-    if (setsockopt(server_socket, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse)) < 0) {
-        perror("[Server Main] setsockopt(SO_REUSEADDR) failed");
+    // reason != nullptr - турнир прерван; шардам уходит FINISH с RESULT_ABORTED.
+    void end(wire::ResultKind result, const char *reason) {
+        if (reason) {
+            logger.warn(LOG_GAME, "[Coordinator] Турнир прерван: {}.", reason);
+            broadcast("FINISH\t" + std::to_string(wire::RESULT_ABORTED) + "\n");
+        }
+        if (result != wire::RESULT_NO_WINNER || round_ > 0) {
+            double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - started_).count();
+            logger.info(LOG_GAME, "[Coordinator] Турнир завершен: раундов {}, за {} с; сообщений узлам {} ({} байт), "
+                        "от узлов {} ({} байт).", round_, elapsed, sent_messages_, sent_bytes_, received_messages_,
+                        received_bytes_);
+        }
+        for (Shard &shard: shards_) shard.playing = false;
+        phase_ = Phase::IDLE;
+        active_ = false;
     }
 
+    size_t participants() const {
+        size_t total = 0;
+        for (const Shard &shard: shards_) total += shard.playing ? shard.participants : 0;
+        return total;
+    }
 
-    if (bind(server_socket, (sockaddr *) &server_addr, sizeof(server_addr)) < 0) {
-        perror("[Server Main] Ошибка привязки серверного сокета");
-        close(server_socket);
-        return 1;
+    size_t playing() const {
+        return std::count_if(shards_.begin(), shards_.end(), [](const Shard &shard) { return shard.playing; });
     }
-    std::cout << "[Server Main] Серверный сокет привязан к порту " << PORT << "." << std::endl;
 
-    std::thread update_thread(update_clients);
-    std::thread command_thread(handle_commands);
+    std::atomic<bool> active_{false}; // турнир запрошен или идет
+    std::vector<Shard> shards_;
+    Phase phase_ = Phase::IDLE;
+    SteadyTime deadline_{};
+    SteadyTime started_{};
+    uint32_t tournament_ = 0;
+    uint32_t round_ = 0;
+    size_t sent_messages_ = 0, received_messages_ = 0, sent_bytes_ = 0, received_bytes_ = 0;
+};
 
-    std::cout << "[Server Main] Сервер готов к приему сообщений..." << std::endl;
+Coordinator coordinator;
 
-    char buffer[1024];
-    sockaddr_in client_addr{};
-    socklen_t addr_len = sizeof(client_addr);
+bool coordinator_start() { return coordinator.request_start(); }
 
-    while (server_running) {
-        memset(&client_addr, 0, sizeof(client_addr));
-        addr_len = sizeof(client_addr);
+// Теплый перезапуск: клиенты из файла реестра возвращаются в шарды до начала приема, так что
+// их PING сразу узнаются без повторной регистрации. Каждый восстановленный клиент получает
+// полный TIMEOUT на первый PING; неактивные остаются неактивными, пока не пришлют PING.
+// Подтверждения multicast сохраняются, только если группа не изменилась.
+bool restore_registry() {
+    uint64_t group = config.multicast ? pack_addr(config.multicast_group) : 0;
+    if (!registry_file.open(config.registry_path, config.registry_capacity, group)) {
+        logger.error(LOG_SERVER, "[Registry] Не удалось открыть файл реестра {} (errno: {})", config.registry_path,
+                     errno);
+        return false;
+    }
+    bool same_group = registry_file.previous_context() == group;
+    auto started = std::chrono::steady_clock::now();
+    uint64_t deadline = steady_ms() + TIMEOUT * 1000;
+    size_t active = 0;
+    size_t restored = registry_file.load([&](uint32_t slot, const PersistedClient &record) {
+        ClientShard &shard = *shards[shard_index(record.key)];
+        auto [index, is_new] = shard.ids.try_emplace(record.key, shard.size());
+        if (!is_new) return;
+        uint8_t flags = (record.active ? CLIENT_ACTIVE : 0) | (same_group && record.multicast ? CLIENT_MULTICAST : 0) |
+                        (record.protocol == wire::VERSION ? CLIENT_V2 : 0);
+        ClientCold cold{profiles.intern_name(RegistryFile::get_text(record.name, sizeof(record.name))),
+                        profiles.intern_hardware(RegistryFile::get_text(record.hardware, sizeof(record.hardware))),
+                        record.inactive_since_ms, slot};
+        shard.add(record.key, static_cast<uint32_t>(record.last_seen), flags, ClientSession{}, cold);
+        shard.version++;
+        registered_clients++;
+        if (flags & CLIENT_ACTIVE) {
+            shard.liveness.schedule(*index, deadline);
+            active++;
+        }
+    });
+    logger.info(LOG_SERVER, "[Registry] Файл реестра {}: восстановлено клиентов {} (активных {}) за {} мс, емкость {}.",
+                config.registry_path, restored, active,
+                std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - started).count(),
+                registry_file.capacity());
+    return true;
+}
+
+void pin_to_cpu(unsigned index) {
+    unsigned cpus = std::max(1u, std::thread::hardware_concurrency());
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(index % cpus, &set);
+    int err = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+    if (err != 0) {
+        logger.warn(LOG_SERVER, "[Recv Thread {}] Не удалось закрепить поток за CPU {} (errno: {})", index, index % cpus,
+                    err);
+    }
+}
+
+// Цикл приема на сокете server_sockets[index]; поток 0 - основной поток сервера.
+void receive_loop(unsigned index) {
+    if (config.pin_cpus) pin_to_cpu(index);
+    int fd = server_sockets[index];
+    RecvRing ring(config.recv_batch);
 
-        ssize_t len = recvfrom(server_socket, buffer, sizeof(buffer) - 1, 0,
-                               (sockaddr *) &client_addr, &addr_len);
+    while (server_running) {
+        int received = ring.receive(fd);
 
         if (!server_running) break;
 
-        if (len > 0) {
-            std::string msg(buffer, len);
-            char ip[INET_ADDRSTRLEN];
-            inet_ntop(AF_INET, &client_addr.sin_addr, ip, sizeof(ip));
-            std::string addr = std::string(ip) + ":" + std::to_string(ntohs(client_addr.sin_port));
-
-            if (msg.rfind("REGISTER:", 0) == 0) {
-                size_t first_colon = 9;
-                size_t second_colon = msg.find(':', first_colon);
-                if (second_colon != std::string::npos) {
-                    std::string reg_name = msg.substr(first_colon, second_colon - first_colon);
-                    std::string reg_hardware = msg.substr(second_colon + 1);
-                    ClientInfo info{reg_name, reg_hardware, time(nullptr), true}; {
-                        std::lock_guard<std::mutex> lock(clients_mutex);
-                        bool is_new = clients.find(addr) == clients.end();
-                        clients[addr] = info;
-                        if (is_new) {
-                            std::cout << "[Server Main] Зарегистрирован НОВЫЙ клиент: " << info.name << " (" << addr <<
-                                    ")" << std::endl;
-                        } else {
-                            std::cout << "[Server Main] Обновлен клиент: " << info.name << " (" << addr << ")" <<
-                                    std::endl;
-                        }
-                    }
-                } else {
-                    std::cerr << "[Server Main] Неверный формат REGISTER от " << addr << ": " << msg << std::endl;
-                }
-            } else if (msg == "PING") {
-                std::lock_guard<std::mutex> lock(clients_mutex);
-                if (clients.count(addr)) {
-                    clients[addr].last_seen = time(nullptr);
-                    if (!clients[addr].active) {
-                        std::cout << "[Server Main] Клиент " << clients[addr].name << " (" << addr <<
-                                ") снова активен (получен PING)." << std::endl;
-                    }
-                    clients[addr].active = true;
-                } else {
-                    std::cout << "[Server Main] Получен PING от НЕИЗВЕСТНОГО клиента " << addr << ". Игнорируется." <<
-                            std::endl;
-                }
-            } else if (msg == "ROCK" || msg == "PAPER" || msg == "SCISSORS") {
-                if (game_running) {
-                    GameChoice choice = string_to_choice(msg);
-                    if (choice != INVALID) {
-                        std::lock_guard<std::mutex> clients_lock(clients_mutex);
-                        if (clients.count(addr) && clients[addr].active) {
-                            std::lock_guard<std::mutex> game_lock(game_mutex);
-                            current_choices[addr] = choice;
-                            std::cout << "[Server Main] Активный игрок " << clients[addr].name << " (" << addr <<
-                                    ") выбрал: " << msg << std::endl;
-                        }
-                    }
-                }
-            } else {
-                std::cout << "[Server Main] Получено неизвестное сообщение от " << addr << ": " << msg << std::endl;
-            }
-        } else if (len < 0) {
+        if (received > 0) {
+            handle_batch(fd, ring, received);
+        } else if (received < 0) {
             if (!server_running) break;
             if (errno == EINTR) { continue; } else if (errno == EBADF) {
-                std::cout << "[Server Main] Серверный сокет закрыт (EBADF)." << std::endl;
+                logger.info(LOG_SERVER, "[Recv Thread {}] Серверный сокет закрыт (EBADF).", index);
                 break;
-            } else { perror("[Server Main] Ошибка приема recvfrom в основном цикле"); }
+            } else { logger.error(LOG_PACKETS, "[Recv Thread {}] Ошибка приема recvmmsg (errno: {})", index, errno); }
+        }
+    }
+}
+
+int main(int argc, char *argv[]) {
+    if (!parse_args(argc, argv)) return 1;
+    logger.set_category(LOG_SERVER, "server", 0);
+    logger.set_category(LOG_CLIENTS, "clients", LOG_RATE_LIMIT);
+    logger.set_category(LOG_PACKETS, "packets", LOG_RATE_LIMIT);
+    logger.set_category(LOG_GAME, "game", 0);
+    logger.set_category(LOG_ADMIN, "admin", 0);
+    logger.set_level(config.log_level);
+    logger.start();
+    logger.info(LOG_SERVER, "[Server Main] Запуск сервера на порту {} (пакет приема: {}, потоков приема: {})...", config.port,
+                config.recv_batch, config.recv_threads);
+
+    for (unsigned i = 0; i < config.recv_threads; ++i) {
+        shards.push_back(std::make_unique<ClientShard>());
+        int fd = open_server_socket();
+        if (fd < 0) {
+            for (int opened: server_sockets) close(opened);
+            return 1;
+        }
+        server_sockets.push_back(fd);
+    }
+    logger.info(LOG_SERVER, "[Server Main] Серверных сокетов привязано к порту {}: {}.", config.port,
+                server_sockets.size());
+    int server_socket = server_sockets.front();
+
+    signal(SIGINT, handle_signal);
+    signal(SIGTERM, handle_signal);
+
+    if (config.multicast) {
+        unsigned char loop = 1, ttl = 1;
+        if (setsockopt(server_socket, IPPROTO_IP, IP_MULTICAST_IF, &config.multicast_if, sizeof(config.multicast_if)) < 0 ||
+            setsockopt(server_socket, IPPROTO_IP, IP_MULTICAST_LOOP, &loop, sizeof(loop)) < 0 ||
+            setsockopt(server_socket, IPPROTO_IP, IP_MULTICAST_TTL, &ttl, sizeof(ttl)) < 0) {
+            perror("[Server Main] Ошибка настройки multicast, рассылки пойдут только по unicast");
+            config.multicast = false;
+        } else {
+            logger.info(LOG_SERVER, "[Server Main] Multicast-рассылки в группу {}.", config.multicast_group);
+        }
+    }
+
+    if (!config.registry_path.empty() && !restore_registry()) {
+        for (int fd: server_sockets) close(fd);
+        return 1;
+    }
+
+    if (!config.journal_dir.empty()) {
+        if (!journal.open(config.journal_dir, config.journal_segment, std::chrono::milliseconds(JOURNAL_COMMIT_MS))) {
+            logger.error(LOG_SERVER, "[Journal] Не удалось открыть журнал результатов в {} (errno: {})",
+                         config.journal_dir, errno);
+            for (int fd: server_sockets) close(fd);
+            return 1;
         }
+        logger.info(LOG_SERVER, "[Journal] Журнал результатов: {}, {} записей в сегменте.", config.journal_dir,
+                    config.journal_segment);
     }
 
-    std::cout << "[Server Main] Основной цикл приема сообщений завершен." << std::endl;
+    if (config.engine == Engine::REACTOR) {
+        if (!reactor.open(server_socket)) {
+            reactor.close_fds();
+            close(server_socket);
+            return 1;
+        }
+        std::thread command_thread(handle_commands);
+        std::thread metrics_thread;
+        if (config.metrics_port) metrics_thread = std::thread(serve_metrics);
+        std::thread control_thread;
+        if (!config.control_path.empty()) control_thread = std::thread(serve_control);
+        std::thread coordinator_thread, cluster_thread;
+        if (config.coordinate_port) coordinator_thread = std::thread(&Coordinator::run, &coordinator);
+        if (config.clustered()) cluster_thread = std::thread(&ClusterLink::run, &cluster_link);
+        std::thread relay_thread;
+        if (config.relay_fanout) relay_thread = std::thread(&RelayFanout::run, &relay_fanout);
+        logger.info(LOG_SERVER, "[Server Main] Сервер готов к приему сообщений (реактор epoll)...");
+        reactor.run();
+        logger.info(LOG_SERVER, "[Server Main] Цикл событий реактора завершен.");
+        if (command_thread.joinable()) command_thread.join();
+        if (metrics_thread.joinable()) metrics_thread.join();
+        if (control_thread.joinable()) control_thread.join();
+        if (coordinator_thread.joinable()) coordinator_thread.join();
+        if (cluster_thread.joinable()) cluster_thread.join();
+        if (relay_thread.joinable()) relay_thread.join();
+        reactor.close_fds();
+        close(server_socket);
+        registry_file.close();
+        journal.close();
+        logger.info(LOG_SERVER, "[Server Main] Сервер завершил работу.");
+        logger.stop();
+        return 0;
+    }
 
-    std::cout << "[Server Main] Ожидание завершения фоновых потоков..." << std::endl;
+    std::thread update_thread(update_clients);
+    std::thread command_thread(handle_commands);
+    std::thread metrics_thread;
+    if (config.metrics_port) metrics_thread = std::thread(serve_metrics);
+    std::thread control_thread;
+    if (!config.control_path.empty()) control_thread = std::thread(serve_control);
+    std::thread coordinator_thread, cluster_thread;
+    if (config.coordinate_port) coordinator_thread = std::thread(&Coordinator::run, &coordinator);
+    if (config.clustered()) cluster_thread = std::thread(&ClusterLink::run, &cluster_link);
+    std::thread relay_thread;
+    if (config.relay_fanout) relay_thread = std::thread(&RelayFanout::run, &relay_fanout);
+
+    logger.info(LOG_SERVER, "[Server Main] Сервер готов к приему сообщений...");
+
+    std::vector<std::thread> receive_threads;
+    for (unsigned i = 1; i < config.recv_threads; ++i) receive_threads.emplace_back(receive_loop, i);
+    receive_loop(0);
+    for (auto &thread: receive_threads) thread.join();
+
+    logger.info(LOG_SERVER, "[Server Main] Основной цикл приема сообщений завершен.");
+    scheduler.stop();
+
+    logger.info(LOG_SERVER, "[Server Main] Ожидание завершения фоновых потоков...");
     if (update_thread.joinable()) {
         update_thread.join();
-        std::cout << "[Server Main] Поток обновления клиентов завершен." << std::endl;
+        logger.info(LOG_SERVER, "[Server Main] Поток обновления клиентов завершен.");
     }
     if (command_thread.joinable()) {
         command_thread.join();
-        std::cout << "[Server Main] Поток команд администратора завершен." << std::endl;
+        logger.info(LOG_SERVER, "[Server Main] Поток команд администратора завершен.");
     }
-
-    close(server_socket);
-    std::cout << "[Server Main] Сервер завершил работу." << std::endl;
+    if (metrics_thread.joinable()) metrics_thread.join();
+    if (control_thread.joinable()) control_thread.join();
+    if (coordinator_thread.joinable()) coordinator_thread.join();
+    if (cluster_thread.joinable()) cluster_thread.join();
+    if (relay_thread.joinable()) relay_thread.join();
+    game_thread.join(); // турнир, прерванный остановкой, еще рассылает ABORTED и пишет журнал
+
+    for (int fd: server_sockets) close(fd);
+    registry_file.close();
+    journal.close();
+    logger.info(LOG_SERVER, "[Server Main] Сервер завершил работу.");
+    logger.stop();
     return 0;
 }
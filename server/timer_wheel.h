@@ -0,0 +1,129 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+#include <algorithm>
+
+// Двухуровневое иерархическое колесо таймеров для плотных id (по одному таймеру на id).
+// Узлы интрузивные (массивы next/prev по id), поэтому перенос таймера - O(1) без выделений,
+// а стоимость advance() пропорциональна числу сработавших таймеров, а не числу id.
+class TimerWheel {
+public:
+    static constexpr uint32_t NONE = ~0u;
+
+    TimerWheel(uint64_t tick_ms, uint64_t now_ms)
+        : tick_ms_(tick_ms), current_tick_(now_ms / tick_ms), heads_(L0_SLOTS + L1_SLOTS, NONE) {
+    }
+
+    // (Пере)планировать таймер id на момент deadline_ms.
+    void schedule(uint32_t id, uint64_t deadline_ms) {
+        ensure(id);
+        unlink(id);
+        deadline_ms_[id] = deadline_ms;
+        uint64_t tick = deadline_tick(deadline_ms);
+        place(id, tick > current_tick_ ? tick : current_tick_ + 1);
+    }
+
+    void cancel(uint32_t id) {
+        if (id < slot_.size()) unlink(id);
+    }
+
+    bool scheduled(uint32_t id) const { return id < slot_.size() && slot_[id] != NONE; }
+
+    uint64_t deadline(uint32_t id) const { return deadline_ms_[id]; }
+
+    // Прокрутить колесо до now_ms, вызывая on_expire(id, deadline_ms) для каждого истекшего таймера.
+    // Из on_expire можно перепланировать только сам сработавший id.
+    template<typename F>
+    size_t advance(uint64_t now_ms, F &&on_expire) {
+        size_t expired = 0;
+        uint64_t target = now_ms / tick_ms_;
+        while (current_tick_ < target) {
+            ++current_tick_;
+            if ((current_tick_ & L0_MASK) == 0) {
+                uint32_t id = detach(L0_SLOTS + ((current_tick_ >> L0_BITS) & L1_MASK));
+                while (id != NONE) {
+                    uint32_t next = next_[id];
+                    place(id, deadline_tick(deadline_ms_[id]));
+                    id = next;
+                }
+            }
+            uint32_t id = detach(current_tick_ & L0_MASK);
+            while (id != NONE) {
+                uint32_t next = next_[id];
+                if (deadline_tick(deadline_ms_[id]) > current_tick_) {
+                    place(id, deadline_tick(deadline_ms_[id]));
+                } else {
+                    expired++;
+                    on_expire(id, deadline_ms_[id]);
+                }
+                id = next;
+            }
+        }
+        return expired;
+    }
+
+private:
+    static constexpr uint32_t L0_BITS = 8;
+    static constexpr uint32_t L0_SLOTS = 1u << L0_BITS;
+    static constexpr uint32_t L0_MASK = L0_SLOTS - 1;
+    static constexpr uint32_t L1_SLOTS = 64;
+    static constexpr uint32_t L1_MASK = L1_SLOTS - 1;
+
+    uint64_t deadline_tick(uint64_t deadline_ms) const { return (deadline_ms + tick_ms_ - 1) / tick_ms_; }
+
+    void ensure(uint32_t id) {
+        if (id < slot_.size()) return;
+        size_t size = std::max<size_t>(static_cast<size_t>(id) + 1, slot_.size() * 2);
+        next_.resize(size, NONE);
+        prev_.resize(size, NONE);
+        slot_.resize(size, NONE);
+        deadline_ms_.resize(size, 0);
+    }
+
+    void place(uint32_t id, uint64_t tick) {
+        uint64_t delta = tick > current_tick_ ? tick - current_tick_ : 0;
+        if (delta < L0_SLOTS) {
+            link(id, static_cast<uint32_t>(tick & L0_MASK));
+        } else {
+            // Слишком далекие таймеры кладем в последнюю ротацию, при каскаде они перепланируются.
+            uint64_t rotation = tick >> L0_BITS;
+            uint64_t max_rotation = (current_tick_ >> L0_BITS) + L1_SLOTS - 1;
+            if (rotation > max_rotation) rotation = max_rotation;
+            link(id, L0_SLOTS + static_cast<uint32_t>(rotation & L1_MASK));
+        }
+    }
+
+    void link(uint32_t id, uint32_t slot) {
+        slot_[id] = slot;
+        prev_[id] = NONE;
+        next_[id] = heads_[slot];
+        if (heads_[slot] != NONE) prev_[heads_[slot]] = id;
+        heads_[slot] = id;
+    }
+
+    void unlink(uint32_t id) {
+        uint32_t slot = slot_[id];
+        if (slot == NONE) return;
+        if (prev_[id] != NONE) next_[prev_[id]] = next_[id]; else heads_[slot] = next_[id];
+        if (next_[id] != NONE) prev_[next_[id]] = prev_[id];
+        slot_[id] = NONE;
+    }
+
+    // Забрать весь список слота; узлы помечаются как незапланированные.
+    uint32_t detach(uint32_t slot) {
+        uint32_t head = heads_[slot];
+        heads_[slot] = NONE;
+        for (uint32_t id = head; id != NONE; id = next_[id]) slot_[id] = NONE;
+        return head;
+    }
+
+    uint64_t tick_ms_;
+    uint64_t current_tick_;
+    std::vector<uint32_t> heads_;
+    std::vector<uint32_t> next_;
+    std::vector<uint32_t> prev_;
+    std::vector<uint32_t> slot_;
+    std::vector<uint64_t> deadline_ms_;
+};